@@ -3,34 +3,47 @@
 //
 
 #include "Activation.h"
+#include "MatrixKernels.h"
 
 
 Matrix activation::relu (const Matrix &matrix)
 {
   Matrix result(matrix);
-
-  for(int i=0 ; i<matrix.get_rows() ; ++i)
-  {
-    for (int j=0 ; j<matrix.get_cols() ; ++j)
-    {
-      result(i, j) = matrix(i, j) >= 0 ?
-          matrix(i, j) : 0;
-    }
-  }
+  relu_in_place (result.data (), matrix.get_rows () * matrix.get_cols ());
   return result;
 }
 
 Matrix activation::softmax (const Matrix &matrix)
 {
   Matrix result (matrix);
-  float s = ZERO;
-  for (int i = 0 ; i<matrix.get_rows () ; ++i)
+  softmax_in_place (result.data (), matrix.get_rows () * matrix.get_cols ());
+  return result;
+}
+
+void activation::relu_in_place (float *values, int n)
+{
+  kernels::relu (values, values, n);
+}
+
+void activation::softmax_in_place (float *values, int n)
+{
+  for (int i = 0 ; i<n ; ++i)
+  {
+    values[i] = std::exp (values[i]);
+  }
+  float s = kernels::sum (values, n);
+  kernels::scale (values, 1 / s, values, n);
+}
+
+activation_in_place_fn activation::in_place (activation_fn func)
+{
+  if (func == relu)
+  {
+    return relu_in_place;
+  }
+  if (func == softmax)
   {
-    for (int j=0 ; j<matrix.get_cols() ; ++j)
-    {
-      result(i, j) = std::exp (matrix(i, j));
-      s += result(i, j);
-    }
+    return softmax_in_place;
   }
-  return result * (1 / s);
+  return nullptr;
 }
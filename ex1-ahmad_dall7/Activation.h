@@ -7,11 +7,24 @@
 
 
 typedef Matrix (*activation_fn) (const Matrix &) ;
+typedef void (*activation_in_place_fn) (float *, int);
 
 namespace activation
 {
     Matrix relu(const Matrix & matrix);
     Matrix softmax(const Matrix & matrix);
+
+    /**
+     * relu / softmax of n contiguous values, in place and without
+     * allocating. Same results as the Matrix versions.
+     */
+    void relu_in_place(float * values, int n);
+    void softmax_in_place(float * values, int n);
+
+    /**
+     * @return the in place form of func, nullptr for other functions
+     */
+    activation_in_place_fn in_place(activation_fn func);
 }
 
 
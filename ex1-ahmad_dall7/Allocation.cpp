@@ -0,0 +1,166 @@
+//
+// Aligned, huge page backed buffers.
+//
+
+#include "Allocation.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#include <sys/mman.h>
+
+static std::atomic<int> current_policy (allocation::TRANSPARENT_HUGE_PAGES);
+static std::atomic<size_t> current_threshold (DEFAULT_HUGE_THRESHOLD);
+static std::atomic<long> normal_count (0);
+static std::atomic<long> transparent_count (0);
+static std::atomic<long> hugetlb_count (0);
+static std::atomic<long> fallback_count (0);
+
+static size_t round_up (size_t bytes, size_t unit)
+{
+  return (bytes + unit - 1) / unit * unit;
+}
+
+static float *aligned_block (size_t alignment, size_t bytes)
+{
+  void *p = nullptr;
+  if (posix_memalign (&p, alignment, round_up (bytes, alignment)) != 0)
+  {
+    throw std::bad_alloc ();
+  }
+  return (float *) p;
+}
+
+/**
+ * A 2MB aligned heap block the kernel is asked to back with transparent
+ * huge pages, or a plain aligned block where it can not.
+ */
+static float *transparent_huge_block (size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+  size_t length = round_up (bytes, HUGE_PAGE_BYTES);
+  float *p = aligned_block (HUGE_PAGE_BYTES, length);
+  if (madvise (p, length, MADV_HUGEPAGE) == 0)
+  {
+    ++transparent_count;
+    return p;
+  }
+  std::free (p);
+#endif
+  ++normal_count;
+  return aligned_block (ALLOCATION_ALIGNMENT, bytes);
+}
+
+void allocation::set_policy (page_policy policy, size_t huge_threshold)
+{
+  current_policy = policy;
+  current_threshold = huge_threshold;
+}
+
+allocation::page_policy allocation::get_policy ()
+{
+  return (page_policy) current_policy.load ();
+}
+
+size_t allocation::get_huge_threshold ()
+{
+  return current_threshold.load ();
+}
+
+allocation::allocation_stats allocation::get_stats ()
+{
+  return allocation_stats{normal_count.load (), transparent_count.load (),
+                          hugetlb_count.load (), fallback_count.load ()};
+}
+
+allocation::buffer::buffer (size_t floats) : _size (floats)
+{
+  size_t bytes = floats == 0 ? sizeof (float) : floats * sizeof (float);
+  page_policy policy = get_policy ();
+  if (policy == NORMAL_PAGES || bytes < get_huge_threshold ())
+  {
+    ++normal_count;
+    _data = aligned_block (ALLOCATION_ALIGNMENT, bytes);
+    return;
+  }
+#ifdef MAP_HUGETLB
+  if (policy == HUGETLB_PAGES)
+  {
+    size_t length = round_up (bytes, HUGE_PAGE_BYTES);
+    void *p = mmap (nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+      ++hugetlb_count;
+      _data = (float *) p;
+      _mapped = length;
+      return;
+    }
+    ++fallback_count;
+  }
+#else
+  fallback_count += policy == HUGETLB_PAGES;
+#endif
+  _data = transparent_huge_block (bytes);
+}
+
+allocation::buffer::~buffer ()
+{
+  release ();
+}
+
+allocation::buffer::buffer (buffer &&other) noexcept
+    : _data (other._data), _size (other._size), _mapped (other._mapped)
+{
+  other._data = nullptr;
+  other._size = 0;
+  other._mapped = 0;
+}
+
+allocation::buffer &allocation::buffer::operator= (buffer &&other) noexcept
+{
+  if (this != &other)
+  {
+    release ();
+    std::swap (_data, other._data);
+    std::swap (_size, other._size);
+    std::swap (_mapped, other._mapped);
+  }
+  return *this;
+}
+
+void allocation::buffer::release ()
+{
+  if (_data == nullptr)
+  {
+    return;
+  }
+  if (_mapped != 0)
+  {
+    munmap (_data, _mapped);
+  }
+  else
+  {
+    std::free (_data);
+  }
+  _data = nullptr;
+  _size = 0;
+  _mapped = 0;
+}
+
+float *allocation::buffer::data ()
+{
+  return _data;
+}
+
+const float *allocation::buffer::data () const
+{
+  return _data;
+}
+
+size_t allocation::buffer::size () const
+{
+  return _size;
+}
@@ -0,0 +1,102 @@
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+#include <cstddef>
+
+#define CACHE_LINE 64
+// every buffer starts on a cache line boundary
+#define ALLOCATION_ALIGNMENT CACHE_LINE
+#define HUGE_PAGE_BYTES (2UL << 20)
+// buffers of at least this many bytes go on huge pages, smaller ones would
+// waste most of a huge page
+#define DEFAULT_HUGE_THRESHOLD (HUGE_PAGE_BYTES / 2)
+
+/**
+ * Where Matrix and InferenceContext storage comes from.
+ *
+ * Small buffers are plain cache aligned heap blocks. Buffers of at least
+ * the huge page threshold are backed by 2MB pages according to the
+ * policy, so a large weight or batch matrix needs a few TLB entries rather
+ * than hundreds: TRANSPARENT_HUGE_PAGES allocates them 2MB aligned and
+ * madvises the kernel to use transparent huge pages, HUGETLB_PAGES maps
+ * them from the hugetlbfs pool and falls back to transparent huge pages
+ * when the pool is empty. Systems without either get normal pages.
+ *
+ * Buffers are not initialized. The kernel places a page on the NUMA node
+ * of the thread that first writes it, so whoever fills a buffer should be
+ * the thread that will use it; Matrix fills its storage in the
+ * constructor.
+ */
+namespace allocation
+{
+    typedef enum page_policy {
+        NORMAL_PAGES,
+        TRANSPARENT_HUGE_PAGES,
+        HUGETLB_PAGES
+    } page_policy;
+
+    /**
+     * @struct allocation_stats
+     * @brief Buffers allocated since the start of the process, by the pages
+     *        they got.
+     * @var normal - buffers on normal pages
+     * @var transparent_huge - buffers madvised to transparent huge pages
+     * @var hugetlb - buffers mapped from the hugetlbfs pool
+     * @var hugetlb_fallbacks - HUGETLB_PAGES requests the pool could not
+     *      serve
+     */
+    typedef struct allocation_stats {
+        long normal;
+        long transparent_huge;
+        long hugetlb;
+        long hugetlb_fallbacks;
+    } allocation_stats;
+
+    /**
+     * Sets the policy for buffers allocated from now on, for all threads.
+     * The default is TRANSPARENT_HUGE_PAGES from DEFAULT_HUGE_THRESHOLD.
+     */
+    void set_policy (page_policy policy,
+                     size_t huge_threshold = DEFAULT_HUGE_THRESHOLD);
+
+    page_policy get_policy ();
+
+    size_t get_huge_threshold ();
+
+    allocation_stats get_stats ();
+
+    /**
+     * Move only owner of an aligned, uninitialized float buffer.
+     */
+    class buffer
+    {
+     public:
+      buffer () = default;
+
+      /**
+       * @throw std::bad_alloc if the memory can not be allocated
+       */
+      explicit buffer (size_t floats) noexcept(false);
+
+      ~buffer ();
+
+      buffer (buffer &&other) noexcept;
+      buffer &operator= (buffer &&other) noexcept;
+      buffer (const buffer &) = delete;
+      buffer &operator= (const buffer &) = delete;
+
+      float *data ();
+      const float *data () const;
+      size_t size () const;
+
+     private:
+      void release ();
+
+      float *_data = nullptr;
+      size_t _size = 0;
+      // length of the mapping for hugetlbfs buffers, 0 for heap blocks
+      size_t _mapped = 0;
+    };
+}
+
+#endif //ALLOCATION_H
@@ -0,0 +1,424 @@
+//
+// Chunked, checkpointed bulk scoring of image manifests.
+//
+
+#include "BulkScorer.h"
+#include "MlpIO.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "mlpscore"
+#define CSV_HEADER "path,digit,probability,error\n"
+#define UNREADABLE_IMAGE "unreadable image"
+#define OUTPUT_BUFFER_BYTES (1 << 20)
+// room for the longest number field: a %u or a %.9g with its key and
+// separators is well under this
+#define NUMBER_BUFFER 64
+
+typedef std::chrono::steady_clock scoring_clock;
+
+/**
+ * @return the first field of every non-empty manifest line
+ */
+static std::vector<std::string> read_manifest (const std::string &path)
+{
+  std::ifstream in (path);
+  if (!in.is_open ())
+  {
+    throw std::invalid_argument (MANIFEST_READ_ERR + path);
+  }
+  std::vector<std::string> paths;
+  std::string line;
+  while (std::getline (in, line))
+  {
+    std::istringstream fields (line);
+    std::string image;
+    if (fields >> image)
+    {
+      paths.push_back (image);
+    }
+  }
+  return paths;
+}
+
+static void append_json_string (std::string &out, const std::string &s)
+{
+  out += '"';
+  for (char c: s)
+  {
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += c;
+    }
+    else if ((unsigned char) c < 0x20)
+    {
+      char escaped[8];
+      std::snprintf (escaped, sizeof (escaped), "\\u%04x", c);
+      out += escaped;
+    }
+    else
+    {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+static void append_csv_field (std::string &out, const std::string &s)
+{
+  if (s.find_first_of (",\"\n\r") == std::string::npos)
+  {
+    out += s;
+    return;
+  }
+  out += '"';
+  for (char c: s)
+  {
+    if (c == '"')
+    {
+      out += '"';
+    }
+    out += c;
+  }
+  out += '"';
+}
+
+static void append_record (std::string &out, output_format format,
+                           const std::string &path, const digit *d)
+{
+  char number[NUMBER_BUFFER];
+  if (format == JSONL)
+  {
+    out += "{\"path\":";
+    append_json_string (out, path);
+    if (d != nullptr)
+    {
+      std::snprintf (number, sizeof (number), ",\"digit\":%u",
+                     d->value);
+      out += number;
+      std::snprintf (number, sizeof (number), ",\"probability\":%.9g",
+                     d->probability);
+      out += number;
+      out += "}\n";
+    }
+    else
+    {
+      out += ",\"error\":\"" UNREADABLE_IMAGE "\"}\n";
+    }
+    return;
+  }
+  append_csv_field (out, path);
+  if (d != nullptr)
+  {
+    std::snprintf (number, sizeof (number), ",%u,%.9g,\n", d->value,
+                   d->probability);
+    out += number;
+  }
+  else
+  {
+    out += ",,," UNREADABLE_IMAGE "\n";
+  }
+}
+
+/**
+ * Reads the last complete "<chunks> <output bytes>" record of a checkpoint.
+ * @return false if there is no checkpoint
+ * @throw std::invalid_argument if it belongs to a different job
+ */
+static bool read_checkpoint (const std::string &path, const std::string &header,
+                             long &chunks, long &offset)
+{
+  std::ifstream in (path, std::ios::in | std::ios::binary);
+  if (!in.is_open ())
+  {
+    return false;
+  }
+  std::stringstream contents;
+  contents << in.rdbuf ();
+  std::string text = contents.str ();
+  // a record cut short by a crash has no newline and is ignored
+  size_t end = text.rfind ('\n');
+  if (end == std::string::npos || text.compare (0, header.size (), header) != 0
+      || text[header.size ()] != '\n')
+  {
+    throw std::invalid_argument (CHECKPOINT_ERR + path);
+  }
+  size_t start = text.rfind ('\n', end - 1);
+  std::istringstream record (text.substr (start + 1, end - start - 1));
+  if (start == header.size () - 1 || !(record >> chunks >> offset))
+  {
+    throw std::invalid_argument (CHECKPOINT_ERR + path);
+  }
+  return true;
+}
+
+static void sync_file (FILE *file, const std::string &path)
+{
+  if (std::fflush (file) != 0 || fsync (fileno (file)) != 0)
+  {
+    throw std::runtime_error (OUTPUT_WRITE_ERR + path);
+  }
+}
+
+/**
+ * Output and checkpoint files of a running job. Chunks finish in any order
+ * and are written in manifest order.
+ */
+class ResultWriter
+{
+ public:
+  ResultWriter (const std::string &output, const std::string &checkpoint,
+                long chunks, long offset)
+      : _output_path (output), _checkpoint_path (checkpoint),
+        _committed (chunks), _offset (offset)
+  {
+    _output = std::fopen (output.c_str (), "ab");
+    _checkpoint = std::fopen (checkpoint.c_str (), "ab");
+    if (_output == nullptr || _checkpoint == nullptr)
+    {
+      close ();
+      throw std::runtime_error (OUTPUT_WRITE_ERR + output);
+    }
+    std::setvbuf (_output, nullptr, _IOFBF, OUTPUT_BUFFER_BYTES);
+  }
+
+  ~ResultWriter ()
+  {
+    close ();
+  }
+
+  ResultWriter (const ResultWriter &) = delete;
+  ResultWriter &operator= (const ResultWriter &) = delete;
+
+  /**
+   * Queues the records of chunk and writes every chunk that is now next in
+   * order, then checkpoints them.
+   */
+  void add (long chunk, std::string records)
+  {
+    std::lock_guard<std::mutex> lock (_lock);
+    _pending[chunk] = std::move (records);
+    bool wrote = false;
+    for (auto it = _pending.find (_committed); it != _pending.end ();
+         it = _pending.find (_committed))
+    {
+      const std::string &data = it->second;
+      if (std::fwrite (data.data (), 1, data.size (), _output) != data.size ())
+      {
+        throw std::runtime_error (OUTPUT_WRITE_ERR + _output_path);
+      }
+      _offset += (long) data.size ();
+      ++_committed;
+      _pending.erase (it);
+      wrote = true;
+    }
+    if (wrote)
+    {
+      // the records must be on disk before the checkpoint that covers them
+      sync_file (_output, _output_path);
+      std::fprintf (_checkpoint, "%ld %ld\n", _committed, _offset);
+      sync_file (_checkpoint, _checkpoint_path);
+    }
+  }
+
+  long committed ()
+  {
+    std::lock_guard<std::mutex> lock (_lock);
+    return _committed;
+  }
+
+ private:
+  void close ()
+  {
+    if (_output != nullptr)
+    {
+      std::fclose (_output);
+      _output = nullptr;
+    }
+    if (_checkpoint != nullptr)
+    {
+      std::fclose (_checkpoint);
+      _checkpoint = nullptr;
+    }
+  }
+
+  std::string _output_path;
+  std::string _checkpoint_path;
+  FILE *_output = nullptr;
+  FILE *_checkpoint = nullptr;
+  std::mutex _lock;
+  std::map<long, std::string> _pending;
+  long _committed;
+  long _offset;
+};
+
+/**
+ * Starts a job from scratch: an empty output (a CSV header only) and a
+ * checkpoint with no chunks done.
+ * @return length of the output
+ */
+static long start_job (const scoring_config &config,
+                       const std::string &checkpoint, const std::string &header)
+{
+  std::string start = config.format == CSV ? CSV_HEADER : "";
+  FILE *output = std::fopen (config.output.c_str (), "wb");
+  FILE *progress = std::fopen (checkpoint.c_str (), "wb");
+  bool ok = output != nullptr && progress != nullptr
+            && std::fwrite (start.data (), 1, start.size (), output)
+               == start.size ()
+            && std::fprintf (progress, "%s\n0 %ld\n", header.c_str (),
+                             (long) start.size ()) > 0
+            && std::fflush (output) == 0 && fsync (fileno (output)) == 0
+            && std::fflush (progress) == 0 && fsync (fileno (progress)) == 0;
+  if (output != nullptr)
+  {
+    std::fclose (output);
+  }
+  if (progress != nullptr)
+  {
+    std::fclose (progress);
+  }
+  if (!ok)
+  {
+    throw std::runtime_error (OUTPUT_WRITE_ERR + config.output);
+  }
+  return (long) start.size ();
+}
+
+scoring_stats score_manifest (const scoring_config &config)
+{
+  if (config.threads < 1 || config.chunk_size < 1 || config.max_chunks < -1
+      || config.output.empty ())
+  {
+    throw std::invalid_argument (SCORING_CONFIG_ERR);
+  }
+  auto start = scoring_clock::now ();
+  std::vector<std::string> paths = read_manifest (config.manifest);
+  std::unique_ptr<MlpNetwork> network = load_network (config.model);
+  long total_chunks = ((long) paths.size () + config.chunk_size - 1)
+                      / config.chunk_size;
+
+  std::string checkpoint = config.output + CHECKPOINT_SUFFIX;
+  std::string header = std::string (CHECKPOINT_MAGIC) + " "
+                       + std::to_string (paths.size ()) + " "
+                       + std::to_string (config.chunk_size) + " "
+                       + (config.format == JSONL ? "jsonl" : "csv");
+  long done = 0, offset = 0;
+  if (read_checkpoint (checkpoint, header, done, offset))
+  {
+    // drop whatever was written after the last checkpoint
+    std::ifstream existing (config.output, std::ios::in | std::ios::binary
+                                           | std::ios::ate);
+    if (done > total_chunks || !existing.is_open ()
+        || (long) existing.tellg () < offset
+        || truncate (config.output.c_str (), offset) != 0)
+    {
+      throw std::invalid_argument (CHECKPOINT_ERR + checkpoint);
+    }
+  }
+  else
+  {
+    offset = start_job (config, checkpoint, header);
+  }
+
+  long end = config.max_chunks < 0 ? total_chunks
+                                   : std::min (total_chunks,
+                                               done + config.max_chunks);
+  ResultWriter writer (config.output, checkpoint, done, offset);
+  std::atomic<long> next_chunk (done);
+  std::atomic<long> failed (0);
+  std::mutex error_lock;
+  std::exception_ptr error;
+  int inputs = network->get_layer (0).input_size ();
+
+  auto worker = [&] ()
+  {
+    try
+    {
+      InferenceContext context;
+      std::vector<Matrix> images (config.chunk_size, Matrix (inputs, 1));
+      std::vector<digit> results (config.chunk_size);
+      std::vector<char> readable (config.chunk_size);
+      for (long chunk = next_chunk++; chunk < end; chunk = next_chunk++)
+      {
+        long first = chunk * config.chunk_size;
+        int count = (int) std::min ((long) config.chunk_size,
+                                    (long) paths.size () - first);
+        for (int i = 0; i < count; ++i)
+        {
+          try
+          {
+            readable[i] = read_matrix_file (paths[first + i], images[i]);
+          }
+          catch (const std::runtime_error &)
+          {
+            readable[i] = false;
+          }
+        }
+        // unreadable slots still hold an older image, their results are
+        // never written
+        network->predict (images.data (), count, results.data (), context);
+
+        std::string records;
+        for (int i = 0; i < count; ++i)
+        {
+          append_record (records, config.format, paths[first + i],
+                         readable[i] ? &results[i] : nullptr);
+          failed += !readable[i];
+        }
+        writer.add (chunk, std::move (records));
+      }
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock (error_lock);
+      if (!error)
+      {
+        error = std::current_exception ();
+      }
+      // the other workers stop after their current chunk
+      next_chunk = end;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 1; t < config.threads; ++t)
+  {
+    workers.emplace_back (worker);
+  }
+  worker ();
+  for (std::thread &t: workers)
+  {
+    t.join ();
+  }
+  if (error)
+  {
+    std::rethrow_exception (error);
+  }
+
+  scoring_stats stats{};
+  stats.resumed_chunks = done;
+  stats.done_chunks = writer.committed ();
+  stats.total_chunks = total_chunks;
+  long manifest_size = (long) paths.size ();
+  stats.images = std::min (manifest_size,
+                           stats.done_chunks * config.chunk_size)
+                 - std::min (manifest_size, done * config.chunk_size);
+  stats.failed = failed.load ();
+  stats.seconds = std::chrono::duration<double> (scoring_clock::now ()
+                                                 - start).count ();
+  stats.images_per_sec = stats.seconds > 0 ? stats.images / stats.seconds : 0;
+  return stats;
+}
@@ -0,0 +1,84 @@
+#ifndef BULKSCORER_H
+#define BULKSCORER_H
+
+#include <string>
+
+#define CHECKPOINT_SUFFIX ".ckpt"
+#define CHECKPOINT_ERR "Error: checkpoint does not match this job: "
+#define SCORING_CONFIG_ERR "Invalid scoring configuration"
+#define MANIFEST_READ_ERR "Error: can not read manifest: "
+#define OUTPUT_WRITE_ERR "Error: can not write output: "
+
+/**
+ * @enum output_format
+ * @brief Result records of a scoring job: one JSON object per line, or
+ *        CSV rows under a path,digit,probability,error header.
+ */
+typedef enum output_format {
+    JSONL,
+    CSV
+} output_format;
+
+/**
+ * @struct scoring_config
+ * @brief One bulk scoring job.
+ * @var manifest - one image path per line
+ * @var model - a model file or parameter directory, see load_network
+ * @var output - results file, progress is kept next to it in
+ *      output + CHECKPOINT_SUFFIX
+ * @var threads - worker threads, each scores whole chunks
+ * @var format - JSONL or CSV
+ * @var chunk_size - images per chunk, the unit of work and of checkpoints
+ * @var max_chunks - stop after this many chunks, -1 for no limit
+ */
+typedef struct scoring_config {
+    std::string manifest;
+    std::string model;
+    std::string output;
+    int threads = 1;
+    output_format format = JSONL;
+    int chunk_size = 1024;
+    long max_chunks = -1;
+} scoring_config;
+
+/**
+ * @struct scoring_stats
+ * @brief What one run of a job did.
+ * @var images - images scored in this run
+ * @var failed - images of this run that could not be read
+ * @var resumed_chunks - chunks already done by earlier runs
+ * @var done_chunks - chunks done after this run
+ * @var total_chunks - chunks in the manifest
+ * @var seconds - wall clock time of this run
+ * @var images_per_sec - images / seconds
+ */
+typedef struct scoring_stats {
+    long images;
+    long failed;
+    long resumed_chunks;
+    long done_chunks;
+    long total_chunks;
+    double seconds;
+    double images_per_sec;
+} scoring_stats;
+
+/**
+ * Classifies every image of a manifest into a results file.
+ *
+ * The manifest is split into chunks of chunk_size lines that the worker
+ * threads claim in order; each worker runs its chunk through the network as
+ * one batch with its own InferenceContext and formats the records into a
+ * buffer. Finished chunks are appended to the output in manifest order and
+ * synced, then the checkpoint records how many chunks are done and how long
+ * the output is. A run that finds a checkpoint for the same manifest length,
+ * chunk size and format cuts the output back to the recorded length, which
+ * drops anything written after the last checkpoint, and continues with the
+ * next chunk. Images that can not be read get a record with an error.
+ *
+ * @throw std::invalid_argument on a bad configuration, an unreadable
+ *        manifest or model, or a checkpoint of a different job
+ * @throw std::runtime_error if the output can not be written
+ */
+scoring_stats score_manifest (const scoring_config &config) noexcept(false);
+
+#endif //BULKSCORER_H
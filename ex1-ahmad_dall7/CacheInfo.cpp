@@ -0,0 +1,36 @@
+//
+// Cache sizes from sysconf, with fallbacks for systems that do not report
+// them.
+//
+
+#include "CacheInfo.h"
+
+#include <unistd.h>
+
+static long sysconf_or (int name, long fallback)
+{
+  long value = sysconf (name);
+  return value > 0 ? value : fallback;
+}
+
+long cache_info::l1d_bytes ()
+{
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  static const long bytes = sysconf_or (_SC_LEVEL1_DCACHE_SIZE,
+                                        DEFAULT_L1D_BYTES);
+  return bytes;
+#else
+  return DEFAULT_L1D_BYTES;
+#endif
+}
+
+long cache_info::l2_bytes ()
+{
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  static const long bytes = sysconf_or (_SC_LEVEL2_CACHE_SIZE,
+                                        DEFAULT_L2_BYTES);
+  return bytes;
+#else
+  return DEFAULT_L2_BYTES;
+#endif
+}
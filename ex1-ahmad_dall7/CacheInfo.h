@@ -0,0 +1,24 @@
+#ifndef CACHEINFO_H
+#define CACHEINFO_H
+
+// used when the system does not report its cache sizes
+#define DEFAULT_L1D_BYTES 32768
+#define DEFAULT_L2_BYTES 262144
+
+/**
+ * Data cache sizes of the machine, read once from sysconf.
+ */
+namespace cache_info
+{
+    /**
+     * @return size in bytes of one core's L1 data cache
+     */
+    long l1d_bytes ();
+
+    /**
+     * @return size in bytes of one core's L2 cache
+     */
+    long l2_bytes ();
+}
+
+#endif //CACHEINFO_H
@@ -0,0 +1,113 @@
+//
+// Confidence gated cascade of networks.
+//
+
+#include "Cascade.h"
+
+#include <chrono>
+
+typedef std::chrono::steady_clock cascade_clock;
+
+void Cascade::add_stage (std::unique_ptr<MlpNetwork> network, float threshold)
+{
+  if (!network)
+  {
+    throw std::invalid_argument (CASCADE_EMPTY_ERR);
+  }
+  if (!(threshold >= 0.f && threshold <= 1.f))
+  {
+    throw std::invalid_argument (THRESHOLD_ERR);
+  }
+  std::unique_ptr<stage> s (new stage);
+  s->network = std::move (network);
+  s->threshold = threshold;
+  _stages.push_back (std::move (s));
+}
+
+digit Cascade::operator() (const Matrix &img, InferenceContext &context) const
+{
+  if (_stages.empty ())
+  {
+    throw std::invalid_argument (CASCADE_EMPTY_ERR);
+  }
+  digit d{ZERO, ZERO_F};
+  for (size_t i = 0; i < _stages.size (); ++i)
+  {
+    stage &s = *_stages[i];
+    auto start = cascade_clock::now ();
+    d = (*s.network) (img, context);
+    s.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds> (
+        cascade_clock::now () - start).count ();
+    ++s.evaluated;
+    if (i + 1 == _stages.size () || d.probability >= s.threshold)
+    {
+      ++s.answered;
+      break;
+    }
+  }
+  return d;
+}
+
+int Cascade::get_stages_count () const
+{
+  return (int) _stages.size ();
+}
+
+const MlpNetwork &Cascade::get_stage (int stage) const
+{
+  if (stage < ZERO || stage >= get_stages_count ())
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERR);
+  }
+  return *_stages[stage]->network;
+}
+
+float Cascade::get_threshold (int stage) const
+{
+  if (stage < ZERO || stage >= get_stages_count ())
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERR);
+  }
+  return _stages[stage]->threshold;
+}
+
+std::vector<stage_stats> Cascade::get_stats () const
+{
+  std::vector<stage_stats> stats;
+  for (const auto &s: _stages)
+  {
+    long evaluated = s->evaluated.load ();
+    long answered = s->answered.load ();
+    double us = s->nanoseconds.load () / 1e3;
+    stats.push_back (stage_stats{
+        evaluated, answered,
+        evaluated > 0 ? (double) answered / evaluated : 0.,
+        evaluated > 0 ? us / evaluated : 0.});
+  }
+  return stats;
+}
+
+double Cascade::average_us () const
+{
+  if (_stages.empty () || _stages[0]->evaluated.load () == 0)
+  {
+    return 0.;
+  }
+  // every image passes the first stage
+  long total_ns = 0;
+  for (const auto &s: _stages)
+  {
+    total_ns += s->nanoseconds.load ();
+  }
+  return total_ns / 1e3 / _stages[0]->evaluated.load ();
+}
+
+void Cascade::reset_stats ()
+{
+  for (auto &s: _stages)
+  {
+    s->evaluated = 0;
+    s->answered = 0;
+    s->nanoseconds = 0;
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include "MlpNetwork.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#define CASCADE_EMPTY_ERR "Error: a cascade needs at least one stage"
+#define THRESHOLD_ERR "Error: cascade thresholds must be in [0, 1]"
+
+/**
+ * @struct stage_stats
+ * @brief What one cascade stage did since the last reset.
+ * @var evaluated - images the stage ran on
+ * @var answered - images whose answer came from the stage
+ * @var hit_rate - answered / evaluated
+ * @var average_us - mean time the stage took per evaluated image
+ */
+typedef struct stage_stats {
+    long evaluated;
+    long answered;
+    double hit_rate;
+    double average_us;
+} stage_stats;
+
+/**
+ * Confidence gated chain of networks. Every image goes to the first
+ * stage; a stage's answer is returned when its probability reaches the
+ * stage's threshold, otherwise the image escalates to the next stage. The
+ * last stage always answers.
+ *
+ * Inference only reads the networks, so a cascade can be shared by
+ * threads that each pass their own InferenceContext. Statistics are kept
+ * with atomic counters.
+ */
+class Cascade
+{
+ public:
+  Cascade () = default;
+  Cascade (const Cascade &) = delete;
+  Cascade &operator= (const Cascade &) = delete;
+
+  /**
+   * Appends a stage. threshold is ignored for the last stage.
+   * @throw std::invalid_argument if network is null or threshold is not in
+   *        [0, 1]
+   */
+  void add_stage (std::unique_ptr<MlpNetwork> network, float threshold)
+  noexcept(false);
+
+  /**
+   * @throw std::invalid_argument if the cascade has no stages
+   */
+  digit operator() (const Matrix &img, InferenceContext &context) const
+  noexcept(false);
+
+  int get_stages_count () const;
+  const MlpNetwork &get_stage (int stage) const;
+  float get_threshold (int stage) const;
+
+  std::vector<stage_stats> get_stats () const;
+
+  /**
+   * @return mean time per image over the whole cascade, in microseconds
+   */
+  double average_us () const;
+
+  void reset_stats ();
+
+ private:
+  typedef struct stage {
+      std::unique_ptr<MlpNetwork> network;
+      float threshold;
+      std::atomic<long> evaluated{0};
+      std::atomic<long> answered{0};
+      std::atomic<long> nanoseconds{0};
+  } stage;
+
+  std::vector<std::unique_ptr<stage>> _stages;
+};
+
+#endif //CASCADE_H
@@ -0,0 +1,157 @@
+//
+// Convolution layer: im2col lowering onto the Matrix GEMM, plus a direct
+// path for 3x3 kernels.
+//
+
+#include "Conv2D.h"
+#include "MatrixKernels.h"
+
+#include <vector>
+
+Conv2D::Conv2D (const image_shape &input, int kernel, Matrix &weights,
+                Matrix &bias, activation_fn func, conv_algorithm algorithm)
+    : _input (input), _kernel (kernel), _weights (weights), _bias (bias),
+      activation (func), _algorithm (algorithm)
+{
+  if (input.channels <= ZERO || kernel <= ZERO || kernel > input.height
+      || kernel > input.width
+      || weights.get_cols () != input.channels * kernel * kernel
+      || bias.get_rows () != weights.get_rows () || bias.get_cols () != ONE
+      || (algorithm == CONV_DIRECT && kernel != DIRECT_KERNEL_SIZE))
+  {
+    throw std::invalid_argument (CONV_SHAPE_ERR);
+  }
+}
+
+int Conv2D::input_size () const
+{
+  return _input.channels * _input.height * _input.width;
+}
+
+int Conv2D::output_size () const
+{
+  image_shape out = get_output_shape ();
+  return out.channels * out.height * out.width;
+}
+
+const image_shape &Conv2D::get_input_shape () const
+{
+  return _input;
+}
+
+image_shape Conv2D::get_output_shape () const
+{
+  return image_shape{_weights.get_rows (), _input.height - _kernel + 1,
+                     _input.width - _kernel + 1};
+}
+
+bool Conv2D::is_direct () const
+{
+  return _algorithm == CONV_DIRECT
+         || (_algorithm == CONV_AUTO && _kernel == DIRECT_KERNEL_SIZE);
+}
+
+int Conv2D::scratch_size () const
+{
+  image_shape out = get_output_shape ();
+  return is_direct () ? 0 : _input.channels * _kernel * _kernel * out.height
+                            * out.width;
+}
+
+void Conv2D::im2col_convolve (const float *input, float *out_values,
+                              float *cols) const
+{
+  image_shape out = get_output_shape ();
+  int plane = out.height * out.width;
+  // row (c, ky, kx) of cols holds the input pixel under that kernel tap for
+  // every output position, so the convolution becomes weights * cols
+  for (int c = 0; c < _input.channels; ++c)
+  {
+    const float *channel = input + c * _input.height * _input.width;
+    for (int ky = 0; ky < _kernel; ++ky)
+    {
+      for (int kx = 0; kx < _kernel; ++kx)
+      {
+        float *row = cols + ((c * _kernel + ky) * _kernel + kx) * plane;
+        for (int oy = 0; oy < out.height; ++oy)
+        {
+          const float *src = channel + (oy + ky) * _input.width + kx;
+          std::copy (src, src + out.width, row + oy * out.width);
+        }
+      }
+    }
+  }
+
+  kernels::gemm_packed (_weights.data (), cols, out_values, out.channels,
+                        _weights.get_cols (), plane);
+  for (int o = 0; o < out.channels; ++o)
+  {
+    float *row = out_values + o * plane;
+    float b = _bias.row_data (o)[0];
+    for (int p = 0; p < plane; ++p)
+    {
+      row[p] += b;
+    }
+  }
+}
+
+void Conv2D::direct_convolve (const float *input, float *out_values) const
+{
+  image_shape out = get_output_shape ();
+  int width = _input.width;
+  for (int o = 0; o < out.channels; ++o)
+  {
+    float *plane = out_values + o * out.height * out.width;
+    std::fill (plane, plane + out.height * out.width,
+               _bias.row_data (o)[0]);
+    for (int c = 0; c < _input.channels; ++c)
+    {
+      // the nine taps stay in registers for the whole plane
+      const float *w = _weights.row_data (o) + c * DIRECT_KERNEL_SIZE
+                                                 * DIRECT_KERNEL_SIZE;
+      float w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3], w4 = w[4],
+          w5 = w[5], w6 = w[6], w7 = w[7], w8 = w[8];
+      const float *channel = input + c * _input.height * width;
+      for (int oy = 0; oy < out.height; ++oy)
+      {
+        const float *r0 = channel + oy * width;
+        const float *r1 = r0 + width;
+        const float *r2 = r1 + width;
+        float *dst = plane + oy * out.width;
+        for (int ox = 0; ox < out.width; ++ox)
+        {
+          dst[ox] += w0 * r0[ox] + w1 * r0[ox + 1] + w2 * r0[ox + 2]
+                     + w3 * r1[ox] + w4 * r1[ox + 1] + w5 * r1[ox + 2]
+                     + w6 * r2[ox] + w7 * r2[ox + 1] + w8 * r2[ox + 2];
+        }
+      }
+    }
+  }
+}
+
+void Conv2D::forward (const float *in, float *out, float *scratch) const
+{
+  if (is_direct ())
+  {
+    direct_convolve (in, out);
+  }
+  else
+  {
+    im2col_convolve (in, out, scratch);
+  }
+  apply_activation (activation, out, output_size ());
+}
+
+Matrix Conv2D::operator() (const Matrix &matrix) const
+{
+  if (matrix.get_rows () * matrix.get_cols () != input_size ())
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  std::vector<float> input (input_size ());
+  std::vector<float> scratch (scratch_size ());
+  matrix.copy_to (input.data ());
+  Matrix result (output_size (), ONE);
+  forward (input.data (), result.data (), scratch.data ());
+  return result;
+}
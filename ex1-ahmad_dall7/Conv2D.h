@@ -0,0 +1,76 @@
+#ifndef CONV2D_H
+#define CONV2D_H
+
+#include "Layer.h"
+
+#define CONV_SHAPE_ERR "Invalid convolution shape"
+#define DIRECT_KERNEL_SIZE 3
+
+/**
+ * @struct image_shape
+ * @brief Channel-major layout of the values a Conv2D or MaxPool2D layer
+ *        reads: channels planes of height x width.
+ */
+typedef struct image_shape {
+    int channels;
+    int height;
+    int width;
+} image_shape;
+
+/**
+ * @enum conv_algorithm
+ * @brief How Conv2D computes its output. AUTO uses the direct loops for
+ *        3x3 kernels and im2col + GEMM for everything else.
+ */
+typedef enum conv_algorithm {
+    CONV_AUTO,
+    CONV_IM2COL,
+    CONV_DIRECT
+} conv_algorithm;
+
+/**
+ * 2D convolution, stride 1 and no padding ("valid"), followed by an
+ * activation. Output is out_channels planes of
+ * (height - kernel + 1) x (width - kernel + 1).
+ */
+class Conv2D : public Layer
+{
+ public:
+  /**
+   * @param input layout of the input values
+   * @param kernel kernel edge length
+   * @param weights out_channels x (channels * kernel * kernel), row o holds
+   *        the kernels of output channel o, channel-major then row-major
+   * @param bias out_channels x 1
+   * @param func activation applied to the output
+   * @param algorithm see conv_algorithm
+   * @throw std::invalid_argument if the shapes do not match
+   */
+  Conv2D (const image_shape &input, int kernel, Matrix & weights,
+          Matrix & bias, activation_fn func,
+          conv_algorithm algorithm = CONV_AUTO);
+
+  Matrix operator() (const Matrix & matrix) const override;
+  void forward (const float * in, float * out,
+                float * scratch) const override;
+  int scratch_size () const override;
+  int input_size () const override;
+  int output_size () const override;
+
+  const image_shape & get_input_shape () const;
+  image_shape get_output_shape () const;
+
+ private:
+  image_shape _input;
+  int _kernel;
+  Matrix _weights;
+  Matrix _bias;
+  activation_fn activation;
+  conv_algorithm _algorithm;
+
+  bool is_direct () const;
+  void im2col_convolve (const float *input, float *out, float *cols) const;
+  void direct_convolve (const float *input, float *out) const;
+};
+
+#endif //CONV2D_H
@@ -2,9 +2,34 @@
 // Created by ahdal_9lda2pd on 21/12/2022.
 //
 #include "Dense.h"
+#include "CacheInfo.h"
+#include "MatrixKernels.h"
 
-Dense::Dense(Matrix& weight, Matrix& bias, activation_fn activation)
-    : _weights(weight), _bias(bias), activation(activation) {}
+#include <algorithm>
+
+#define MAX_SAMPLE_BLOCK 64
+#define GEMV_GROUP 4
+
+Dense::Dense(Matrix& weight, Matrix& bias, activation_fn activation,
+             weight_precision precision)
+    : _weights(weight), _bias(bias), activation(activation),
+      precision(precision)
+{
+  if (precision == FP32)
+  {
+    return;
+  }
+  int n = _weights.get_rows () * _weights.get_cols ();
+  float *w = _weights.data ();
+  _half_weights.resize (n);
+  for (int i = 0; i < n; ++i)
+  {
+    _half_weights[i] = precision == FP16 ? kernels::to_fp16 (w[i])
+                                         : kernels::to_bf16 (w[i]);
+    w[i] = precision == FP16 ? kernels::from_fp16 (_half_weights[i])
+                             : kernels::from_bf16 (_half_weights[i]);
+  }
+}
 const Matrix &Dense::get_weights () const
 {
   return this->_weights;
@@ -19,8 +44,92 @@ const activation_fn &Dense::get_activation () const
 }
 Matrix Dense::operator()(const Matrix& matrix) const
 {
-  return activation(_weights * matrix + _bias);
-
+  if (precision == FP32)
+  {
+    return activation(_weights * matrix + _bias);
+  }
+  if (matrix.get_rows () != _weights.get_cols () || matrix.get_cols () != ONE)
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  Matrix result (_weights.get_rows (), ONE);
+  if (precision == FP16)
+  {
+    kernels::gemv_fp16 (_half_weights.data (), matrix.data (), result.data (),
+                        _weights.get_rows (), _weights.get_cols ());
+  }
+  else
+  {
+    kernels::gemv_bf16 (_half_weights.data (), matrix.data (), result.data (),
+                        _weights.get_rows (), _weights.get_cols ());
+  }
+  return activation(result + _bias);
+}
+void Dense::forward (const float *in, float *out, float *) const
+{
+  int rows = _weights.get_rows (), cols = _weights.get_cols ();
+  if (precision == FP32)
+  {
+    kernels::gemv (_weights.data (), in, out, rows, cols);
+  }
+  else if (precision == FP16)
+  {
+    kernels::gemv_fp16 (_half_weights.data (), in, out, rows, cols);
+  }
+  else
+  {
+    kernels::gemv_bf16 (_half_weights.data (), in, out, rows, cols);
+  }
+  kernels::add (out, _bias.data (), out, rows);
+  apply_activation (activation, out, rows);
+}
+void Dense::forward_batch (const float *in, float *out, int count,
+                           float *) const
+{
+  int rows = _weights.get_rows (), cols = _weights.get_cols ();
+  // three quarters of L1 for the block's inputs, the rest for the weight
+  // rows; gemv_many shares each weight load between groups of 4 samples
+  static const long l1d = cache_info::l1d_bytes ();
+  long fit = l1d * 3 / 4 / (long) (cols * sizeof (float));
+  int block = (int) std::max ((long) GEMV_GROUP,
+                              std::min ((long) MAX_SAMPLE_BLOCK, fit)
+                              / GEMV_GROUP * GEMV_GROUP);
+  for (int b = 0; b < count; b += block)
+  {
+    int n = std::min (block, count - b);
+    const float *x = in + (long) b * cols;
+    float *y = out + (long) b * rows;
+    if (precision == FP32)
+    {
+      kernels::gemv_many (_weights.data (), x, y, rows, cols, n);
+    }
+    else if (precision == FP16)
+    {
+      kernels::gemv_many_fp16 (_half_weights.data (), x, y, rows, cols, n);
+    }
+    else
+    {
+      kernels::gemv_many_bf16 (_half_weights.data (), x, y, rows, cols, n);
+    }
+  }
+  for (int b = 0; b < count; ++b)
+  {
+    float *y = out + (long) b * rows;
+    kernels::add (y, _bias.data (), y, rows);
+    apply_activation (activation, y, rows);
+  }
+}
+int Dense::input_size () const
+{
+  return _weights.get_cols ();
+}
+int Dense::output_size () const
+{
+  return _weights.get_rows ();
+}
+weight_precision Dense::get_precision () const
+{
+  return precision;
 }
 
 
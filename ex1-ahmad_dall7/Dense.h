@@ -1,23 +1,59 @@
 #ifndef DENSE_H
 #define DENSE_H
 
-#include "Activation.h"
+#include "Layer.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @enum weight_precision
+ * @brief How a Dense layer stores its weights. Half precision weights are
+ *        converted once, when the layer is built, and widened back to float
+ *        inside the matrix-vector loop, so activations and sums stay fp32.
+ */
+typedef enum weight_precision {
+    FP32,
+    FP16,
+    BF16
+} weight_precision;
 
 // Insert Dense class here...
 
-class Dense
+class Dense : public Layer
 {
  public:
-  Dense (Matrix & weights, Matrix & bias, activation_fn func_type);
+  Dense (Matrix & weights, Matrix & bias, activation_fn func_type,
+         weight_precision precision = FP32);
+
+  /**
+   * The weights the layer computes with: for FP16 / BF16 layers these are
+   * the rounded values, widened back to float.
+   */
   const Matrix & get_weights() const;
   const Matrix & get_bias() const;
   const activation_fn & get_activation() const;
-  Matrix operator()(const Matrix & matrix) const;
+  Matrix operator()(const Matrix & matrix) const override;
+  void forward (const float * in, float * out,
+                float * scratch) const override;
+
+  /**
+   * Works on blocks of samples that fit in L1: each weight row is read
+   * once per block instead of once per sample.
+   */
+  void forward_batch (const float * in, float * out, int count,
+                      float * scratch) const override;
+  int input_size () const override;
+  int output_size () const override;
+  weight_precision get_precision () const;
 
  private:
   Matrix _weights;
   Matrix _bias;
   activation_fn activation;
+  weight_precision precision;
+  // the weights the forward pass streams when precision is FP16 or BF16
+  std::vector<uint16_t> _half_weights;
 };
 
 
@@ -0,0 +1,311 @@
+//
+// Content hash cache of inference results.
+//
+
+#include "InferenceCache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+#define XXH_STRIPE 32
+#define SHARD_SHIFT 60
+
+static inline uint64_t rotl64 (uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64 (const unsigned char *p)
+{
+  uint64_t v;
+  std::memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline uint32_t read32 (const unsigned char *p)
+{
+  uint32_t v;
+  std::memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline uint64_t xxh_round (uint64_t acc, uint64_t input)
+{
+  acc += input * XXH_PRIME2;
+  return rotl64 (acc, 31) * XXH_PRIME1;
+}
+
+static inline uint64_t xxh_merge (uint64_t acc, uint64_t v)
+{
+  acc ^= xxh_round (0, v);
+  return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// reads are little endian, like every target this builds for
+uint64_t xxh64 (const void *data, size_t len, uint64_t seed)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  const unsigned char *end = p + len;
+  uint64_t h;
+  if (len >= XXH_STRIPE)
+  {
+    uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+    uint64_t v2 = seed + XXH_PRIME2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - XXH_PRIME1;
+    const unsigned char *limit = end - XXH_STRIPE;
+    do
+    {
+      v1 = xxh_round (v1, read64 (p));
+      v2 = xxh_round (v2, read64 (p + 8));
+      v3 = xxh_round (v3, read64 (p + 16));
+      v4 = xxh_round (v4, read64 (p + 24));
+      p += XXH_STRIPE;
+    }
+    while (p <= limit);
+    h = rotl64 (v1, 1) + rotl64 (v2, 7) + rotl64 (v3, 12) + rotl64 (v4, 18);
+    h = xxh_merge (h, v1);
+    h = xxh_merge (h, v2);
+    h = xxh_merge (h, v3);
+    h = xxh_merge (h, v4);
+  }
+  else
+  {
+    h = seed + XXH_PRIME5;
+  }
+  h += (uint64_t) len;
+
+  for (; p + 8 <= end; p += 8)
+  {
+    h ^= xxh_round (0, read64 (p));
+    h = rotl64 (h, 27) * XXH_PRIME1 + XXH_PRIME4;
+  }
+  if (p + 4 <= end)
+  {
+    h ^= (uint64_t) read32 (p) * XXH_PRIME1;
+    h = rotl64 (h, 23) * XXH_PRIME2 + XXH_PRIME3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+  {
+    h ^= (uint64_t) *p * XXH_PRIME5;
+    h = rotl64 (h, 11) * XXH_PRIME1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_PRIME2;
+  h ^= h >> 29;
+  h *= XXH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+void InferenceCache::shard_array_deleter::operator() (shard *shards) const
+{
+  for (int i = 0; i < count; ++i)
+  {
+    shards[i].~shard ();
+  }
+  std::free (shards);
+}
+
+std::unique_ptr<InferenceCache::shard[], InferenceCache::shard_array_deleter>
+InferenceCache::allocate_shards (int count)
+{
+  // C++14 new[] ignores the extended alignment of shard, so the array is
+  // allocated aligned and the shards are constructed in place
+  void *memory = nullptr;
+  if (posix_memalign (&memory, alignof (shard), sizeof (shard) * count) != 0)
+  {
+    throw std::bad_alloc ();
+  }
+  shard *shards = static_cast<shard *> (memory);
+  int built = 0;
+  try
+  {
+    for (; built < count; ++built)
+    {
+      new (shards + built) shard ();
+    }
+  }
+  catch (...)
+  {
+    shard_array_deleter{built} (shards);
+    throw;
+  }
+  return std::unique_ptr<shard[], shard_array_deleter>
+      (shards, shard_array_deleter{count});
+}
+
+InferenceCache::InferenceCache (size_t capacity)
+    : _capacity (capacity),
+      _shards_count (capacity < MIN_SHARDED_CAPACITY ? 1 : CACHE_SHARDS),
+      _shards (nullptr, shard_array_deleter{0})
+{
+  if (capacity == 0)
+  {
+    throw std::invalid_argument (CACHE_CAPACITY_ERR);
+  }
+  _shards = allocate_shards (_shards_count);
+  for (int i = 0; i < _shards_count; ++i)
+  {
+    // the first shards take the remainder so the total is exact
+    _shards[i].capacity = capacity / _shards_count
+                          + (i < (int) (capacity % _shards_count));
+  }
+}
+
+digit InferenceCache::operator() (const ModelHandle &model, const Matrix &img,
+                                  InferenceContext &context)
+{
+  ModelHandle::Pin pin = model.pin ();
+  unsigned long generation = pin.generation ();
+  return lookup (*pin, &generation, img, context);
+}
+
+digit InferenceCache::operator() (const MlpNetwork &network, const Matrix &img,
+                                  InferenceContext &context)
+{
+  return lookup (network, nullptr, img, context);
+}
+
+bool InferenceCache::matches (const entry &e, const Matrix &img)
+{
+  return e.rows == img.get_rows () && e.cols == img.get_cols ()
+         && std::memcmp (e.pixels.data (), img.data (),
+                         e.pixels.size () * sizeof (float)) == 0;
+}
+
+/**
+ * generation is null for lookups that do not follow a ModelHandle.
+ */
+digit InferenceCache::lookup (const MlpNetwork &network,
+                              const unsigned long *generation,
+                              const Matrix &img, InferenceContext &context)
+{
+  size_t pixels = (size_t) img.get_rows () * img.get_cols ();
+  uint64_t seed = ((uint64_t) img.get_rows () << 32) | (uint32_t) img.get_cols ();
+  uint64_t key = xxh64 (img.data (), pixels * sizeof (float), seed);
+  shard &s = _shards[_shards_count == 1 ? 0 : key >> SHARD_SHIFT];
+
+  bool stale = false;
+  {
+    std::lock_guard<std::mutex> lock (s.lock);
+    if (generation != nullptr && *generation > s.generation)
+    {
+      s.invalidations += (long) s.lru.size ();
+      s.lru.clear ();
+      s.index.clear ();
+      s.generation = *generation;
+    }
+    stale = generation != nullptr && *generation < s.generation;
+    auto it = stale ? s.index.end () : s.index.find (key);
+    if (it != s.index.end () && matches (*it->second, img))
+    {
+      s.lru.splice (s.lru.begin (), s.lru, it->second);
+      ++s.hits;
+      return it->second->result;
+    }
+    ++s.misses;
+  }
+
+  digit result = network (img, context);
+  if (!stale)
+  {
+    std::lock_guard<std::mutex> lock (s.lock);
+    // skipped if a newer network was published meanwhile
+    if (generation == nullptr || *generation == s.generation)
+    {
+      insert (s, key, img, result);
+    }
+  }
+  return result;
+}
+
+/**
+ * Stores result for img at the front of s, reusing the least recently used
+ * entry's storage once the shard is full. Called with s.lock held.
+ */
+void InferenceCache::insert (shard &s, uint64_t key, const Matrix &img,
+                             digit result)
+{
+  auto it = s.index.find (key);
+  std::list<entry>::iterator e;
+  if (it != s.index.end ())
+  {
+    // a colliding or concurrently cached image takes the slot over
+    e = it->second;
+  }
+  else if (s.lru.size () < s.capacity)
+  {
+    e = s.lru.emplace (s.lru.begin ());
+    s.index[key] = e;
+  }
+  else
+  {
+    e = std::prev (s.lru.end ());
+    s.index.erase (e->key);
+    ++s.evictions;
+    s.index[key] = e;
+  }
+  s.lru.splice (s.lru.begin (), s.lru, e);
+  const float *pixels = img.data ();
+  e->key = key;
+  e->rows = img.get_rows ();
+  e->cols = img.get_cols ();
+  e->pixels.assign (pixels, pixels + (size_t) e->rows * e->cols);
+  e->result = result;
+}
+
+void InferenceCache::clear ()
+{
+  for (int i = 0; i < _shards_count; ++i)
+  {
+    std::lock_guard<std::mutex> lock (_shards[i].lock);
+    _shards[i].invalidations += (long) _shards[i].lru.size ();
+    _shards[i].lru.clear ();
+    _shards[i].index.clear ();
+  }
+}
+
+size_t InferenceCache::capacity () const
+{
+  return _capacity;
+}
+
+cache_stats InferenceCache::get_stats () const
+{
+  cache_stats stats{};
+  for (int i = 0; i < _shards_count; ++i)
+  {
+    shard &s = _shards[i];
+    std::lock_guard<std::mutex> lock (s.lock);
+    stats.hits += s.hits;
+    stats.misses += s.misses;
+    stats.evictions += s.evictions;
+    stats.invalidations += s.invalidations;
+    stats.entries += (long) s.lru.size ();
+  }
+  long lookups = stats.hits + stats.misses;
+  stats.hit_rate = lookups > 0 ? (double) stats.hits / lookups : 0.;
+  return stats;
+}
+
+void InferenceCache::reset_stats ()
+{
+  for (int i = 0; i < _shards_count; ++i)
+  {
+    shard &s = _shards[i];
+    std::lock_guard<std::mutex> lock (s.lock);
+    s.hits = 0;
+    s.misses = 0;
+    s.evictions = 0;
+    s.invalidations = 0;
+  }
+}
@@ -0,0 +1,133 @@
+#ifndef INFERENCECACHE_H
+#define INFERENCECACHE_H
+
+#include "ModelHandle.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define CACHE_CAPACITY_ERR "Error: a cache needs room for at least one entry"
+#define CACHE_SHARDS 16
+// caches smaller than this keep a single shard, so their LRU order is exact
+#define MIN_SHARDED_CAPACITY 1024
+
+/**
+ * XXH64 of len bytes, the same value as the reference xxHash.
+ */
+uint64_t xxh64 (const void *data, size_t len, uint64_t seed = 0);
+
+/**
+ * @struct cache_stats
+ * @brief What an InferenceCache did since the last reset.
+ * @var hits - lookups answered from the cache
+ * @var misses - lookups that ran the network
+ * @var evictions - least recently used entries dropped to make room
+ * @var invalidations - entries dropped because a new model was published
+ * @var entries - entries currently held
+ * @var hit_rate - hits / (hits + misses)
+ */
+typedef struct cache_stats {
+    long hits;
+    long misses;
+    long evictions;
+    long invalidations;
+    long entries;
+    double hit_rate;
+} cache_stats;
+
+/**
+ * Bounded cache of inference results keyed by the contents of the image.
+ *
+ * An image is looked up by the XXH64 of its pixels; an entry keeps a copy
+ * of the pixels and only answers when they are equal, so a hash collision
+ * costs a miss, never a wrong digit. Every entry therefore takes about the
+ * size of one image. Entries are spread over CACHE_SHARDS shards by hash,
+ * each with its own lock and least recently used eviction, and the network
+ * runs outside the locks.
+ *
+ * Through a ModelHandle the cache follows the published generation: the
+ * first lookup that pins a newer network empties the shard it lands in, and
+ * lookups still pinning an older network bypass the cache. With a plain
+ * MlpNetwork the caller calls clear() after changing the network. One cache
+ * should serve one model.
+ */
+class InferenceCache
+{
+ public:
+  /**
+   * @param capacity - maximum number of cached results
+   * @throw std::invalid_argument if capacity is 0
+   */
+  explicit InferenceCache (size_t capacity) noexcept(false);
+
+  InferenceCache (const InferenceCache &) = delete;
+  InferenceCache &operator= (const InferenceCache &) = delete;
+
+  /**
+   * The network's answer for img, cached for the current generation of
+   * model.
+   */
+  digit operator() (const ModelHandle &model, const Matrix &img,
+                    InferenceContext &context);
+
+  /**
+   * The network's answer for img, cached until clear().
+   */
+  digit operator() (const MlpNetwork &network, const Matrix &img,
+                    InferenceContext &context);
+
+  void clear ();
+
+  size_t capacity () const;
+
+  cache_stats get_stats () const;
+
+  void reset_stats ();
+
+ private:
+  typedef struct entry {
+      uint64_t key;
+      int rows;
+      int cols;
+      std::vector<float> pixels;
+      digit result;
+  } entry;
+
+  typedef struct alignas(CACHE_LINE) shard {
+      std::mutex lock;
+      std::list<entry> lru;
+      std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+      size_t capacity = 0;
+      unsigned long generation = 0;
+      long hits = 0;
+      long misses = 0;
+      long evictions = 0;
+      long invalidations = 0;
+  } shard;
+
+  digit lookup (const MlpNetwork &network, const unsigned long *generation,
+                const Matrix &img, InferenceContext &context);
+  static bool matches (const entry &e, const Matrix &img);
+  void insert (shard &s, uint64_t key, const Matrix &img, digit result);
+
+  /**
+   * Destroys and frees a shard array from allocate_shards.
+   */
+  typedef struct shard_array_deleter {
+      int count;
+      void operator() (shard *shards) const;
+  } shard_array_deleter;
+
+  static std::unique_ptr<shard[], shard_array_deleter>
+  allocate_shards (int count);
+
+  size_t _capacity;
+  int _shards_count;
+  std::unique_ptr<shard[], shard_array_deleter> _shards;
+};
+
+#endif //INFERENCECACHE_H
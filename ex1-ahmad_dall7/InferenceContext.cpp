@@ -0,0 +1,68 @@
+//
+// Per-thread inference buffers.
+//
+
+#include "InferenceContext.h"
+#include "MlpNetwork.h"
+
+#include <algorithm>
+
+#define LINE_FLOATS (CACHE_LINE / sizeof (float))
+
+static size_t round_to_line (size_t floats)
+{
+  return (floats + LINE_FLOATS - 1) / LINE_FLOATS * LINE_FLOATS;
+}
+
+InferenceContext::InferenceContext ()
+    : _activations{nullptr, nullptr}, _scratch (nullptr),
+      _activation_size (0), _scratch_size (0)
+{}
+
+InferenceContext::InferenceContext (const MlpNetwork &network)
+    : InferenceContext ()
+{
+  reserve (network);
+}
+
+void InferenceContext::reserve (const MlpNetwork &network, int samples)
+{
+  // in size_t: a whole batch of inputs does not fit in an int
+  size_t activation_size = 0, scratch_size = 0;
+  for (int i = 0; i < network.get_layers_count (); ++i)
+  {
+    const Layer &layer = network.get_layer (i);
+    activation_size = std::max (activation_size, (size_t) std::max (
+        layer.input_size (), layer.output_size ()));
+    scratch_size = std::max (scratch_size, (size_t) layer.scratch_size ());
+  }
+  activation_size = round_to_line (activation_size
+                                   * (size_t) std::max (samples, 1));
+  scratch_size = round_to_line (scratch_size);
+  if (_storage.data () != nullptr && activation_size <= _activation_size
+      && scratch_size <= _scratch_size)
+  {
+    return;
+  }
+
+  _activation_size = std::max (_activation_size, activation_size);
+  _scratch_size = std::max (_scratch_size, scratch_size);
+  // buffers start cache aligned, one line of padding after the end
+  _storage = allocation::buffer (2 * _activation_size + _scratch_size
+                                 + LINE_FLOATS);
+  float *base = _storage.data ();
+  std::fill (base, base + _storage.size (), 0.f);
+  _activations[0] = base;
+  _activations[1] = base + _activation_size;
+  _scratch = base + 2 * _activation_size;
+}
+
+float *InferenceContext::activations (int i)
+{
+  return _activations[i];
+}
+
+float *InferenceContext::scratch ()
+{
+  return _scratch;
+}
@@ -0,0 +1,56 @@
+#ifndef INFERENCECONTEXT_H
+#define INFERENCECONTEXT_H
+
+#include "Allocation.h"
+
+class MlpNetwork;
+
+/**
+ * Scratch memory of one inference thread: two activation buffers the
+ * layers ping-pong between and the scratch Layer::forward needs, sized
+ * from a network's layer shapes.
+ *
+ * Give every thread its own context and share the network: inference
+ * through a context only reads the network and allocates nothing once the
+ * context is big enough. Create (or first reserve) a context on the thread
+ * that uses it, so its pages are touched there first.
+ */
+class InferenceContext
+{
+ public:
+  InferenceContext ();
+
+  /**
+   * A context already big enough for network.
+   */
+  explicit InferenceContext (const MlpNetwork &network);
+
+  InferenceContext (const InferenceContext &) = delete;
+  InferenceContext &operator= (const InferenceContext &) = delete;
+  InferenceContext (InferenceContext &&) = default;
+  InferenceContext &operator= (InferenceContext &&) = default;
+
+  /**
+   * Grows the buffers to fit samples inputs of network at once. Allocates
+   * only when they are too small, so a context can serve any network of
+   * the same or smaller shape, e.g. the networks a ModelHandle swaps in.
+   */
+  void reserve (const MlpNetwork &network, int samples = 1);
+
+  /**
+   * @param i 0 or 1
+   * @return activation buffer i, room for the reserved number of samples
+   */
+  float *activations (int i);
+
+  float *scratch ();
+
+ private:
+  allocation::buffer _storage;
+  float *_activations[2];
+  float *_scratch;
+  size_t _activation_size;
+  size_t _scratch_size;
+};
+
+#endif //INFERENCECONTEXT_H
@@ -0,0 +1,82 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include "Activation.h"
+
+#include <algorithm>
+
+/**
+ * A network layer. Layers take and return column vectors, so any layer can
+ * follow any other as long as the sizes chain: layers that work on images
+ * (Conv2D, MaxPool2D) read their input as channel-major C x H x W values and
+ * write their output the same way.
+ */
+class Layer
+{
+ public:
+  virtual ~Layer () = default;
+
+  virtual Matrix operator() (const Matrix & matrix) const = 0;
+
+  /**
+   * The layer on raw buffers, without allocating: reads input_size()
+   * values from in and writes output_size() values to out, using scratch
+   * (scratch_size() floats) for intermediates. Gives the same results as
+   * operator(). in, out and scratch must not overlap.
+   */
+  virtual void forward (const float * in, float * out,
+                        float * scratch) const = 0;
+
+  /**
+   * forward() on count samples stored one after the other: sample b reads
+   * in + b * input_size() and writes out + b * output_size(). Gives the
+   * same results as count forward() calls, which is what it defaults to.
+   */
+  virtual void forward_batch (const float * in, float * out, int count,
+                              float * scratch) const
+  {
+    for (int b = 0; b < count; ++b)
+    {
+      forward (in + (long) b * input_size (), out + (long) b * output_size (),
+               scratch);
+    }
+  }
+
+  /**
+   * @return number of floats of scratch forward() and forward_batch() need
+   */
+  virtual int scratch_size () const
+  {
+    return 0;
+  }
+
+  /**
+   * @return number of values the layer reads
+   */
+  virtual int input_size () const = 0;
+
+  /**
+   * @return number of values the layer writes
+   */
+  virtual int output_size () const = 0;
+
+ protected:
+  /**
+   * Applies func to n values in place. Activations without an in place
+   * form go through a temporary Matrix, which allocates.
+   */
+  static void apply_activation (activation_fn func, float * values, int n)
+  {
+    activation_in_place_fn in_place = activation::in_place (func);
+    if (in_place != nullptr)
+    {
+      in_place (values, n);
+      return;
+    }
+    Matrix m (n, 1);
+    std::copy (values, values + n, m.data ());
+    func (m).copy_to (values);
+  }
+};
+
+#endif //LAYER_H
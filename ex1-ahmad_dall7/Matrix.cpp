@@ -3,54 +3,49 @@
 //
 
 #include "Matrix.h"
+#include "MatrixKernels.h"
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 
 
 
-void Matrix::free_matrix (float ***matrix, const int & rows)
+void Matrix::free_matrix (float ***matrix)
 {
-  for (int i=0 ; i<rows ; ++i)
-  {
-    delete (*matrix)[i];
-  }
   delete[] (*matrix);
   *matrix = NULL;
 }
 
-void Matrix::init_matrix (float ***mat, const dims &_dims, float val)
+void Matrix::init_matrix (float ***mat, allocation::buffer &storage,
+                          const dims &_dims, float val)
 {
   if (_dims.rows <= ZERO || _dims.cols <= ZERO)
   {
     throw std::runtime_error (OUT_OF_RANGE_ERR);
   }
+  // one aligned block for all elements, the row pointers index into it.
+  // Filling it here makes the constructing thread the first to touch it.
+  storage = allocation::buffer ((size_t) _dims.rows * _dims.cols);
+  float *data = storage.data ();
+  std::fill (data, data + _dims.rows * _dims.cols, val);
   (*mat) = new float *[_dims.rows];
   for (int i=0 ; i < _dims.rows ; ++i)
   {
-    (*mat)[i] = new float [_dims.cols];
-    for (int j=0 ; j < _dims.cols ; ++j)
-    {
-      (*mat)[i][j] = val;
-    }
+    (*mat)[i] = data + i * _dims.cols;
   }
 }
 
 void Matrix::copy_matrix (float **src_mat, float **dst_mat,
                           const dims &_dims)
 {
-  for (int i = 0; i < _dims.rows; ++i)
-  {
-    for (int j = 0; j < _dims.cols; ++j)
-    {
-      dst_mat[i][j] = src_mat[i][j];
-    }
-  }
+  std::copy (src_mat[0], src_mat[0] + _dims.rows * _dims.cols, dst_mat[0]);
 }
 
-Matrix::Matrix (int rows, int cols): _dims(dims{rows, cols})
+Matrix::Matrix (int rows, int cols): _matrix(NULL), _dims(dims{rows, cols})
 {
-  init_matrix (&_matrix, _dims, ZERO);
+  init_matrix (&_matrix, _storage, _dims, ZERO);
 }
 
 Matrix::Matrix() : Matrix(1, 1){}
@@ -63,7 +58,7 @@ Matrix::Matrix (const Matrix &matrix)
 
 Matrix::~Matrix ()
 {
-  free_matrix (&_matrix, get_rows());
+  free_matrix (&_matrix);
 }
 
 int Matrix::get_rows () const
@@ -79,8 +74,9 @@ int Matrix::get_cols () const
 Matrix &Matrix::transpose ()
 {
   float **result = nullptr;
+  allocation::buffer storage;
   dims new_dims = dims{get_cols(), get_rows()};
-  init_matrix (&result, new_dims, ZERO);
+  init_matrix (&result, storage, new_dims, ZERO);
   for (int i=0 ; i<_dims.rows ; ++i)
   {
     for (int j=0 ; j<_dims.cols ; ++j)
@@ -88,8 +84,9 @@ Matrix &Matrix::transpose ()
       result[j][i] = _matrix[i][j];
     }
   }
-  free_matrix (&_matrix, get_rows());
+  free_matrix (&_matrix);
   _matrix = result;
+  _storage = std::move (storage);
 
   int temp = _dims.cols;
   _dims.cols = _dims.rows;
@@ -100,17 +97,14 @@ Matrix &Matrix::transpose ()
 Matrix &Matrix::vectorize ()
 {
   float ** vec;
+  allocation::buffer storage;
   dims new_dims{get_rows() * get_cols(), ONE};
-  init_matrix (&vec, new_dims, ONE);
-  for (int i=0 ; i<get_rows() ; ++i)
-  {
-    for (int j=0 ; j<get_cols() ; ++j)
-    {
-      vec[i * get_cols() + j][0] = _matrix[i][j];
-    }
-  }
-  free_matrix (&_matrix, get_rows());
+  init_matrix (&vec, storage, new_dims, ONE);
+  // storage is already row-major, only the row pointers change
+  copy_matrix (_matrix, vec, new_dims);
+  free_matrix (&_matrix);
   _matrix = vec;
+  _storage = std::move (storage);
   this->_dims.rows = this->get_rows() * this->get_cols();
   this->_dims.cols = ONE;
 
@@ -135,13 +129,7 @@ Matrix Matrix::dot (Matrix & matrix) const
   Matrix result(rows, cols);
   if (rows == matrix.get_rows() && cols == matrix.get_cols())
   {
-    for (int i=0 ; i<rows ; ++i)
-    {
-      for (int j=0 ; j<cols ; ++j)
-      {
-        result._matrix[i][j] = _matrix[i][j] * matrix._matrix[i][j];
-      }
-    }
+    kernels::multiply (data (), matrix.data (), result.data (), rows * cols);
   }
   else
   {
@@ -152,28 +140,13 @@ Matrix Matrix::dot (Matrix & matrix) const
 
 float Matrix::sum () const
 {
-  float result = 0;
-  for(int i=0 ; i< this->get_rows() ; ++i)
-  {
-    for (int j=0 ; j< this->get_cols() ; ++j)
-    {
-      result += this->_matrix[i][j];
-    }
-  }
-  return result;
+  return kernels::sum (data (), get_rows () * get_cols ());
 }
 
 float Matrix::norm () const
 {
-  float result = 0;
-  for (int i=0 ; i< this->get_rows() ; ++i)
-  {
-    for (int j=0 ; j< this->get_cols() ; ++j)
-    {
-      result += (float )pow(_matrix[i][j], 2);
-    }
-  }
-  return sqrt(result);
+  int n = get_rows () * get_cols ();
+  return sqrt(kernels::dot (data (), data (), n));
 }
 
 int Matrix::argmax () const
@@ -188,9 +161,13 @@ Matrix &Matrix::operator+= (const Matrix &matrix)
 
 Matrix &Matrix::operator = (const Matrix &matrix)
 {
-  free_matrix (&_matrix, get_rows ());
+  if (this == &matrix)
+  {
+    return *this;
+  }
+  free_matrix (&_matrix);
   _dims = {matrix.get_rows (), matrix.get_cols ()};
-  init_matrix (&_matrix, _dims, ZERO);
+  init_matrix (&_matrix, _storage, _dims, ZERO);
   copy_matrix (matrix._matrix, _matrix, _dims);
   return *this;
 }
@@ -202,13 +179,8 @@ Matrix Matrix::operator+ (const Matrix &matrix) const
   if (this->get_rows() == matrix.get_rows() &&
   this->get_cols() == matrix.get_cols())
   {
-    for (int i=0 ; i<this->get_rows() ; ++i)
-    {
-      for(int j=0 ; j< this->get_cols() ; ++j)
-      {
-        result._matrix[i][j] += _matrix[i][j];
-      }
-    }
+    kernels::add (result.data (), data (), result.data (),
+                  get_rows () * get_cols ());
   }
   else
   {
@@ -224,28 +196,15 @@ Matrix Matrix::operator* (const Matrix &matrix) const
     {
       throw std::length_error (LENGTH_ERR);
     }
-  for (int i = 0; i < get_rows (); ++i)
-    {
-      for (int j = 0; j < matrix.get_cols (); ++j)
-        {
-          for (int k = 0; k < get_cols (); ++k)
-            {
-              result._matrix[i][j] += _matrix[i][k] * matrix._matrix[k][j];
-            }
-        }
-    }
+  kernels::gemm (_matrix, matrix._matrix, result._matrix,
+                 get_rows (), get_cols (), matrix.get_cols ());
   return result;
 }
 Matrix Matrix::operator* (float c) const
 {
   Matrix result(*this);
-  for (int i = 0; i<get_rows(); ++i)
-  {
-    for (int j = 0; j<get_cols (); ++j)
-    {
-      result._matrix[i][j] *= c;
-    }
-  }
+  kernels::scale (result.data (), c, result.data (),
+                  get_rows () * get_cols ());
   return result;
 }
 
@@ -283,6 +242,26 @@ float & Matrix::operator[] (int _i)
          (*this)(_i / get_cols(), _i % get_cols());
 }
 
+float * Matrix::row_data (int row)
+{
+  return _matrix[row];
+}
+const float * Matrix::row_data (int row) const
+{
+  return _matrix[row];
+}
+float * Matrix::data ()
+{
+  return _matrix[0];
+}
+const float * Matrix::data () const
+{
+  return _matrix[0];
+}
+void Matrix::copy_to (float *out) const
+{
+  std::copy (data (), data () + get_rows () * get_cols (), out);
+}
 
 std::ostream &operator<< (std::ostream &out, const Matrix &matrix)
 {
@@ -2,6 +2,8 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include "Allocation.h"
+
 #include <iostream>
 #include <cmath>
 
@@ -56,6 +58,25 @@ class Matrix {
      float & operator () (int row, int col);
      float & operator [] (int _i);
 
+     /**
+      * Unchecked pointer to the first element of a row. Meant for kernel
+      * code that has already validated the dimensions.
+      */
+     float * row_data (int row);
+     const float * row_data (int row) const;
+
+     /**
+      * Unchecked pointer to all rows * cols elements, stored contiguously
+      * in row-major order.
+      */
+     float * data ();
+     const float * data () const;
+
+     /**
+      * Copies all elements, row by row, to out (rows * cols floats).
+      */
+     void copy_to (float * out) const;
+
 
      friend std::ostream &operator << (std::ostream &out,
          const Matrix &matrix);
@@ -72,10 +93,13 @@ class Matrix {
 
  private:
 
+  // row pointers into _storage
   float ** _matrix;
+  allocation::buffer _storage;
   dims _dims;
-  static void init_matrix (float ***mat, const dims &_dims, float val);
-  static void free_matrix(float *** matrix, const int & rows);
+  static void init_matrix (float ***mat, allocation::buffer &storage,
+                           const dims &_dims, float val);
+  static void free_matrix(float *** matrix);
   static void copy_matrix (float **src_mat, float **dst_mat,
                            const dims &_dims);
 
@@ -0,0 +1,637 @@
+//
+// Raw float kernels used by Matrix, Activation and Dense.
+//
+
+#include "MatrixKernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_DISPATCH 1
+#endif
+
+// number of independent accumulators used by the reductions, wide enough
+// for the compiler to keep one full vector register of partial sums
+#define LANES 8
+// depth of the k panel in gemm, chosen so a panel of b rows stays in L1/L2
+#define K_BLOCK 128
+
+#define FP16_INF 0x7c00u
+#define FP16_QUIET_NAN 0x0200u
+#define FP16_SIGN 0x8000u
+// float bit patterns: smallest normal half 2^-14, and the midpoint between
+// the largest half 65504 and 65536 where rounding overflows to infinity
+#define FP16_MIN_NORMAL_BITS 0x38800000u
+#define FP16_OVERFLOW_BITS 0x477ff000u
+// exponent bias difference, 127 - 15
+#define FP16_BIAS_SHIFT 112
+
+static std::atomic<bool> deterministic_mode (false);
+static std::atomic<bool> isa_dispatch (true);
+
+static inline bool deterministic ()
+{
+  return deterministic_mode.load (std::memory_order_relaxed);
+}
+
+static inline float load_one (float f)
+{
+  return f;
+}
+
+/**
+ * The reduction of dot_avx2 in scalar code: 16 fused multiply-add lanes, a
+ * last block of 8 into the first 8 lanes, the same pairwise tree over the
+ * lanes and a fused tail, so the result is bit-identical to dot_avx2.
+ */
+template<typename T, float (*widen) (T)>
+static float dot_canonical (const T *a, const float *x, int k)
+{
+  float acc[2 * LANES] = {0};
+  int p = 0;
+  for (; p + 2 * LANES <= k; p += 2 * LANES)
+  {
+    for (int l = 0; l < 2 * LANES; ++l)
+    {
+      acc[l] = std::fma (widen (a[p + l]), x[p + l], acc[l]);
+    }
+  }
+  if (p + LANES <= k)
+  {
+    for (int l = 0; l < LANES; ++l)
+    {
+      acc[l] = std::fma (widen (a[p + l]), x[p + l], acc[l]);
+    }
+    p += LANES;
+  }
+  float lanes[LANES];
+  for (int l = 0; l < LANES; ++l)
+  {
+    lanes[l] = acc[l] + acc[l + LANES];
+  }
+  float result = ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6]))
+                 + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+  for (; p < k; ++p)
+  {
+    result = std::fma (widen (a[p]), x[p], result);
+  }
+  return result;
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+static bool has_avx2_f16c ()
+{
+  static const bool supported = __builtin_cpu_supports ("avx2")
+                                && __builtin_cpu_supports ("fma")
+                                && __builtin_cpu_supports ("f16c");
+  return supported && isa_dispatch.load (std::memory_order_relaxed);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 load_fp32 (const float *p)
+{
+  return _mm256_loadu_ps (p);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 widen_fp16 (const uint16_t *p)
+{
+  return _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *) p));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline __m256 widen_bf16 (const uint16_t *p)
+{
+  __m256i wide = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *) p));
+  return _mm256_castsi256_ps (_mm256_slli_epi32 (wide, 16));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+static inline float horizontal_sum (__m256 acc0, __m256 acc1)
+{
+  __m256 acc = _mm256_add_ps (acc0, acc1);
+  __m128 quad = _mm_add_ps (_mm256_castps256_ps128 (acc),
+                            _mm256_extractf128_ps (acc, 1));
+  quad = _mm_add_ps (quad, _mm_movehl_ps (quad, quad));
+  quad = _mm_add_ss (quad, _mm_movehdup_ps (quad));
+  return _mm_cvtss_f32 (quad);
+}
+
+/**
+ * Inner product of k weights of type T, widened to float by load, with k
+ * floats. Two 8 lane accumulators hide the FMA latency.
+ */
+template<typename T, __m256 (*load) (const T *), float (*load_one) (T)>
+__attribute__((target("avx2,fma,f16c")))
+static float dot_avx2 (const T *a, const float *x, int k)
+{
+  __m256 acc0 = _mm256_setzero_ps ();
+  __m256 acc1 = _mm256_setzero_ps ();
+  int p = 0;
+  for (; p + 16 <= k; p += 16)
+  {
+    acc0 = _mm256_fmadd_ps (load (a + p), _mm256_loadu_ps (x + p), acc0);
+    acc1 = _mm256_fmadd_ps (load (a + p + 8), _mm256_loadu_ps (x + p + 8),
+                            acc1);
+  }
+  if (p + 8 <= k)
+  {
+    acc0 = _mm256_fmadd_ps (load (a + p), _mm256_loadu_ps (x + p), acc0);
+    p += 8;
+  }
+  float result = horizontal_sum (acc0, acc1);
+  for (; p < k; ++p)
+  {
+    result = std::fma (load_one (a[p]), x[p], result);
+  }
+  return result;
+}
+
+/**
+ * dot_avx2 of one weight row with four vectors x + v * k, every weight
+ * load feeding four FMAs. Each vector keeps its own two accumulators, so
+ * the results are the same as four dot_avx2 calls. out[v * stride] gets
+ * the result of vector v.
+ */
+template<typename T, __m256 (*load) (const T *), float (*load_one) (T)>
+__attribute__((target("avx2,fma,f16c")))
+static void dot4_avx2 (const T *a, const float *x, int k, float *out,
+                       int stride)
+{
+  const float *x0 = x, *x1 = x + k, *x2 = x + 2 * k, *x3 = x + 3 * k;
+  __m256 acc[4][2];
+  for (int v = 0; v < 4; ++v)
+  {
+    acc[v][0] = _mm256_setzero_ps ();
+    acc[v][1] = _mm256_setzero_ps ();
+  }
+  int p = 0;
+  for (; p + 16 <= k; p += 16)
+  {
+    __m256 w0 = load (a + p), w1 = load (a + p + 8);
+    acc[0][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x0 + p), acc[0][0]);
+    acc[1][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x1 + p), acc[1][0]);
+    acc[2][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x2 + p), acc[2][0]);
+    acc[3][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x3 + p), acc[3][0]);
+    acc[0][1] = _mm256_fmadd_ps (w1, _mm256_loadu_ps (x0 + p + 8), acc[0][1]);
+    acc[1][1] = _mm256_fmadd_ps (w1, _mm256_loadu_ps (x1 + p + 8), acc[1][1]);
+    acc[2][1] = _mm256_fmadd_ps (w1, _mm256_loadu_ps (x2 + p + 8), acc[2][1]);
+    acc[3][1] = _mm256_fmadd_ps (w1, _mm256_loadu_ps (x3 + p + 8), acc[3][1]);
+  }
+  if (p + 8 <= k)
+  {
+    __m256 w0 = load (a + p);
+    acc[0][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x0 + p), acc[0][0]);
+    acc[1][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x1 + p), acc[1][0]);
+    acc[2][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x2 + p), acc[2][0]);
+    acc[3][0] = _mm256_fmadd_ps (w0, _mm256_loadu_ps (x3 + p), acc[3][0]);
+    p += 8;
+  }
+  for (int v = 0; v < 4; ++v)
+  {
+    float result = horizontal_sum (acc[v][0], acc[v][1]);
+    const float *xv = x + v * k;
+    for (int q = p; q < k; ++q)
+    {
+      result = std::fma (load_one (a[q]), xv[q], result);
+    }
+    out[v * stride] = result;
+  }
+}
+
+template<typename T, __m256 (*load) (const T *), float (*load_one) (T)>
+static void gemv_many_avx2 (const T *a, const float *x, float *y, int m,
+                            int k, int count)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const T *row = a + (long) i * k;
+    int b = 0;
+    for (; b + 4 <= count; b += 4)
+    {
+      dot4_avx2<T, load, load_one> (row, x + (long) b * k, k,
+                                    y + (long) b * m + i, m);
+    }
+    for (; b < count; ++b)
+    {
+      y[(long) b * m + i] = dot_avx2<T, load, load_one> (row, x + (long) b * k,
+                                                        k);
+    }
+  }
+}
+
+template<__m256 (*widen) (const uint16_t *), float (*widen_one) (uint16_t)>
+static void gemv_half_avx2 (const uint16_t *a, const float *x, float *y,
+                            int m, int k)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    y[i] = dot_avx2<uint16_t, widen, widen_one> (a + (long) i * k, x, k);
+  }
+}
+
+#endif
+
+void kernels::add (const float *a, const float *b, float *out, int n)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    out[i] = a[i] + b[i];
+  }
+}
+
+void kernels::multiply (const float *a, const float *b, float *out, int n)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    out[i] = a[i] * b[i];
+  }
+}
+
+void kernels::scale (const float *a, float c, float *out, int n)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    out[i] = a[i] * c;
+  }
+}
+
+void kernels::axpy (float alpha, const float *x, float *y, int n)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    y[i] += alpha * x[i];
+  }
+}
+
+void kernels::relu (const float *a, float *out, int n)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    out[i] = a[i] >= 0 ? a[i] : 0;
+  }
+}
+
+float kernels::sum (const float *a, int n)
+{
+  float acc[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= n; i += LANES)
+  {
+    for (int l = 0; l < LANES; ++l)
+    {
+      acc[l] += a[i + l];
+    }
+  }
+  float result = 0;
+  for (int l = 0; l < LANES; ++l)
+  {
+    result += acc[l];
+  }
+  for (; i < n; ++i)
+  {
+    result += a[i];
+  }
+  return result;
+}
+
+float kernels::dot (const float *a, const float *b, int n)
+{
+#ifdef HAVE_X86_DISPATCH
+  // the portable loop below is vectorized poorly (lane shuffles) by some
+  // compilers, the explicit AVX2 loop is several times faster
+  if (has_avx2_f16c ())
+  {
+    return dot_avx2<float, load_fp32, load_one> (a, b, n);
+  }
+#endif
+  if (deterministic ())
+  {
+    return dot_canonical<float, load_one> (a, b, n);
+  }
+  float acc[LANES] = {0};
+  int i = 0;
+  for (; i + LANES <= n; i += LANES)
+  {
+    for (int l = 0; l < LANES; ++l)
+    {
+      acc[l] += a[i + l] * b[i + l];
+    }
+  }
+  float result = 0;
+  for (int l = 0; l < LANES; ++l)
+  {
+    result += acc[l];
+  }
+  for (; i < n; ++i)
+  {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+
+/**
+ * i-k-j gemm over row accessors: the innermost loop streams one row of b
+ * into one row of c.
+ */
+template<typename RowA, typename RowB, typename RowC>
+static void gemm_rows (RowA a, RowB b, RowC c, int m, int k, int n)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    std::fill (c (i), c (i) + n, 0.f);
+  }
+  for (int kk = 0; kk < k; kk += K_BLOCK)
+  {
+    int k_end = std::min (kk + K_BLOCK, k);
+    for (int i = 0; i < m; ++i)
+    {
+      const float *a_row = a (i);
+      for (int p = kk; p < k_end; ++p)
+      {
+        kernels::axpy (a_row[p], b (p), c (i), n);
+      }
+    }
+  }
+}
+
+void kernels::gemm (const float *const *a, const float *const *b,
+                    float *const *c, int m, int k, int n)
+{
+  if (n == 1)
+  {
+    // matrix * column vector: every output is a contiguous dot product.
+    // The column is gathered first unless its rows are already adjacent.
+    const float *column = b[0];
+    std::vector<float> gathered;
+    bool adjacent = true;
+    for (int p = 1; p < k && adjacent; ++p)
+    {
+      adjacent = b[p] == b[0] + p;
+    }
+    if (!adjacent)
+    {
+      gathered.resize (k);
+      for (int p = 0; p < k; ++p)
+      {
+        gathered[p] = b[p][0];
+      }
+      column = gathered.data ();
+    }
+    for (int i = 0; i < m; ++i)
+    {
+      c[i][0] = dot (a[i], column, k);
+    }
+    return;
+  }
+  gemm_rows ([a] (int i) { return a[i]; }, [b] (int p) { return b[p]; },
+             [c] (int i) { return c[i]; }, m, k, n);
+}
+
+void kernels::gemv (const float *a, const float *x, float *y, int m, int k)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    y[i] = dot (a + (long) i * k, x, k);
+  }
+}
+
+void kernels::gemv_many (const float *a, const float *x, float *y, int m,
+                         int k, int count)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (has_avx2_f16c ())
+  {
+    gemv_many_avx2<float, load_fp32, load_one> (a, x, y, m, k, count);
+    return;
+  }
+#endif
+  for (int i = 0; i < m; ++i)
+  {
+    for (int b = 0; b < count; ++b)
+    {
+      y[(long) b * m + i] = dot (a + (long) i * k, x + (long) b * k, k);
+    }
+  }
+}
+
+void kernels::gemm_packed (const float *a, const float *b, float *c, int m,
+                           int k, int n)
+{
+  if (n == 1)
+  {
+    gemv (a, b, c, m, k);
+    return;
+  }
+  gemm_rows ([a, k] (int i) { return a + (long) i * k; },
+             [b, n] (int p) { return b + (long) p * n; },
+             [c, n] (int i) { return c + (long) i * n; }, m, k, n);
+}
+
+void kernels::set_deterministic (bool enabled)
+{
+  deterministic_mode = enabled;
+}
+
+bool kernels::is_deterministic ()
+{
+  return deterministic ();
+}
+
+void kernels::set_isa_dispatch (bool enabled)
+{
+  isa_dispatch = enabled;
+}
+
+uint16_t kernels::to_fp16 (float f)
+{
+  uint32_t x;
+  std::memcpy (&x, &f, sizeof (float));
+  uint32_t sign = (x >> 16) & FP16_SIGN;
+  uint32_t abs = x & 0x7fffffffu;
+  if (abs > 0x7f800000u)
+  {
+    return (uint16_t) (sign | FP16_INF | FP16_QUIET_NAN);
+  }
+  if (abs >= FP16_OVERFLOW_BITS)
+  {
+    return (uint16_t) (sign | FP16_INF);
+  }
+
+  uint32_t exponent = abs >> 23;
+  uint32_t mantissa = abs & 0x7fffffu;
+  uint32_t half, rest, tie;
+  if (abs < FP16_MIN_NORMAL_BITS)
+  {
+    // subnormal half: the value in units of 2^-24
+    if (exponent == 0)
+    {
+      return (uint16_t) sign;
+    }
+    uint32_t shift = 126 - exponent;
+    if (shift > 24)
+    {
+      return (uint16_t) sign;
+    }
+    mantissa |= 0x800000u;
+    half = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    tie = 1u << (shift - 1);
+  }
+  else
+  {
+    half = ((exponent - FP16_BIAS_SHIFT) << 10) | (mantissa >> 13);
+    rest = mantissa & 0x1fffu;
+    tie = 0x1000u;
+  }
+  // a carry out of the mantissa correctly bumps the exponent
+  if (rest > tie || (rest == tie && (half & 1)))
+  {
+    ++half;
+  }
+  return (uint16_t) (sign | half);
+}
+
+float kernels::from_fp16 (uint16_t h)
+{
+  uint32_t sign = (uint32_t) (h & FP16_SIGN) << 16;
+  uint32_t exponent = (h >> 10) & 0x1fu;
+  uint32_t mantissa = h & 0x3ffu;
+  if (exponent == 0)
+  {
+    float value = std::ldexp ((float) mantissa, -24);
+    return sign != 0 ? -value : value;
+  }
+  uint32_t x = exponent == 0x1fu
+               ? sign | 0x7f800000u | (mantissa << 13)
+               : sign | ((exponent + FP16_BIAS_SHIFT) << 23) | (mantissa << 13);
+  float f;
+  std::memcpy (&f, &x, sizeof (float));
+  return f;
+}
+
+uint16_t kernels::to_bf16 (float f)
+{
+  uint32_t x;
+  std::memcpy (&x, &f, sizeof (float));
+  if ((x & 0x7fffffffu) > 0x7f800000u)
+  {
+    return (uint16_t) ((x >> 16) | 0x40u);
+  }
+  x += 0x7fffu + ((x >> 16) & 1);
+  return (uint16_t) (x >> 16);
+}
+
+float kernels::from_bf16 (uint16_t h)
+{
+  uint32_t x = (uint32_t) h << 16;
+  float f;
+  std::memcpy (&f, &x, sizeof (float));
+  return f;
+}
+
+template<float (*widen) (uint16_t)>
+static void gemv_half_scalar (const uint16_t *a, const float *x, float *y,
+                              int m, int k)
+{
+  for (int i = 0; i < m; ++i)
+  {
+    const uint16_t *row = a + (long) i * k;
+    if (deterministic ())
+    {
+      y[i] = dot_canonical<uint16_t, widen> (row, x, k);
+      continue;
+    }
+    float acc[LANES] = {0};
+    int p = 0;
+    for (; p + LANES <= k; p += LANES)
+    {
+      for (int l = 0; l < LANES; ++l)
+      {
+        acc[l] += widen (row[p + l]) * x[p + l];
+      }
+    }
+    float result = 0;
+    for (int l = 0; l < LANES; ++l)
+    {
+      result += acc[l];
+    }
+    for (; p < k; ++p)
+    {
+      result += widen (row[p]) * x[p];
+    }
+    y[i] = result;
+  }
+}
+
+void kernels::gemv_fp16 (const uint16_t *a, const float *x, float *y, int m,
+                         int k)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (has_avx2_f16c ())
+  {
+    gemv_half_avx2<widen_fp16, from_fp16> (a, x, y, m, k);
+    return;
+  }
+#endif
+  gemv_half_scalar<from_fp16> (a, x, y, m, k);
+}
+
+void kernels::gemv_bf16 (const uint16_t *a, const float *x, float *y, int m,
+                         int k)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (has_avx2_f16c ())
+  {
+    gemv_half_avx2<widen_bf16, from_bf16> (a, x, y, m, k);
+    return;
+  }
+#endif
+  gemv_half_scalar<from_bf16> (a, x, y, m, k);
+}
+
+void kernels::gemv_many_fp16 (const uint16_t *a, const float *x, float *y,
+                              int m, int k, int count)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (has_avx2_f16c ())
+  {
+    gemv_many_avx2<uint16_t, widen_fp16, from_fp16> (a, x, y, m, k, count);
+    return;
+  }
+#endif
+  for (int i = 0; i < m; ++i)
+  {
+    for (int b = 0; b < count; ++b)
+    {
+      gemv_half_scalar<from_fp16> (a + (long) i * k, x + (long) b * k,
+                                   y + (long) b * m + i, 1, k);
+    }
+  }
+}
+
+void kernels::gemv_many_bf16 (const uint16_t *a, const float *x, float *y,
+                              int m, int k, int count)
+{
+#ifdef HAVE_X86_DISPATCH
+  if (has_avx2_f16c ())
+  {
+    gemv_many_avx2<uint16_t, widen_bf16, from_bf16> (a, x, y, m, k, count);
+    return;
+  }
+#endif
+  for (int i = 0; i < m; ++i)
+  {
+    for (int b = 0; b < count; ++b)
+    {
+      gemv_half_scalar<from_bf16> (a + (long) i * k, x + (long) b * k,
+                                   y + (long) b * m + i, 1, k);
+    }
+  }
+}
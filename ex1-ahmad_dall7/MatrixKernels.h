@@ -0,0 +1,145 @@
+#ifndef MATRIXKERNELS_H
+#define MATRIXKERNELS_H
+
+#include <cstdint>
+
+/**
+ * Raw float kernels behind the Matrix operators.
+ * All kernels work on plain row pointers so they do not depend on how
+ * Matrix lays out its storage, and size checks are the caller's job. None
+ * of them allocate or throw, except gemm with n == 1 on a column whose rows
+ * are not adjacent in memory, which gathers the column into a temporary
+ * and can throw std::bad_alloc.
+ */
+namespace kernels
+{
+    /**
+     * out[i] = a[i] + b[i]
+     */
+    void add (const float *a, const float *b, float *out, int n);
+
+    /**
+     * out[i] = a[i] * b[i]
+     */
+    void multiply (const float *a, const float *b, float *out, int n);
+
+    /**
+     * out[i] = a[i] * c
+     */
+    void scale (const float *a, float c, float *out, int n);
+
+    /**
+     * y[i] += alpha * x[i]
+     */
+    void axpy (float alpha, const float *x, float *y, int n);
+
+    /**
+     * out[i] = max(a[i], 0)
+     */
+    void relu (const float *a, float *out, int n);
+
+    /**
+     * @return sum of a[0..n)
+     */
+    float sum (const float *a, int n);
+
+    /**
+     * @return inner product of a[0..n) and b[0..n)
+     */
+    float dot (const float *a, const float *b, int n);
+
+    /**
+     * c = a * b, where a is m x k, b is k x n and c is m x n.
+     * Each argument is an array of row pointers. c is overwritten and must
+     * not alias a or b. With n == 1 and rows of b that are not adjacent, the
+     * column is copied into a temporary (k floats), so that case allocates
+     * and may throw std::bad_alloc; it keeps the results equal to gemv.
+     */
+    void gemm (const float *const *a, const float *const *b,
+               float *const *c, int m, int k, int n);
+
+    /**
+     * y = a * x, where a is a contiguous row-major m x k matrix and x holds
+     * k floats. Gives the same results as gemm with n == 1.
+     */
+    void gemv (const float *a, const float *x, float *y, int m, int k);
+
+    /**
+     * gemv of a with count vectors stored one after the other:
+     * y[b * m + i] = row i of a . x[b * k .. b * k + k). Same results as
+     * count gemv calls, but each weight load is shared by several vectors.
+     */
+    void gemv_many (const float *a, const float *x, float *y, int m, int k,
+                    int count);
+
+    /**
+     * gemm on contiguous row-major matrices, same results as gemm.
+     */
+    void gemm_packed (const float *a, const float *b, float *c, int m, int k,
+                      int n);
+
+    /**
+     * float to IEEE half precision, rounding to nearest even. Values past
+     * the half range become infinity.
+     */
+    uint16_t to_fp16 (float f);
+
+    /**
+     * IEEE half precision to float, exact.
+     */
+    float from_fp16 (uint16_t h);
+
+    /**
+     * float to bfloat16 (the upper half of a float), rounding to nearest
+     * even.
+     */
+    uint16_t to_bf16 (float f);
+
+    /**
+     * bfloat16 to float, exact.
+     */
+    float from_bf16 (uint16_t h);
+
+    /**
+     * y = a * x, where a is an m x k row-major matrix of fp16 values and x
+     * holds k floats. Every weight is widened to float as it is loaded and
+     * the products are accumulated in float, so only the weight traffic is
+     * halved. Uses F16C/AVX2 when the CPU has them.
+     */
+    void gemv_fp16 (const uint16_t *a, const float *x, float *y, int m, int k);
+
+    /**
+     * gemv_fp16 for bfloat16 weights.
+     */
+    void gemv_bf16 (const uint16_t *a, const float *x, float *y, int m, int k);
+
+    /**
+     * gemv_many for fp16 / bf16 weights, same results as gemv_fp16 /
+     * gemv_bf16.
+     */
+    void gemv_many_fp16 (const uint16_t *a, const float *x, float *y, int m,
+                         int k, int count);
+    void gemv_many_bf16 (const uint16_t *a, const float *x, float *y, int m,
+                         int k, int count);
+
+    /**
+     * Deterministic mode, off by default. dot and the gemv kernels then
+     * reduce in one fixed order - 16 lanes of fused multiply-adds summed
+     * by a fixed pairwise tree - whichever code path runs, so their results
+     * are bit-identical on every CPU. The AVX2 path always uses that order;
+     * the mode makes the portable path follow it too, at the cost of a
+     * scalar fma per element. The other kernels are elementwise or already
+     * have a single code path. Process wide, set it before inference
+     * starts.
+     */
+    void set_deterministic (bool enabled);
+    bool is_deterministic ();
+
+    /**
+     * Lets the kernels use CPU specific instructions (the default) or
+     * forces the portable code, e.g. to check that both agree.
+     */
+    void set_isa_dispatch (bool enabled);
+}
+
+#endif //MATRIXKERNELS_H
@@ -0,0 +1,212 @@
+//
+// Naive reference implementations, see MatrixReference.h.
+//
+
+#include "MatrixReference.h"
+
+Matrix reference::add (const Matrix &a, const Matrix &b)
+{
+  if (a.get_rows () != b.get_rows () || a.get_cols () != b.get_cols ())
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  Matrix result (b);
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result (i, j) += a (i, j);
+    }
+  }
+  return result;
+}
+
+Matrix reference::dot (const Matrix &a, const Matrix &b)
+{
+  if (a.get_rows () != b.get_rows () || a.get_cols () != b.get_cols ())
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  Matrix result (a.get_rows (), a.get_cols ());
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result (i, j) = a (i, j) * b (i, j);
+    }
+  }
+  return result;
+}
+
+Matrix reference::multiply (const Matrix &a, const Matrix &b)
+{
+  if (a.get_cols () != b.get_rows ())
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  Matrix result (a.get_rows (), b.get_cols ());
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < b.get_cols (); ++j)
+    {
+      for (int k = 0; k < a.get_cols (); ++k)
+      {
+        result (i, j) += a (i, k) * b (k, j);
+      }
+    }
+  }
+  return result;
+}
+
+Matrix reference::scale (const Matrix &a, float c)
+{
+  Matrix result (a);
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result (i, j) *= c;
+    }
+  }
+  return result;
+}
+
+float reference::sum (const Matrix &a)
+{
+  float result = 0;
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result += a (i, j);
+    }
+  }
+  return result;
+}
+
+float reference::norm (const Matrix &a)
+{
+  float result = 0;
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result += (float) pow (a (i, j), 2);
+    }
+  }
+  return sqrt (result);
+}
+
+Matrix reference::relu (const Matrix &a)
+{
+  Matrix result (a);
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result (i, j) = a (i, j) >= 0 ? a (i, j) : 0;
+    }
+  }
+  return result;
+}
+
+Matrix reference::softmax (const Matrix &a)
+{
+  Matrix result (a);
+  float s = ZERO;
+  for (int i = 0; i < a.get_rows (); ++i)
+  {
+    for (int j = 0; j < a.get_cols (); ++j)
+    {
+      result (i, j) = std::exp (a (i, j));
+      s += result (i, j);
+    }
+  }
+  return scale (result, 1 / s);
+}
+
+Matrix reference::conv2d (const Matrix &input, const image_shape &shape,
+                          int kernel, const Matrix &weights,
+                          const Matrix &bias)
+{
+  int out_h = shape.height - kernel + 1;
+  int out_w = shape.width - kernel + 1;
+  Matrix result (weights.get_rows () * out_h * out_w, ONE);
+  for (int o = 0; o < weights.get_rows (); ++o)
+  {
+    for (int y = 0; y < out_h; ++y)
+    {
+      for (int x = 0; x < out_w; ++x)
+      {
+        float s = bias (o, 0);
+        for (int c = 0; c < shape.channels; ++c)
+        {
+          for (int ky = 0; ky < kernel; ++ky)
+          {
+            for (int kx = 0; kx < kernel; ++kx)
+            {
+              s += weights (o, (c * kernel + ky) * kernel + kx)
+                   * input[(c * shape.height + y + ky) * shape.width
+                           + x + kx];
+            }
+          }
+        }
+        result ((o * out_h + y) * out_w + x, 0) = s;
+      }
+    }
+  }
+  return result;
+}
+
+Matrix reference::max_pool (const Matrix &input, const image_shape &shape,
+                            int pool)
+{
+  int out_h = shape.height / pool;
+  int out_w = shape.width / pool;
+  Matrix result (shape.channels * out_h * out_w, ONE);
+  for (int c = 0; c < shape.channels; ++c)
+  {
+    for (int y = 0; y < out_h; ++y)
+    {
+      for (int x = 0; x < out_w; ++x)
+      {
+        float max = input[(c * shape.height + y * pool) * shape.width
+                          + x * pool];
+        for (int py = 0; py < pool; ++py)
+        {
+          for (int px = 0; px < pool; ++px)
+          {
+            float v = input[(c * shape.height + y * pool + py) * shape.width
+                            + x * pool + px];
+            max = v > max ? v : max;
+          }
+        }
+        result ((c * out_h + y) * out_w + x, 0) = max;
+      }
+    }
+  }
+  return result;
+}
+
+digit reference::predict (const Matrix weights[MLP_SIZE],
+                          const Matrix biases[MLP_SIZE], const Matrix &img)
+{
+  Matrix result (img);
+  result.vectorize ();
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    Matrix z = add (multiply (weights[i], result), biases[i]);
+    result = i == MLP_SIZE - 1 ? softmax (z) : relu (z);
+  }
+
+  digit d{ZERO, ZERO_F};
+  for (int i = 0; i < result.get_rows (); ++i)
+  {
+    if (result (i, 0) > d.probability)
+    {
+      d.probability = result (i, 0);
+      d.value = i;
+    }
+  }
+  return d;
+}
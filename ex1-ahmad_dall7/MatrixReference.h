@@ -0,0 +1,50 @@
+#ifndef MATRIXREFERENCE_H
+#define MATRIXREFERENCE_H
+
+#include "Conv2D.h"
+#include "MlpNetwork.h"
+
+/**
+ * The original, naive element-by-element implementations of the Matrix,
+ * activation and network math. They are slow on purpose: every element goes
+ * through the bounds-checked operator(), and every reduction is a single
+ * left-to-right sum. Optimized kernels are validated against these.
+ */
+namespace reference
+{
+    Matrix add (const Matrix &a, const Matrix &b);
+    Matrix dot (const Matrix &a, const Matrix &b);
+    Matrix multiply (const Matrix &a, const Matrix &b);
+    Matrix scale (const Matrix &a, float c);
+    float sum (const Matrix &a);
+    float norm (const Matrix &a);
+    Matrix relu (const Matrix &a);
+    Matrix softmax (const Matrix &a);
+
+    /**
+     * Valid, stride 1 convolution straight from the definition, without the
+     * activation. Arguments as in Conv2D.
+     * @return out_channels * out_height * out_width x 1
+     */
+    Matrix conv2d (const Matrix &input, const image_shape &shape, int kernel,
+                   const Matrix &weights, const Matrix &bias);
+
+    /**
+     * Non-overlapping max pooling straight from the definition.
+     */
+    Matrix max_pool (const Matrix &input, const image_shape &shape,
+                     int pool);
+
+    /**
+     * Runs the MLP_SIZE dense layers of MlpNetwork using only the functions
+     * above.
+     * @param weights weights[i] is the i'th layer weights matrix
+     * @param biases biases[i] is the i'th layer bias vector
+     * @param img input image, any shape with the first layer's input size
+     * @return predicted digit and its probability
+     */
+    digit predict (const Matrix weights[MLP_SIZE],
+                   const Matrix biases[MLP_SIZE], const Matrix &img);
+}
+
+#endif //MATRIXREFERENCE_H
@@ -0,0 +1,78 @@
+//
+// Non-overlapping max pooling layer.
+//
+
+#include "MaxPool2D.h"
+
+#include <algorithm>
+#include <vector>
+
+MaxPool2D::MaxPool2D (const image_shape &input, int pool)
+    : _input (input), _pool (pool)
+{
+  if (input.channels <= ZERO || pool <= ZERO || pool > input.height
+      || pool > input.width)
+  {
+    throw std::invalid_argument (CONV_SHAPE_ERR);
+  }
+}
+
+int MaxPool2D::input_size () const
+{
+  return _input.channels * _input.height * _input.width;
+}
+
+int MaxPool2D::output_size () const
+{
+  image_shape out = get_output_shape ();
+  return out.channels * out.height * out.width;
+}
+
+const image_shape &MaxPool2D::get_input_shape () const
+{
+  return _input;
+}
+
+image_shape MaxPool2D::get_output_shape () const
+{
+  return image_shape{_input.channels, _input.height / _pool,
+                     _input.width / _pool};
+}
+
+void MaxPool2D::forward (const float *in, float *out_values, float *) const
+{
+  image_shape out = get_output_shape ();
+  for (int c = 0; c < out.channels; ++c)
+  {
+    const float *channel = in + c * _input.height * _input.width;
+    float *dst = out_values + c * out.height * out.width;
+    for (int oy = 0; oy < out.height; ++oy)
+    {
+      for (int ox = 0; ox < out.width; ++ox)
+      {
+        const float *window = channel + oy * _pool * _input.width
+                              + ox * _pool;
+        float max = window[0];
+        for (int y = 0; y < _pool; ++y)
+        {
+          const float *row = window + y * _input.width;
+          max = std::max (max, *std::max_element (row, row + _pool));
+        }
+        dst[oy * out.width + ox] = max;
+      }
+    }
+  }
+}
+
+Matrix MaxPool2D::operator() (const Matrix &matrix) const
+{
+  if (matrix.get_rows () * matrix.get_cols () != input_size ())
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  std::vector<float> input (input_size ());
+  matrix.copy_to (input.data ());
+  Matrix result (output_size (), ONE);
+  forward (input.data (), result.data (), nullptr);
+  return result;
+}
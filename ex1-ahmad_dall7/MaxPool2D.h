@@ -0,0 +1,33 @@
+#ifndef MAXPOOL2D_H
+#define MAXPOOL2D_H
+
+#include "Conv2D.h"
+
+/**
+ * Non-overlapping max pooling: every pool x pool window of every channel is
+ * reduced to its maximum. Trailing rows/columns that do not fill a window
+ * are dropped.
+ */
+class MaxPool2D : public Layer
+{
+ public:
+  /**
+   * @throw std::invalid_argument if the pool does not fit the input
+   */
+  MaxPool2D (const image_shape &input, int pool);
+
+  Matrix operator() (const Matrix & matrix) const override;
+  void forward (const float * in, float * out,
+                float * scratch) const override;
+  int input_size () const override;
+  int output_size () const override;
+
+  const image_shape & get_input_shape () const;
+  image_shape get_output_shape () const;
+
+ private:
+  image_shape _input;
+  int _pool;
+};
+
+#endif //MAXPOOL2D_H
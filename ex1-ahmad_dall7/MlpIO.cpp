@@ -0,0 +1,348 @@
+//
+// Binary matrix and parameter files.
+//
+
+#include "MlpIO.h"
+#include "MaxPool2D.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#define DENSE_LAYER "dense"
+#define CONV_LAYER "conv2d"
+#define MAXPOOL_LAYER "maxpool"
+#define RELU_NAME "relu"
+#define SOFTMAX_NAME "softmax"
+#define FP32_NAME "fp32"
+#define FP16_NAME "fp16"
+#define BF16_NAME "bf16"
+#define COMMENT '#'
+
+static std::string layer_path (const std::string &dir, const char *prefix,
+                               int layer)
+{
+  return dir + "/" + prefix + std::to_string (layer + 1);
+}
+
+bool read_matrix_file (const std::string &path, Matrix &mat)
+{
+  std::ifstream is (path, std::ios::in | std::ios::binary);
+  if (!is.is_open ())
+  {
+    return false;
+  }
+  is >> mat;
+  return true;
+}
+
+bool write_matrix_file (const std::string &path, const Matrix &mat)
+{
+  std::ofstream os (path, std::ios::out | std::ios::binary
+                          | std::ios::trunc);
+  if (!os.is_open ())
+  {
+    return false;
+  }
+  for (int i = 0; i < mat.get_rows (); ++i)
+  {
+    os.write ((const char *) mat.row_data (i),
+              mat.get_cols () * sizeof (float));
+  }
+  return (bool) os;
+}
+
+void load_parameters (const std::string &dir, Matrix weights[MLP_SIZE],
+                      Matrix biases[MLP_SIZE]) noexcept(false)
+{
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    weights[i] = Matrix (weights_dims[i].rows, weights_dims[i].cols);
+    biases[i] = Matrix (bias_dims[i].rows, bias_dims[i].cols);
+    try
+    {
+      if (read_matrix_file (layer_path (dir, WEIGHTS_FILE_PREFIX, i),
+                            weights[i])
+          && read_matrix_file (layer_path (dir, BIAS_FILE_PREFIX, i),
+                               biases[i]))
+      {
+        continue;
+      }
+    }
+    catch (const std::runtime_error &)
+    {
+      // a short file, reported below like a missing one
+    }
+    throw std::invalid_argument (PARAMETERS_ERR + std::to_string (i + 1));
+  }
+}
+
+void save_parameters (const std::string &dir,
+                      const Matrix weights[MLP_SIZE],
+                      const Matrix biases[MLP_SIZE]) noexcept(false)
+{
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    if (!write_matrix_file (layer_path (dir, WEIGHTS_FILE_PREFIX, i),
+                            weights[i])
+        || !write_matrix_file (layer_path (dir, BIAS_FILE_PREFIX, i),
+                               biases[i]))
+    {
+      throw std::invalid_argument (PARAMETERS_ERR + std::to_string (i + 1));
+    }
+  }
+}
+
+static std::string model_dir (const std::string &path)
+{
+  size_t slash = path.find_last_of ('/');
+  return slash == std::string::npos ? "." : path.substr (0, slash);
+}
+
+static std::string relative_to (const std::string &dir,
+                                const std::string &file)
+{
+  return !file.empty () && file[0] == '/' ? file : dir + "/" + file;
+}
+
+static bool parse_activation (const std::string &name, activation_fn &func)
+{
+  if (name == RELU_NAME)
+  {
+    func = activation::relu;
+    return true;
+  }
+  if (name == SOFTMAX_NAME)
+  {
+    func = activation::softmax;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Reads the optional precision field of a dense line, FP32 if absent.
+ * @return false on an unknown precision or trailing fields
+ */
+static bool parse_precision (std::istringstream &fields,
+                             weight_precision &precision)
+{
+  std::string name, rest;
+  precision = FP32;
+  if (!(fields >> name))
+  {
+    return true;
+  }
+  if (fields >> rest)
+  {
+    return false;
+  }
+  if (name == FP16_NAME)
+  {
+    precision = FP16;
+  }
+  else if (name == BF16_NAME)
+  {
+    precision = BF16;
+  }
+  return name == FP32_NAME || precision != FP32;
+}
+
+/**
+ * Reads the parameters of a dense or conv2d layer.
+ * @return false if either file is missing or too short
+ */
+static bool read_layer_parameters (const std::string &dir,
+                                   const std::string &weights_file,
+                                   const std::string &bias_file,
+                                   Matrix &weights, Matrix &bias)
+{
+  try
+  {
+    return read_matrix_file (relative_to (dir, weights_file), weights)
+           && read_matrix_file (relative_to (dir, bias_file), bias);
+  }
+  catch (const std::runtime_error &)
+  {
+    return false;
+  }
+}
+
+/**
+ * Builds the layer described by one model file line.
+ * @return the new layer, nullptr if the line is malformed
+ */
+static Layer *parse_layer (const std::string &dir, const std::string &line)
+{
+  std::istringstream fields (line);
+  std::string type, func_name, weights_file, bias_file;
+  image_shape shape{};
+  activation_fn func;
+  fields >> type;
+  if (type == DENSE_LAYER)
+  {
+    int rows, cols;
+    weight_precision precision;
+    if (!(fields >> rows >> cols >> func_name >> weights_file >> bias_file)
+        || rows <= ZERO || cols <= ZERO || !parse_activation (func_name, func)
+        || !parse_precision (fields, precision))
+    {
+      return nullptr;
+    }
+    Matrix weights (rows, cols), bias (rows, ONE);
+    if (!read_layer_parameters (dir, weights_file, bias_file, weights, bias))
+    {
+      return nullptr;
+    }
+    return new Dense (weights, bias, func, precision);
+  }
+  if (type == CONV_LAYER)
+  {
+    int out_channels, kernel;
+    if (!(fields >> shape.channels >> shape.height >> shape.width
+                 >> out_channels >> kernel >> func_name >> weights_file
+                 >> bias_file)
+        || out_channels <= ZERO || kernel <= ZERO
+        || !parse_activation (func_name, func))
+    {
+      return nullptr;
+    }
+    Matrix weights (out_channels, shape.channels * kernel * kernel);
+    Matrix bias (out_channels, ONE);
+    if (!read_layer_parameters (dir, weights_file, bias_file, weights, bias))
+    {
+      return nullptr;
+    }
+    return new Conv2D (shape, kernel, weights, bias, func);
+  }
+  if (type == MAXPOOL_LAYER)
+  {
+    int pool;
+    if (!(fields >> shape.channels >> shape.height >> shape.width >> pool))
+    {
+      return nullptr;
+    }
+    return new MaxPool2D (shape, pool);
+  }
+  return nullptr;
+}
+
+std::unique_ptr<MlpNetwork> load_model (const std::string &path)
+noexcept(false)
+{
+  std::ifstream in (path);
+  if (!in.is_open ())
+  {
+    throw std::invalid_argument (MODEL_ERR + path);
+  }
+  std::string dir = model_dir (path);
+  std::vector<Layer *> layers;
+  std::string line;
+  while (std::getline (in, line))
+  {
+    if (line.empty () || line[0] == COMMENT)
+    {
+      continue;
+    }
+    Layer *layer = nullptr;
+    try
+    {
+      layer = parse_layer (dir, line);
+    }
+    catch (const std::invalid_argument &)
+    {
+      // bad conv/pool shape, reported like any malformed line
+    }
+    if (layer == nullptr)
+    {
+      for (Layer *built: layers)
+      {
+        delete built;
+      }
+      throw std::invalid_argument (MODEL_ERR + line);
+    }
+    layers.push_back (layer);
+  }
+  if (layers.empty ())
+  {
+    throw std::invalid_argument (MODEL_ERR + path);
+  }
+
+  Layer **owned = new Layer *[layers.size ()];
+  std::copy (layers.begin (), layers.end (), owned);
+  return std::unique_ptr<MlpNetwork> (new MlpNetwork (owned,
+                                                      (int) layers.size ()));
+}
+
+std::unique_ptr<MlpNetwork> load_network (const std::string &path)
+noexcept(false)
+{
+  std::string suffix = MODEL_FILE_SUFFIX;
+  if (path.size () >= suffix.size ()
+      && path.compare (path.size () - suffix.size (), suffix.size (),
+                       suffix) == 0)
+  {
+    return load_model (path);
+  }
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  load_parameters (path, weights, biases);
+  return std::unique_ptr<MlpNetwork> (new MlpNetwork (weights, biases));
+}
+
+std::unique_ptr<Cascade> load_cascade (const std::string &path)
+noexcept(false)
+{
+  std::ifstream in (path);
+  if (!in.is_open ())
+  {
+    throw std::invalid_argument (CASCADE_ERR + path);
+  }
+  std::string dir = model_dir (path);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline (in, line))
+  {
+    if (!line.empty () && line[0] != COMMENT)
+    {
+      lines.push_back (line);
+    }
+  }
+  if (lines.empty ())
+  {
+    throw std::invalid_argument (CASCADE_ERR + path);
+  }
+
+  std::unique_ptr<Cascade> cascade (new Cascade);
+  for (size_t i = 0; i < lines.size (); ++i)
+  {
+    std::istringstream fields (lines[i]);
+    std::string model_file, threshold_field, rest;
+    fields >> model_file >> threshold_field >> rest;
+    bool last = i + 1 == lines.size ();
+    float threshold = 1.f;
+    size_t parsed = 0;
+    try
+    {
+      if (!threshold_field.empty ())
+      {
+        threshold = std::stof (threshold_field, &parsed);
+      }
+    }
+    catch (const std::logic_error &)
+    {
+      parsed = 0;
+    }
+    if (model_file.empty () || !rest.empty ()
+        || (threshold_field.empty () && !last)
+        || (!threshold_field.empty () && parsed != threshold_field.size ())
+        || threshold < 0.f || threshold > 1.f)
+    {
+      throw std::invalid_argument (CASCADE_ERR + lines[i]);
+    }
+    cascade->add_stage (load_model (relative_to (dir, model_file)),
+                        threshold);
+  }
+  return cascade;
+}
@@ -0,0 +1,87 @@
+#ifndef MLPIO_H
+#define MLPIO_H
+
+#include "Cascade.h"
+#include "MlpNetwork.h"
+
+#include <memory>
+#include <string>
+
+#define PARAMETERS_ERR "Error: invalid Parameters file for layer: "
+#define MODEL_ERR "Error: invalid model file line: "
+#define CASCADE_ERR "Error: invalid cascade file line: "
+#define MODEL_FILE_SUFFIX ".model"
+#define WEIGHTS_FILE_PREFIX "w"
+#define BIAS_FILE_PREFIX "b"
+
+/**
+ * Reads a binary file of row-major float32 values into mat.
+ * The file must hold at least as many values as mat has elements.
+ * @return true on success, false if the file can not be opened
+ * @throw std::runtime_error if the file is too short
+ */
+bool read_matrix_file (const std::string &path, Matrix &mat);
+
+/**
+ * Writes mat as row-major float32 values, the format read_matrix_file
+ * and the w/b parameter files use.
+ * @return true on success, false if the file can not be written
+ */
+bool write_matrix_file (const std::string &path, const Matrix &mat);
+
+/**
+ * Loads the parameter files <dir>/w1..wN and <dir>/b1..bN, sized by
+ * weights_dims and bias_dims.
+ * @throw std::invalid_argument naming the layer whose files are bad
+ */
+void load_parameters (const std::string &dir, Matrix weights[MLP_SIZE],
+                      Matrix biases[MLP_SIZE]) noexcept(false);
+
+/**
+ * Writes weights and biases to <dir>/w1..wN and <dir>/b1..bN.
+ * @throw std::invalid_argument naming the layer that could not be written
+ */
+void save_parameters (const std::string &dir,
+                      const Matrix weights[MLP_SIZE],
+                      const Matrix biases[MLP_SIZE]) noexcept(false);
+
+/**
+ * Loads a network described by a model file. Every non-empty line that does
+ * not start with '#' describes one layer, in order:
+ *
+ *   dense <rows> <cols> <relu|softmax> <weights file> <bias file>
+ *         [fp32|fp16|bf16]
+ *   conv2d <channels> <height> <width> <out channels> <kernel>
+ *          <relu|softmax> <weights file> <bias file>
+ *   maxpool <channels> <height> <width> <pool>
+ *
+ * Parameter file paths are relative to the model file's directory.
+ * @throw std::invalid_argument on a malformed line, a missing parameter file
+ *        or layers whose sizes do not chain
+ */
+std::unique_ptr<MlpNetwork> load_model (const std::string &path)
+noexcept(false);
+
+/**
+ * Loads a model file (see load_model) when path ends with
+ * MODEL_FILE_SUFFIX, otherwise the w1..w4 / b1..b4 parameter files of the
+ * directory path.
+ * @throw std::invalid_argument if the files are missing or malformed
+ */
+std::unique_ptr<MlpNetwork> load_network (const std::string &path)
+noexcept(false);
+
+/**
+ * Loads a cascade file. Every non-empty line that does not start with '#'
+ * is one stage, cheapest first:
+ *
+ *   <model file> <threshold>
+ *
+ * The threshold may be left out on the last line, which always answers.
+ * Model file paths are relative to the cascade file's directory.
+ * @throw std::invalid_argument on a malformed line or a bad model file
+ */
+std::unique_ptr<Cascade> load_cascade (const std::string &path)
+noexcept(false);
+
+#endif //MLPIO_H
@@ -3,18 +3,45 @@
 //
 
 #include "MlpNetwork.h"
+#include "CacheInfo.h"
 
+#include <algorithm>
 
-MlpNetwork::MlpNetwork(Matrix weights[MLP_SIZE],
-                       Matrix bias[MLP_SIZE]):layers_count(MLP_SIZE)
+#define MAX_TILE 256
+
+static void free_layers (Layer **layers, int layers_count)
+{
+  for (int i = 0; i < layers_count; ++i)
+  {
+    delete layers[i];
+  }
+  delete[] layers;
+}
+
+MlpNetwork::MlpNetwork(Matrix weights[MLP_SIZE], Matrix bias[MLP_SIZE],
+                       weight_precision precision):layers_count(MLP_SIZE)
 {
-  layers = new (std::nothrow) Dense * [MLP_SIZE];
+  layers = new (std::nothrow) Layer * [MLP_SIZE];
   for (int i = 0; i < MLP_SIZE; ++i)
   {
     layers[i] = new (std::nothrow) Dense (weights[i], bias[i],
                                           i == MLP_SIZE - 1
                                           ? activation::softmax
-                                          : activation::relu);
+                                          : activation::relu,
+                                          precision);
+  }
+}
+
+MlpNetwork::MlpNetwork (Layer **layers, int layers_count)
+    : layers (layers), layers_count (layers_count)
+{
+  for (int i = 0; i + 1 < layers_count; ++i)
+  {
+    if (layers[i]->output_size () != layers[i + 1]->input_size ())
+    {
+      free_layers (layers, layers_count);
+      throw std::invalid_argument (NETWORK_SHAPE_ERR);
+    }
   }
 }
 
@@ -23,7 +50,7 @@ digit MlpNetwork::operator() (const Matrix &matrix) const
   Matrix result (matrix);
   result.vectorize();
   digit d{ZERO, ZERO_F};
-  for (int i = 0; i < MLP_SIZE; ++i)
+  for (int i = 0; i < layers_count; ++i)
   {
     result = (*(this->layers[i])) (result);
   }
@@ -38,13 +65,109 @@ digit MlpNetwork::operator() (const Matrix &matrix) const
   }
   return d;
 }
+
+static digit most_probable (const float *probabilities, int n)
+{
+  digit d{ZERO, ZERO_F};
+  for (int i = 0; i < n; ++i)
+  {
+    if (probabilities[i] > d.probability)
+    {
+      d.probability = probabilities[i];
+      d.value = i;
+    }
+  }
+  return d;
+}
+
+digit MlpNetwork::operator() (const Matrix &matrix,
+                              InferenceContext &context) const
+{
+  if (matrix.get_rows () * matrix.get_cols () != layers[0]->input_size ())
+  {
+    throw std::length_error (LENGTH_ERR);
+  }
+  context.reserve (*this);
+  matrix.copy_to (context.activations (0));
+  for (int i = 0; i < layers_count; ++i)
+  {
+    layers[i]->forward (context.activations (i % 2),
+                        context.activations ((i + 1) % 2),
+                        context.scratch ());
+  }
+
+  return most_probable (context.activations (layers_count % 2),
+                        layers[layers_count - 1]->output_size ());
+}
+
+int MlpNetwork::tile_size () const
+{
+  // the intermediate activations of a tile live in L1, its input images
+  // in half of L2
+  long hidden_bytes = 0;
+  for (int i = 0; i < layers_count; ++i)
+  {
+    hidden_bytes += layers[i]->output_size () * (long) sizeof (float);
+  }
+  long input_bytes = layers[0]->input_size () * (long) sizeof (float);
+  long tile = std::min (cache_info::l1d_bytes () / hidden_bytes,
+                        cache_info::l2_bytes () / 2 / input_bytes);
+  return (int) std::max (1L, std::min ((long) MAX_TILE, tile));
+}
+
+void MlpNetwork::predict (const Matrix *images, int count, digit *results,
+                          InferenceContext &context, batch_mode mode) const
+{
+  int inputs = layers[0]->input_size ();
+  int outputs = layers[layers_count - 1]->output_size ();
+  int tile = mode == BATCH_FUSED ? tile_size ()
+                                 : std::max (1, std::min (count,
+                                                          LAYERWISE_SLICE));
+  context.reserve (*this, tile);
+  for (int start = 0; start < count; start += tile)
+  {
+    int n = std::min (tile, count - start);
+    float *in = context.activations (0);
+    for (int b = 0; b < n; ++b)
+    {
+      const Matrix &img = images[start + b];
+      if (img.get_rows () * img.get_cols () != inputs)
+      {
+        throw std::length_error (LENGTH_ERR);
+      }
+      img.copy_to (in + (long) b * inputs);
+    }
+    for (int i = 0; i < layers_count; ++i)
+    {
+      layers[i]->forward_batch (context.activations (i % 2),
+                                context.activations ((i + 1) % 2), n,
+                                context.scratch ());
+    }
+    const float *out = context.activations (layers_count % 2);
+    for (int b = 0; b < n; ++b)
+    {
+      results[start + b] = most_probable (out + (long) b * outputs, outputs);
+    }
+  }
+}
+
 MlpNetwork::~MlpNetwork ()
 {
-  for(int i=0 ; i<layers_count ; ++i)
+  free_layers (layers, layers_count);
+}
+
+int MlpNetwork::get_layers_count () const
+{
+  return layers_count;
+}
+
+const Layer &MlpNetwork::get_layer (int layer) const
+{
+  if (layer < ZERO || layer >= layers_count)
   {
-    delete layers[i];
+    throw std::out_of_range (OUT_OF_RANGE_ERR);
   }
-  delete[] layers;
+  return *layers[layer];
 }
 
 
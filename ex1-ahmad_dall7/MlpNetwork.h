@@ -4,8 +4,12 @@
 #define MLPNETWORK_H
 
 #include "Dense.h"
+#include "InferenceContext.h"
 
 #define MLP_SIZE 4
+#define NETWORK_SHAPE_ERR "Layer sizes do not chain"
+// images BATCH_LAYERWISE runs through a layer before the next layer
+#define LAYERWISE_SLICE 4096
 
 /**
  * @struct digit
@@ -19,6 +23,18 @@ typedef struct digit {
     float probability;
 } digit;
 
+/**
+ * @enum batch_mode
+ * @brief How MlpNetwork::predict walks a batch. FUSED pushes tiles of
+ *        tile_size() images through every layer back to back, so their
+ *        activations stay in cache. LAYERWISE runs each layer over a
+ *        slice of LAYERWISE_SLICE images before the next one.
+ */
+typedef enum batch_mode {
+    BATCH_FUSED,
+    BATCH_LAYERWISE
+} batch_mode;
+
 const Matrix::dims img_dims = {28, 28};
 const Matrix::dims weights_dims[] = {{128, 784},
                                      {64,  128},
@@ -34,14 +50,59 @@ const Matrix::dims bias_dims[] = {{128, 1},
 class MlpNetwork
 {
  private:
-  Dense ** layers;
+  Layer ** layers;
   int layers_count;
 
  public:
-  MlpNetwork(Matrix weights[MLP_SIZE], Matrix bias[MLP_SIZE]);
+  /**
+   * The MLP_SIZE layer MLP, relu hidden layers and a softmax output, with
+   * every layer's weights stored in the given precision.
+   */
+  MlpNetwork(Matrix weights[MLP_SIZE], Matrix bias[MLP_SIZE],
+             weight_precision precision = FP32);
+
+  /**
+   * Builds a network from any chain of layers, e.g. Conv2D, MaxPool2D and
+   * Dense. Takes ownership of the layers and of the array, both are freed
+   * with delete / delete[].
+   * @throw std::invalid_argument if a layer's output size is not the next
+   *        layer's input size (the layers are freed first)
+   */
+  MlpNetwork(Layer ** layers, int layers_count);
+
   digit operator()(const Matrix& matrix) const;
+
+  /**
+   * Same result as operator()(matrix), computed in context's buffers with
+   * Layer::forward. Only reads the network, so any number of threads can
+   * share it, each with its own context; nothing is allocated once the
+   * context fits the network.
+   * @throw std::length_error if matrix does not fit the first layer
+   */
+  digit operator()(const Matrix& matrix, InferenceContext & context) const;
+  /**
+   * Classifies count images into results, same answers as operator().
+   * LAYERWISE reserves room for one slice in context, FUSED only for one
+   * tile.
+   * @throw std::length_error if an image does not fit the first layer
+   */
+  void predict(const Matrix * images, int count, digit * results,
+               InferenceContext & context,
+               batch_mode mode = BATCH_FUSED) const;
+
+  /**
+   * Images per tile in BATCH_FUSED mode: as many as keep the tile's
+   * intermediate activations in L1 and its input images in half of L2.
+   */
+  int tile_size() const;
+
   ~MlpNetwork();
 
+  MlpNetwork(const MlpNetwork &) = delete;
+  MlpNetwork & operator = (const MlpNetwork &) = delete;
+
+  int get_layers_count () const;
+  const Layer & get_layer (int layer) const;
 };
 
 
@@ -0,0 +1,158 @@
+//
+// Lock free readers over a hot swappable network.
+//
+
+#include "ModelHandle.h"
+#include "MlpIO.h"
+
+#include <thread>
+
+static std::atomic<unsigned int> next_stripe (0);
+
+ModelHandle::Pin::Pin (reader_counter *counter, const published *model)
+    : _counter (counter), _model (model)
+{}
+
+ModelHandle::Pin::Pin (Pin &&other) noexcept
+    : _counter (other._counter), _model (other._model)
+{
+  other._counter = nullptr;
+  other._model = nullptr;
+}
+
+ModelHandle::Pin::~Pin ()
+{
+  if (_counter != nullptr)
+  {
+    // release: every use of the network happens before the writer sees the
+    // counter drop
+    _counter->count.fetch_sub (1, std::memory_order_release);
+  }
+}
+
+const MlpNetwork &ModelHandle::Pin::operator* () const
+{
+  return *_model->network;
+}
+
+const MlpNetwork *ModelHandle::Pin::operator-> () const
+{
+  return _model->network.get ();
+}
+
+unsigned long ModelHandle::Pin::generation () const
+{
+  return _model->generation;
+}
+
+ModelHandle::ModelHandle (std::unique_ptr<MlpNetwork> network)
+    : _current (nullptr), _epoch (0)
+{
+  if (!network)
+  {
+    throw std::invalid_argument (HANDLE_NULL_ERR);
+  }
+  _current.store (new published{std::move (network), 0});
+}
+
+ModelHandle::~ModelHandle ()
+{
+  {
+    std::lock_guard<std::mutex> lock (_loader_lock);
+    if (_loader.valid ())
+    {
+      _loader.wait ();
+    }
+  }
+  delete _current.load ();
+}
+
+ModelHandle::reader_counter *ModelHandle::enter () const
+{
+  static thread_local unsigned int stripe = next_stripe++ % READER_STRIPES;
+  unsigned long epoch = _epoch.load ();
+  reader_counter *counter = &_readers[epoch & 1][stripe];
+  // seq_cst: either the writer sees this reader, or the reader's load of
+  // _current below sees the writer's new pointer
+  counter->count.fetch_add (1);
+  return counter;
+}
+
+ModelHandle::Pin ModelHandle::pin () const
+{
+  reader_counter *counter = enter ();
+  return Pin (counter, _current.load ());
+}
+
+digit ModelHandle::operator() (const Matrix &img) const
+{
+  Pin model = pin ();
+  return (*model) (img);
+}
+
+digit ModelHandle::operator() (const Matrix &img,
+                               InferenceContext &context) const
+{
+  Pin model = pin ();
+  return (*model) (img, context);
+}
+
+void ModelHandle::wait_for_readers (unsigned long epoch)
+{
+  for (reader_counter &counter: _readers[epoch & 1])
+  {
+    // seq_cst, not just acquire: this load has to be ordered after the
+    // exchange of _current (and the epoch flip) for the handshake with
+    // enter() to hold - an acquire load may be reordered before them
+    while (counter.count.load (std::memory_order_seq_cst) != 0)
+    {
+      std::this_thread::yield ();
+    }
+  }
+}
+
+void ModelHandle::synchronize ()
+{
+  // A reader that loaded the epoch just before a flip still counts itself
+  // in the old parity, so one flip is not enough: the second flip drains
+  // the readers that entered the other parity before the swap.
+  for (int flip = 0; flip < 2; ++flip)
+  {
+    wait_for_readers (_epoch.fetch_add (1));
+  }
+}
+
+unsigned long ModelHandle::publish (std::unique_ptr<MlpNetwork> network)
+{
+  if (!network)
+  {
+    throw std::invalid_argument (HANDLE_NULL_ERR);
+  }
+  std::lock_guard<std::mutex> lock (_writer);
+  unsigned long generation = _current.load ()->generation + 1;
+  published *old = _current.exchange (new published{std::move (network),
+                                                     generation});
+  synchronize ();
+  delete old;
+  return generation;
+}
+
+std::shared_future<unsigned long> ModelHandle::reload (const std::string &path)
+{
+  std::lock_guard<std::mutex> lock (_loader_lock);
+  if (_loader.valid ())
+  {
+    _loader.wait ();
+  }
+  _loader = std::async (std::launch::async, [this, path] ()
+  {
+    // the slow part, parsing and building, runs before the swap
+    return publish (load_network (path));
+  }).share ();
+  return _loader;
+}
+
+unsigned long ModelHandle::generation () const
+{
+  return pin ().generation ();
+}
@@ -0,0 +1,136 @@
+#ifndef MODELHANDLE_H
+#define MODELHANDLE_H
+
+#include "MlpNetwork.h"
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#define HANDLE_NULL_ERR "Error: a model handle needs a network"
+// counters per epoch parity, readers spread over them by thread so they do
+// not all bounce one cache line
+#define READER_STRIPES 16
+
+/**
+ * Shared, hot swappable network.
+ *
+ * Readers pin the current network without taking a lock: a pin bumps a
+ * reader counter of the current epoch and loads the published pointer.
+ * publish() swaps the pointer atomically and then waits a grace period,
+ * two epoch flips each followed by the drain of the previous epoch's
+ * counters, before freeing the old network. Inferences that started on the
+ * old network finish on it, new ones see the new network, and no reader
+ * ever waits on the writer.
+ */
+class ModelHandle
+{
+ private:
+  typedef struct published {
+      std::unique_ptr<MlpNetwork> network;
+      unsigned long generation;
+  } published;
+
+  typedef struct alignas(CACHE_LINE) reader_counter {
+      std::atomic<long> count{0};
+  } reader_counter;
+
+ public:
+  /**
+   * A pinned network, valid until the pin is destroyed. Pins are cheap and
+   * meant to be held for one request, holding one for long delays the
+   * reclamation of a replaced network.
+   */
+  class Pin
+  {
+   public:
+    Pin (Pin &&other) noexcept;
+    Pin (const Pin &) = delete;
+    Pin &operator= (const Pin &) = delete;
+    Pin &operator= (Pin &&) = delete;
+    ~Pin ();
+
+    const MlpNetwork &operator* () const;
+    const MlpNetwork *operator-> () const;
+
+    /**
+     * @return generation of the pinned network, 0 for the initial one
+     */
+    unsigned long generation () const;
+
+   private:
+    friend class ModelHandle;
+    Pin (reader_counter *counter, const published *model);
+
+    reader_counter *_counter;
+    const published *_model;
+  };
+
+  /**
+   * @throw std::invalid_argument if network is null
+   */
+  explicit ModelHandle (std::unique_ptr<MlpNetwork> network) noexcept(false);
+
+  /**
+   * Waits for a running reload. All pins must be released before.
+   */
+  ~ModelHandle ();
+
+  ModelHandle (const ModelHandle &) = delete;
+  ModelHandle &operator= (const ModelHandle &) = delete;
+
+  /**
+   * Pins the current network, lock free.
+   */
+  Pin pin () const;
+
+  /**
+   * Runs one inference on the current network.
+   */
+  digit operator() (const Matrix &img) const;
+
+  /**
+   * Runs one inference on the current network with the caller's scratch
+   * memory, see MlpNetwork::operator()(const Matrix&, InferenceContext&).
+   */
+  digit operator() (const Matrix &img, InferenceContext &context) const;
+
+  /**
+   * Publishes network and frees the one it replaces once every inference
+   * that could still be using it has finished. Blocks the calling thread
+   * (never the readers) for that grace period.
+   * @return generation of the published network
+   * @throw std::invalid_argument if network is null
+   */
+  unsigned long publish (std::unique_ptr<MlpNetwork> network) noexcept(false);
+
+  /**
+   * Builds a network in a background thread and publishes it. path is
+   * anything load_network accepts. A reload waits for the previous one to
+   * finish first.
+   * @return the generation of the new network, or the loading error
+   */
+  std::shared_future<unsigned long> reload (const std::string &path);
+
+  /**
+   * @return generation of the currently published network
+   */
+  unsigned long generation () const;
+
+ private:
+  reader_counter *enter () const;
+  void synchronize ();
+  void wait_for_readers (unsigned long epoch);
+
+  std::atomic<published *> _current;
+  std::atomic<unsigned long> _epoch;
+  mutable reader_counter _readers[2][READER_STRIPES];
+  // serializes writers, readers never take it
+  std::mutex _writer;
+  std::mutex _loader_lock;
+  std::shared_future<unsigned long> _loader;
+};
+
+#endif //MODELHANDLE_H
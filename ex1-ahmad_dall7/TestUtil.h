@@ -0,0 +1,76 @@
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+//
+// Fixtures shared by the test programs. Each test is a single translation
+// unit, so the failure count lives here as a static.
+//
+
+#include "MlpIO.h"
+#include "Trainer.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define IMAGES_COUNT 10
+
+// the labels of images/im0 .. im9
+static const unsigned int image_labels[IMAGES_COUNT] = {5, 0, 4, 1, 9, 2, 1,
+                                                        3, 1, 4};
+// a small network keeps training in the tests fast
+static const Matrix::dims small_dims[MLP_SIZE] = {{16, 784},
+                                                  {12, 16},
+                                                  {10, 12},
+                                                  {10, 10}};
+
+static int failures = 0;
+
+/**
+ * Counts a failure and reports it, the test keeps going so one run shows
+ * every broken check.
+ */
+inline void check (bool ok, const std::string &what)
+{
+  if (!ok)
+  {
+    ++failures;
+    std::cerr << "FAILED: " << what << std::endl;
+  }
+}
+
+/**
+ * Reads images/im0 .. im9 under base.
+ * @throw std::invalid_argument if an image is missing
+ */
+inline std::vector<Matrix> load_image_matrices (const std::string &base)
+{
+  std::vector<Matrix> images;
+  for (int i = 0; i < IMAGES_COUNT; ++i)
+  {
+    Matrix img (img_dims.rows, img_dims.cols);
+    if (!read_matrix_file (base + "images/im" + std::to_string (i), img))
+    {
+      throw std::invalid_argument ("missing image " + std::to_string (i));
+    }
+    images.push_back (img);
+  }
+  return images;
+}
+
+/**
+ * The images of load_image_matrices with their labels.
+ */
+inline std::vector<sample> load_images (const std::string &base)
+{
+  std::vector<sample> samples;
+  std::vector<Matrix> images = load_image_matrices (base);
+  for (int i = 0; i < IMAGES_COUNT; ++i)
+  {
+    samples.push_back (sample{images[i], image_labels[i]});
+  }
+  return samples;
+}
+
+#endif //TESTUTIL_H
@@ -0,0 +1,450 @@
+//
+// Backpropagation and data-parallel mini-batch training, see Trainer.h.
+//
+
+#include "Trainer.h"
+#include "MatrixKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
+
+// keeps log() finite when the network is confidently wrong
+#define MIN_PROBABILITY 1e-30f
+
+/**
+ * Numerically stable in-place softmax (the max logit is subtracted first,
+ * which leaves the result unchanged).
+ */
+static void softmax_in_place (float *z, int n)
+{
+  float max = *std::max_element (z, z + n);
+  float s = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    z[i] = std::exp (z[i] - max);
+    s += z[i];
+  }
+  kernels::scale (z, 1 / s, z, n);
+}
+
+/**
+ * Reusable barrier for a fixed number of threads (std::barrier is C++20).
+ * The generation counter tells a wake-up of this round from the next one.
+ */
+class batch_barrier
+{
+ public:
+  explicit batch_barrier (int count) : _count (count)
+  {
+  }
+
+  void wait ()
+  {
+    std::unique_lock<std::mutex> lock (_mutex);
+    unsigned long generation = _generation;
+    if (++_waiting == _count)
+    {
+      _waiting = 0;
+      ++_generation;
+      _released.notify_all ();
+      return;
+    }
+    _released.wait (lock, [this, generation] ()
+    { return _generation != generation; });
+  }
+
+ private:
+  std::mutex _mutex;
+  std::condition_variable _released;
+  int _count;
+  int _waiting = 0;
+  unsigned long _generation = 0;
+};
+
+static void zero (Matrix &m)
+{
+  for (int i = 0; i < m.get_rows (); ++i)
+  {
+    std::fill (m.row_data (i), m.row_data (i) + m.get_cols (), 0.f);
+  }
+}
+
+Trainer::Trainer (const Matrix weights[MLP_SIZE],
+                  const Matrix biases[MLP_SIZE],
+                  const trainer_config &config)
+    : _config (config), _step (0), _epochs (0)
+{
+  if (config.batch_size <= ZERO || config.threads <= ZERO
+      || config.epochs < ZERO || config.learning_rate <= 0)
+  {
+    throw std::invalid_argument (TRAINER_CONFIG_ERR);
+  }
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    if (biases[i].get_rows () != weights[i].get_rows ()
+        || biases[i].get_cols () != ONE
+        || (i > 0 && weights[i].get_cols () != weights[i - 1].get_rows ()))
+    {
+      throw std::invalid_argument (TRAINER_CONFIG_ERR);
+    }
+    _weights[i] = weights[i];
+    _biases[i] = biases[i];
+    _first_moment_w[i] = Matrix (weights[i].get_rows (),
+                                 weights[i].get_cols ());
+    _second_moment_w[i] = _first_moment_w[i];
+    _first_moment_b[i] = Matrix (biases[i].get_rows (), ONE);
+    _second_moment_b[i] = _first_moment_b[i];
+  }
+  // the other workspaces are built by the worker threads that use them,
+  // so their pages are first touched there
+  _workspaces.resize (config.deterministic
+                     ? std::max (config.threads, TRAINER_SHARDS)
+                     : config.threads);
+  init_workspace (_workspaces[0]);
+}
+
+void Trainer::random_parameters (const Matrix::dims w_dims[MLP_SIZE],
+                                 unsigned int seed,
+                                 Matrix weights[MLP_SIZE],
+                                 Matrix biases[MLP_SIZE])
+{
+  std::mt19937 rng (seed);
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    std::normal_distribution<float> values
+        (0.f, std::sqrt (2.f / (float) w_dims[i].cols));
+    weights[i] = Matrix (w_dims[i].rows, w_dims[i].cols);
+    biases[i] = Matrix (w_dims[i].rows, ONE);
+    for (int j = 0; j < w_dims[i].rows * w_dims[i].cols; ++j)
+    {
+      weights[i][j] = values (rng);
+    }
+  }
+}
+
+void Trainer::init_workspace (workspace &ws) const
+{
+  ws.activations[0] = Matrix (ONE, _weights[0].get_cols ());
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    ws.grad_w[i] = Matrix (_weights[i].get_rows (), _weights[i].get_cols ());
+    ws.grad_b[i] = Matrix (_biases[i].get_rows (), ONE);
+    ws.activations[i + 1] = Matrix (ONE, _weights[i].get_rows ());
+    ws.deltas[i] = Matrix (ONE, _weights[i].get_rows ());
+  }
+  ws.loss = 0;
+  ws.correct = 0;
+  ws.ready = true;
+}
+
+void Trainer::forward (const Matrix &image, workspace &ws) const
+{
+  image.copy_to (ws.activations[0].row_data (0));
+  for (int l = 0; l < MLP_SIZE; ++l)
+  {
+    const Matrix &w = _weights[l];
+    const float *in = ws.activations[l].row_data (0);
+    float *out = ws.activations[l + 1].row_data (0);
+    for (int i = 0; i < w.get_rows (); ++i)
+    {
+      out[i] = kernels::dot (w.row_data (i), in, w.get_cols ())
+               + _biases[l].row_data (i)[0];
+    }
+    if (l == MLP_SIZE - 1)
+    {
+      softmax_in_place (out, w.get_rows ());
+    }
+    else
+    {
+      kernels::relu (out, out, w.get_rows ());
+    }
+  }
+}
+
+float Trainer::sample_loss (const sample &s, workspace &ws) const
+{
+  if (s.image.get_rows () * s.image.get_cols () != _weights[0].get_cols ()
+      || s.label >= (unsigned int) _weights[MLP_SIZE - 1].get_rows ())
+  {
+    throw std::invalid_argument (TRAINER_SAMPLE_ERR);
+  }
+  forward (s.image, ws);
+  const float *p = ws.activations[MLP_SIZE].row_data (0);
+  return -std::log (std::max (p[s.label], MIN_PROBABILITY));
+}
+
+void Trainer::backward (const sample &s, workspace &ws) const
+{
+  // softmax + cross entropy: dL/dz = p - onehot(label)
+  int outputs = _weights[MLP_SIZE - 1].get_rows ();
+  float *delta = ws.deltas[MLP_SIZE - 1].row_data (0);
+  std::copy (ws.activations[MLP_SIZE].row_data (0),
+             ws.activations[MLP_SIZE].row_data (0) + outputs, delta);
+  delta[s.label] -= 1;
+
+  for (int l = MLP_SIZE - 1; l >= 0; --l)
+  {
+    const Matrix &w = _weights[l];
+    const float *in = ws.activations[l].row_data (0);
+    delta = ws.deltas[l].row_data (0);
+    float *prev = l > 0 ? ws.deltas[l - 1].row_data (0) : nullptr;
+    if (prev != nullptr)
+    {
+      std::fill (prev, prev + w.get_cols (), 0.f);
+    }
+    for (int i = 0; i < w.get_rows (); ++i)
+    {
+      if (delta[i] == 0)
+      {
+        continue; // dead relu unit, contributes nothing
+      }
+      ws.grad_b[l].row_data (i)[0] += delta[i];
+      kernels::axpy (delta[i], in, ws.grad_w[l].row_data (i), w.get_cols ());
+      if (prev != nullptr)
+      {
+        kernels::axpy (delta[i], w.row_data (i), prev, w.get_cols ());
+      }
+    }
+    if (prev != nullptr)
+    {
+      // relu'(z) is 1 exactly where the cached activation is positive
+      for (int j = 0; j < w.get_cols (); ++j)
+      {
+        prev[j] = in[j] > 0 ? prev[j] : 0;
+      }
+    }
+  }
+}
+
+void Trainer::compute_gradients (const std::vector<sample> &data, int begin,
+                                 int end, workspace &ws) const
+{
+  if (!ws.ready)
+  {
+    init_workspace (ws);
+  }
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    zero (ws.grad_w[i]);
+    zero (ws.grad_b[i]);
+  }
+  ws.loss = 0;
+  ws.correct = 0;
+  for (int i = begin; i < end; ++i)
+  {
+    const sample &s = data[_order[i]];
+    ws.loss += sample_loss (s, ws);
+    const float *p = ws.activations[MLP_SIZE].row_data (0);
+    int outputs = _weights[MLP_SIZE - 1].get_rows ();
+    if ((unsigned int) (std::max_element (p, p + outputs) - p) == s.label)
+    {
+      ++ws.correct;
+    }
+    backward (s, ws);
+  }
+}
+
+void Trainer::reduce_gradients (int used_workspaces)
+{
+  workspace &total = _workspaces[0];
+  for (int t = 1; t < used_workspaces; ++t)
+  {
+    const workspace &part = _workspaces[t];
+    for (int l = 0; l < MLP_SIZE; ++l)
+    {
+      for (int i = 0; i < total.grad_w[l].get_rows (); ++i)
+      {
+        kernels::add (total.grad_w[l].row_data (i),
+                      part.grad_w[l].row_data (i),
+                      total.grad_w[l].row_data (i),
+                      total.grad_w[l].get_cols ());
+        total.grad_b[l].row_data (i)[0] += part.grad_b[l].row_data (i)[0];
+      }
+    }
+    total.loss += part.loss;
+    total.correct += part.correct;
+  }
+}
+
+/**
+ * One parameter tensor's update. g is the summed gradient, scaled by
+ * inv_batch to the batch mean.
+ */
+static void update_rows (Matrix &param, const Matrix &grad, Matrix &m,
+                         Matrix &v, const trainer_config &config,
+                         float inv_batch, long step)
+{
+  float lr = config.learning_rate;
+  float m_correction = 1 - (float) std::pow (config.beta1, step);
+  float v_correction = 1 - (float) std::pow (config.beta2, step);
+  for (int i = 0; i < param.get_rows (); ++i)
+  {
+    float *p = param.row_data (i);
+    const float *g = grad.row_data (i);
+    if (config.optimizer == SGD)
+    {
+      kernels::axpy (-lr * inv_batch, g, p, param.get_cols ());
+      continue;
+    }
+    float *m_row = m.row_data (i);
+    float *v_row = v.row_data (i);
+    for (int j = 0; j < param.get_cols (); ++j)
+    {
+      float g_mean = g[j] * inv_batch;
+      m_row[j] = config.beta1 * m_row[j] + (1 - config.beta1) * g_mean;
+      v_row[j] = config.beta2 * v_row[j]
+                 + (1 - config.beta2) * g_mean * g_mean;
+      p[j] -= lr * (m_row[j] / m_correction)
+              / (std::sqrt (v_row[j] / v_correction) + config.epsilon);
+    }
+  }
+}
+
+void Trainer::apply_update (int batch_size)
+{
+  ++_step;
+  float inv_batch = 1.f / (float) batch_size;
+  const workspace &total = _workspaces[0];
+  for (int l = 0; l < MLP_SIZE; ++l)
+  {
+    update_rows (_weights[l], total.grad_w[l], _first_moment_w[l],
+                 _second_moment_w[l], _config, inv_batch, _step);
+    update_rows (_biases[l], total.grad_b[l], _first_moment_b[l],
+                 _second_moment_b[l], _config, inv_batch, _step);
+  }
+}
+
+std::vector<epoch_stats> Trainer::train (const std::vector<sample> &data)
+{
+  std::vector<epoch_stats> stats;
+  for (int e = 0; e < _config.epochs; ++e)
+  {
+    stats.push_back (train_epoch (data));
+  }
+  return stats;
+}
+
+epoch_stats Trainer::train_epoch (const std::vector<sample> &data)
+{
+  auto start = std::chrono::steady_clock::now ();
+  int n = (int) data.size ();
+  // validate up front, a throw inside a worker thread would terminate
+  for (const auto &s: data)
+  {
+    if (s.image.get_rows () * s.image.get_cols () != _weights[0].get_cols ()
+        || s.label >= (unsigned int) _weights[MLP_SIZE - 1].get_rows ())
+    {
+      throw std::invalid_argument (TRAINER_SAMPLE_ERR);
+    }
+  }
+  _order.resize (n);
+  std::iota (_order.begin (), _order.end (), 0);
+  std::mt19937 rng (_config.seed + _epochs++);
+  std::shuffle (_order.begin (), _order.end (), rng);
+
+  double loss = 0;
+  int correct = 0;
+  int max_parts = std::min (_config.deterministic ? TRAINER_SHARDS
+                                                  : _config.threads,
+                            std::min (_config.batch_size, n));
+  int threads = std::max (1, std::min (_config.threads, max_parts));
+  // the workers are started once per epoch and meet twice per batch: when
+  // the gradients are done, and when thread 0 (the calling thread) has
+  // reduced them and updated the parameters the next batch reads.
+  // shard s gets samples [begin + s * batch / parts, ...), thread t works
+  // on shards t, t + threads, ... which workspace a shard uses does not
+  // depend on the thread, so neither do the results
+  batch_barrier barrier (threads);
+  auto run_batches = [&] (int t)
+  {
+    for (int begin = 0; begin < n; begin += _config.batch_size)
+    {
+      int batch = std::min (_config.batch_size, n - begin);
+      int parts = std::min (max_parts, batch);
+      for (int s = t; s < parts; s += threads)
+      {
+        compute_gradients (data, begin + s * batch / parts,
+                           begin + (s + 1) * batch / parts, _workspaces[s]);
+      }
+      barrier.wait ();
+      if (t == 0)
+      {
+        reduce_gradients (parts);
+        loss += _workspaces[0].loss;
+        correct += _workspaces[0].correct;
+        apply_update (batch);
+      }
+      barrier.wait ();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; ++t)
+  {
+    workers.emplace_back (run_batches, t);
+  }
+  run_batches (0);
+  for (auto &worker: workers)
+  {
+    worker.join ();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now () - start;
+  epoch_stats stats{};
+  stats.loss = n == 0 ? 0 : (float) (loss / n);
+  stats.accuracy = n == 0 ? 0 : (float) correct / (float) n;
+  stats.seconds = elapsed.count ();
+  stats.samples_per_sec = stats.seconds > 0 ? n / stats.seconds : 0;
+  stats.samples_per_sec_per_core = stats.samples_per_sec / threads;
+  return stats;
+}
+
+float Trainer::loss (const std::vector<sample> &data) const
+{
+  workspace ws;
+  init_workspace (ws);
+  double total = 0;
+  for (const auto &s: data)
+  {
+    total += sample_loss (s, ws);
+  }
+  return data.empty () ? 0 : (float) (total / data.size ());
+}
+
+const Matrix &Trainer::get_weights (int layer) const
+{
+  if (layer < ZERO || layer >= MLP_SIZE)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERR);
+  }
+  return _weights[layer];
+}
+
+const Matrix &Trainer::get_bias (int layer) const
+{
+  if (layer < ZERO || layer >= MLP_SIZE)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERR);
+  }
+  return _biases[layer];
+}
+
+const trainer_config &Trainer::get_config () const
+{
+  return _config;
+}
+
+void Trainer::export_parameters (Matrix weights[MLP_SIZE],
+                                 Matrix biases[MLP_SIZE]) const
+{
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    weights[i] = _weights[i];
+    biases[i] = _biases[i];
+  }
+}
@@ -0,0 +1,171 @@
+#ifndef TRAINER_H
+#define TRAINER_H
+
+#include "MlpNetwork.h"
+
+#include <vector>
+
+#define TRAINER_CONFIG_ERR "Invalid trainer configuration"
+#define TRAINER_SAMPLE_ERR "Invalid training sample"
+// shards of a batch in deterministic mode, whatever the thread count
+#define TRAINER_SHARDS 8
+
+/**
+ * @enum optimizer_type
+ * @brief Parameter update rule applied after every mini-batch.
+ */
+typedef enum optimizer_type {
+    SGD,
+    ADAM
+} optimizer_type;
+
+/**
+ * @struct trainer_config
+ * @brief Hyper parameters of a Trainer.
+ * @var epochs - passes over the data set (used by train())
+ * @var batch_size - samples per parameter update
+ * @var threads - worker threads computing the gradients of a batch
+ * @var optimizer - SGD or ADAM
+ * @var learning_rate - step size
+ * @var beta1, beta2, epsilon - Adam moment decay rates and stabilizer
+ * @var seed - seed of the shuffling between epochs
+ * @var deterministic - split every batch into TRAINER_SHARDS fixed shards
+ *      instead of one per thread, so the parameters after training do not
+ *      depend on threads. Together with kernels::set_deterministic they do
+ *      not depend on the CPU either.
+ */
+typedef struct trainer_config {
+    int epochs = 10;
+    int batch_size = 32;
+    int threads = 1;
+    optimizer_type optimizer = ADAM;
+    float learning_rate = 0.001f;
+    float beta1 = 0.9f;
+    float beta2 = 0.999f;
+    float epsilon = 1e-8f;
+    unsigned int seed = 0;
+    bool deterministic = false;
+} trainer_config;
+
+/**
+ * @struct sample
+ * @brief One labeled training image, any shape with as many elements as the
+ *        first layer has inputs.
+ */
+typedef struct sample {
+    Matrix image;
+    unsigned int label;
+} sample;
+
+/**
+ * @struct epoch_stats
+ * @brief Loss, accuracy and throughput of one pass over the data.
+ * @var loss - mean cross entropy loss
+ * @var accuracy - fraction of samples predicted correctly before the update
+ * @var seconds - wall clock time of the epoch
+ * @var samples_per_sec - training throughput
+ * @var samples_per_sec_per_core - throughput divided by the threads the
+ * epoch ran on
+ */
+typedef struct epoch_stats {
+    float loss;
+    float accuracy;
+    double seconds;
+    double samples_per_sec;
+    double samples_per_sec_per_core;
+} epoch_stats;
+
+/**
+ * Mini-batch trainer for the MLP_SIZE layer network of MlpNetwork: relu
+ * hidden layers and a softmax output trained with cross entropy.
+ * Each batch is split into shards, one per worker thread or TRAINER_SHARDS
+ * in deterministic mode. Every shard's forward and backward passes run into
+ * its own gradient buffers, and the buffers are then reduced in shard order
+ * before the update.
+ */
+class Trainer
+{
+ public:
+  /**
+   * Starts from the given parameters. Layer sizes are taken from the
+   * matrices, so smaller or larger networks than weights_dims are fine.
+   * @throw std::invalid_argument if the shapes do not chain or the config
+   *        is invalid
+   */
+  Trainer (const Matrix weights[MLP_SIZE], const Matrix biases[MLP_SIZE],
+           const trainer_config &config);
+
+  /**
+   * Fills weights/biases with He initialized parameters of the given shapes
+   * (zero biases).
+   */
+  static void random_parameters (const Matrix::dims w_dims[MLP_SIZE],
+                                 unsigned int seed,
+                                 Matrix weights[MLP_SIZE],
+                                 Matrix biases[MLP_SIZE]);
+
+  /**
+   * Runs config.epochs epochs over data.
+   * @return statistics of every epoch
+   */
+  std::vector<epoch_stats> train (const std::vector<sample> &data);
+
+  /**
+   * One shuffled pass over data with a parameter update per mini-batch.
+   */
+  epoch_stats train_epoch (const std::vector<sample> &data);
+
+  /**
+   * Mean cross entropy loss of the current parameters over data.
+   */
+  float loss (const std::vector<sample> &data) const;
+
+  const Matrix & get_weights (int layer) const;
+  const Matrix & get_bias (int layer) const;
+  const trainer_config & get_config () const;
+
+  /**
+   * Copies the current parameters out, e.g. to build an MlpNetwork or to
+   * save them with save_parameters.
+   */
+  void export_parameters (Matrix weights[MLP_SIZE],
+                          Matrix biases[MLP_SIZE]) const;
+
+ private:
+  /**
+   * Per-thread forward/backward state, allocated once and reused.
+   * Activations and deltas are 1 x n rows so they are contiguous.
+   */
+  struct workspace {
+      Matrix grad_w[MLP_SIZE];
+      Matrix grad_b[MLP_SIZE];
+      Matrix activations[MLP_SIZE + 1];
+      Matrix deltas[MLP_SIZE];
+      double loss;
+      int correct;
+      bool ready = false;
+  };
+
+  Matrix _weights[MLP_SIZE];
+  Matrix _biases[MLP_SIZE];
+  Matrix _first_moment_w[MLP_SIZE];
+  Matrix _first_moment_b[MLP_SIZE];
+  Matrix _second_moment_w[MLP_SIZE];
+  Matrix _second_moment_b[MLP_SIZE];
+  trainer_config _config;
+  std::vector<workspace> _workspaces;
+  std::vector<int> _order;
+  long _step;
+  int _epochs;
+
+  void init_workspace (workspace &ws) const;
+  void forward (const Matrix &image, workspace &ws) const;
+  float sample_loss (const sample &s, workspace &ws) const;
+  void backward (const sample &s, workspace &ws) const;
+  void compute_gradients (const std::vector<sample> &data, int begin,
+                          int end, workspace &ws) const;
+  void reduce_gradients (int used_workspaces);
+  void apply_update (int batch_size);
+};
+
+#endif //TRAINER_H
@@ -0,0 +1,213 @@
+//
+// Tests for InferenceCache: xxh64 matches the reference xxHash, cached
+// answers equal the network's, eviction is least recently used, and a
+// published model invalidates what the previous one answered.
+//
+// Usage: ./cache_test [ex1 directory]
+//
+
+#include "InferenceCache.h"
+#include "MlpIO.h"
+#include "TestUtil.h"
+#include "Trainer.h"
+
+#include <thread>
+
+#define RANDOM_SEED 11
+#define THREADS 4
+#define THREAD_ROUNDS 50
+
+static bool same (const digit &a, const digit &b)
+{
+  return a.value == b.value && a.probability == b.probability;
+}
+
+static void test_xxh64 ()
+{
+  std::cout << "Checking xxh64 against reference values" << std::endl;
+  // xxhash.xxh64 of bytes (i * 7 + 3) & 0xff, i < length
+  static const struct {
+      size_t length;
+      uint64_t seed;
+      uint64_t hash;
+  } reference[] = {
+      {0, 0x0ULL, 0xef46db3751d8e999ULL},
+      {1, 0x0ULL, 0x1f25c8d0bc1f4bb6ULL},
+      {3, 0x0ULL, 0x31d2363f52e564c9ULL},
+      {4, 0x0ULL, 0x9bb64b7d66ee9fdaULL},
+      {8, 0x0ULL, 0xdab99d95c6f90092ULL},
+      {31, 0x0ULL, 0xa2aa5f33cc4a6119ULL},
+      {32, 0x0ULL, 0x23c3c17ef790fd97ULL},
+      {33, 0x1ULL, 0x17b3df313de9a40eULL},
+      {100, 0x9e3779b97f4a7c15ULL, 0xf6d8f65c625abb4fULL},
+      {3136, 0x2aULL, 0x6657967a89fb549ULL},
+  };
+  std::vector<unsigned char> bytes (3136);
+  for (size_t i = 0; i < bytes.size (); ++i)
+  {
+    bytes[i] = (unsigned char) (i * 7 + 3);
+  }
+  for (const auto &r: reference)
+  {
+    check (xxh64 (bytes.data (), r.length, r.seed) == r.hash,
+           "xxh64 of " + std::to_string (r.length) + " bytes");
+  }
+}
+
+static void test_hits_and_eviction (const MlpNetwork &network,
+                                    const std::vector<Matrix> &images)
+{
+  std::cout << "Checking cached answers and eviction" << std::endl;
+  InferenceContext context;
+  InferenceCache cache (IMAGES_COUNT);
+  bool ok = true;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (const Matrix &img: images)
+    {
+      ok = ok && same (cache (network, img, context), network (img, context));
+    }
+  }
+  cache_stats stats = cache.get_stats ();
+  check (ok, "cached answers");
+  check (stats.hits == IMAGES_COUNT && stats.misses == IMAGES_COUNT
+         && stats.entries == IMAGES_COUNT && stats.evictions == 0,
+         "hit and miss counts");
+
+  Matrix changed = images[0];
+  changed[0] += 1.f;
+  cache (network, changed, context);
+  check (cache.get_stats ().misses == IMAGES_COUNT + 1,
+         "one changed pixel misses");
+
+  InferenceCache small (3);
+  for (int i: {0, 1, 2, 0, 3})
+  {
+    small (network, images[i], context);
+  }
+  // images 1 and 2 were the least recently used when 3 came in
+  stats = small.get_stats ();
+  check (stats.hits == 1 && stats.misses == 4 && stats.evictions == 1
+         && stats.entries == 3, "eviction counts");
+  small.reset_stats ();
+  for (int i: {0, 3, 2, 1})
+  {
+    small (network, images[i], context);
+  }
+  stats = small.get_stats ();
+  check (stats.hits == 3 && stats.misses == 1, "least recently used evicted");
+
+  small.clear ();
+  check (small.get_stats ().entries == 0, "clear");
+}
+
+static void test_reload (const std::string &base,
+                         const std::vector<Matrix> &images)
+{
+  std::cout << "Checking invalidation on publish" << std::endl;
+  ModelHandle handle (load_model (base + "parameters/mlp.model"));
+  InferenceContext context;
+  InferenceCache cache (IMAGES_COUNT);
+  for (const Matrix &img: images)
+  {
+    cache (handle, img, context);
+  }
+
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (weights_dims, RANDOM_SEED, weights, biases);
+  std::unique_ptr<MlpNetwork> replacement (new MlpNetwork (weights, biases));
+  const MlpNetwork &fresh = *replacement;
+  handle.publish (std::move (replacement));
+
+  bool ok = true;
+  for (const Matrix &img: images)
+  {
+    ok = ok && same (cache (handle, img, context), fresh (img, context));
+  }
+  check (ok, "answers of the published model");
+  cache_stats stats = cache.get_stats ();
+  check (stats.invalidations == IMAGES_COUNT && stats.hits == 0
+         && stats.entries == IMAGES_COUNT, "invalidation counts");
+}
+
+static void test_threads (const MlpNetwork &network,
+                          const std::vector<Matrix> &images)
+{
+  std::cout << "Checking concurrent lookups" << std::endl;
+  InferenceCache cache (IMAGES_COUNT / 2);
+  std::vector<digit> expected;
+  InferenceContext context;
+  for (const Matrix &img: images)
+  {
+    expected.push_back (network (img, context));
+  }
+  std::vector<int> wrong (THREADS, 0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < THREADS; ++t)
+  {
+    workers.emplace_back ([&, t] ()
+    {
+      InferenceContext own;
+      for (int r = 0; r < THREAD_ROUNDS; ++r)
+      {
+        int i = (r * (t + 1)) % IMAGES_COUNT;
+        wrong[t] += !same (cache (network, images[i], own), expected[i]);
+      }
+    });
+  }
+  for (std::thread &worker: workers)
+  {
+    worker.join ();
+  }
+  bool ok = true;
+  for (int w: wrong)
+  {
+    ok = ok && w == 0;
+  }
+  cache_stats stats = cache.get_stats ();
+  check (ok, "concurrent answers");
+  check (stats.hits + stats.misses == THREADS * THREAD_ROUNDS
+         && stats.entries <= IMAGES_COUNT / 2, "concurrent counts");
+}
+
+static void test_capacity ()
+{
+  try
+  {
+    InferenceCache empty (0);
+    check (false, "zero capacity");
+  }
+  catch (const std::invalid_argument &)
+  {
+  }
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  try
+  {
+    std::vector<Matrix> images = load_image_matrices (base);
+    std::unique_ptr<MlpNetwork> network = load_model (
+        base + "parameters/mlp.model");
+    test_xxh64 ();
+    test_hits_and_eviction (*network, images);
+    test_reload (base, images);
+    test_threads (*network, images);
+    test_capacity ();
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All cache checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+//
+// Tests for Cascade: a stage answers exactly when its probability reaches
+// its threshold, the statistics count what happened, and cascade files
+// load and reject malformed lines.
+//
+// Usage: ./cascade_test [ex1 directory]
+//
+
+#include "MlpIO.h"
+#include "TestUtil.h"
+#include "Trainer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#define SEED 3
+#define FIT_EPOCHS 30
+#define CASCADE_FILE "cascade_test.cascade"
+
+/**
+ * A small network fitted to the images, confident on some of them.
+ */
+static std::unique_ptr<MlpNetwork> small_network (
+    const std::vector<sample> &images)
+{
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (small_dims, SEED, weights, biases);
+  trainer_config config;
+  config.batch_size = 5;
+  config.epochs = FIT_EPOCHS;
+  Trainer trainer (weights, biases, config);
+  trainer.train (images);
+  trainer.export_parameters (weights, biases);
+  return std::unique_ptr<MlpNetwork> (new MlpNetwork (weights, biases));
+}
+
+static void test_thresholds (const std::string &base,
+                             const std::vector<sample> &images)
+{
+  std::cout << "Checking cascade answers and statistics" << std::endl;
+  InferenceContext context;
+  for (float threshold: {0.f, 0.5f, 0.9f, 0.999f, 1.f})
+  {
+    Cascade cascade;
+    cascade.add_stage (small_network (images), threshold);
+    cascade.add_stage (load_model (base + "parameters/mlp.model"), 0.f);
+    long escalated = 0;
+    bool ok = true;
+    for (const sample &s: images)
+    {
+      digit small = cascade.get_stage (0) (s.image, context);
+      digit big = cascade.get_stage (1) (s.image, context);
+      bool confident = small.probability >= threshold;
+      escalated += !confident;
+      const digit &expected = confident ? small : big;
+      digit actual = cascade (s.image, context);
+      ok = ok && actual.value == expected.value
+           && actual.probability == expected.probability;
+    }
+    std::string name = "threshold " + std::to_string (threshold);
+    check (ok, name + " answers");
+
+    std::vector<stage_stats> stats = cascade.get_stats ();
+    check (stats[0].evaluated == IMAGES_COUNT
+           && stats[0].answered == IMAGES_COUNT - escalated
+           && stats[1].evaluated == escalated
+           && stats[1].answered == escalated, name + " statistics");
+    check (threshold > 0.f || stats[0].hit_rate == 1., name + " hit rate");
+    check (cascade.average_us () > 0, name + " latency");
+    cascade.reset_stats ();
+    check (cascade.get_stats ()[0].evaluated == 0, name + " reset");
+  }
+}
+
+static bool loads (const std::string &contents)
+{
+  std::ofstream (CASCADE_FILE) << contents;
+  try
+  {
+    load_cascade (CASCADE_FILE);
+    return true;
+  }
+  catch (const std::invalid_argument &)
+  {
+    return false;
+  }
+}
+
+static void test_files (const std::string &base)
+{
+  std::cout << "Checking cascade files" << std::endl;
+  std::string model = base + "parameters/mlp.model";
+  std::ofstream (CASCADE_FILE) << "# two stages\n" << model << " 0.75\n"
+                               << model << "\n";
+  std::unique_ptr<Cascade> cascade = load_cascade (CASCADE_FILE);
+  check (cascade->get_stages_count () == 2, "stages in file");
+  check (cascade->get_threshold (0) == 0.75f, "threshold in file");
+
+  check (loads (model + " 1\n"), "single stage with threshold");
+  check (!loads (model + "\n" + model + "\n"), "missing threshold");
+  check (!loads (model + " 1.5\n" + model + "\n"), "threshold above 1");
+  check (!loads (model + " 0.5x\n" + model + "\n"), "malformed threshold");
+  check (!loads (model + " 0.5 extra\n" + model + "\n"), "extra field");
+  check (!loads ("# nothing\n"), "empty cascade");
+  check (!loads ("missing.model\n"), "missing model");
+  std::remove (CASCADE_FILE);
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  try
+  {
+    std::vector<sample> images = load_images (base);
+    test_thresholds (base, images);
+    test_files (base);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All cascade checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
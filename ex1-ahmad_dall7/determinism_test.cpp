@@ -0,0 +1,194 @@
+//
+// Tests for deterministic mode: with kernels::set_deterministic the
+// portable kernels give the same bits as the AVX2 ones, so network outputs
+// do not depend on the code path, and deterministic training gives the
+// same parameters for every thread count.
+//
+// Usage: ./determinism_test [ex1 directory]
+//
+
+#include "MatrixKernels.h"
+#include "MlpIO.h"
+#include "TestUtil.h"
+#include "Trainer.h"
+
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+
+#define SEED 37
+#define MAX_LENGTH 100
+#define GEMV_ROWS 13
+#define GEMV_VECTORS 6
+#define TRAIN_EPOCHS 3
+#define TRAIN_BATCH 7
+
+static std::mt19937 rng (SEED);
+
+static bool same_bits (const float *a, const float *b, size_t n)
+{
+  return std::memcmp (a, b, n * sizeof (float)) == 0;
+}
+
+static std::vector<float> random_floats (size_t n)
+{
+  std::uniform_real_distribution<float> values (-1.f, 1.f);
+  std::vector<float> v (n);
+  for (float &f: v)
+  {
+    f = values (rng);
+  }
+  return v;
+}
+
+/**
+ * Runs f with ISA dispatch on and off.
+ * @return whether both runs wrote the same bits to out
+ */
+static bool same_on_every_path (const std::function<void (float *)> &f,
+                                size_t n)
+{
+  std::vector<float> dispatched (n), portable (n);
+  kernels::set_isa_dispatch (true);
+  f (dispatched.data ());
+  kernels::set_isa_dispatch (false);
+  f (portable.data ());
+  kernels::set_isa_dispatch (true);
+  return same_bits (dispatched.data (), portable.data (), n);
+}
+
+static void test_kernels ()
+{
+  std::cout << "Checking deterministic kernels on every code path"
+            << std::endl;
+  bool dot_ok = true, gemv_ok = true, half_ok = true;
+  for (int k = 0; k <= MAX_LENGTH; ++k)
+  {
+    std::vector<float> a = random_floats ((size_t) GEMV_ROWS * k);
+    std::vector<float> x = random_floats ((size_t) GEMV_VECTORS * k);
+    std::vector<uint16_t> fp16 (a.size ()), bf16 (a.size ());
+    for (size_t i = 0; i < a.size (); ++i)
+    {
+      fp16[i] = kernels::to_fp16 (a[i]);
+      bf16[i] = kernels::to_bf16 (a[i]);
+    }
+    dot_ok = dot_ok && same_on_every_path ([&] (float *out)
+    {
+      *out = kernels::dot (a.data (), x.data (), k);
+    }, 1);
+    gemv_ok = gemv_ok && same_on_every_path ([&] (float *out)
+    {
+      kernels::gemv_many (a.data (), x.data (), out, GEMV_ROWS, k,
+                          GEMV_VECTORS);
+    }, GEMV_ROWS * GEMV_VECTORS);
+    half_ok = half_ok && same_on_every_path ([&] (float *out)
+    {
+      kernels::gemv_many_fp16 (fp16.data (), x.data (), out, GEMV_ROWS, k,
+                               GEMV_VECTORS);
+      kernels::gemv_bf16 (bf16.data (), x.data (),
+                          out + GEMV_ROWS * GEMV_VECTORS, GEMV_ROWS, k);
+    }, GEMV_ROWS * (GEMV_VECTORS + 1));
+  }
+  check (dot_ok, "dot");
+  check (gemv_ok, "gemv_many");
+  check (half_ok, "fp16 / bf16 gemv");
+}
+
+static void test_network (const std::string &base,
+                          const std::vector<sample> &images)
+{
+  std::cout << "Checking network outputs on every code path" << std::endl;
+  std::unique_ptr<MlpNetwork> network = load_model (
+      base + "parameters/mlp.model");
+  std::vector<Matrix> batch;
+  for (const sample &s: images)
+  {
+    batch.push_back (s.image);
+  }
+  InferenceContext context;
+  check (same_on_every_path ([&] (float *out)
+  {
+    std::vector<digit> results (IMAGES_COUNT);
+    network->predict (batch.data (), IMAGES_COUNT, results.data (), context);
+    for (int i = 0; i < IMAGES_COUNT; ++i)
+    {
+      out[2 * i] = (float) results[i].value;
+      out[2 * i + 1] = results[i].probability;
+    }
+  }, 2 * IMAGES_COUNT), "predictions");
+}
+
+/**
+ * Trains a small network and flattens its parameters into out.
+ */
+static void train (const std::vector<sample> &images, int threads,
+                   std::vector<float> &out)
+{
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (small_dims, SEED, weights, biases);
+  trainer_config config;
+  config.batch_size = TRAIN_BATCH;
+  config.epochs = TRAIN_EPOCHS;
+  config.threads = threads;
+  config.deterministic = true;
+  Trainer trainer (weights, biases, config);
+  trainer.train (images);
+  trainer.export_parameters (weights, biases);
+  out.clear ();
+  for (int l = 0; l < MLP_SIZE; ++l)
+  {
+    out.insert (out.end (), weights[l].data (),
+                weights[l].data () + weights[l].get_rows ()
+                                     * weights[l].get_cols ());
+    out.insert (out.end (), biases[l].data (),
+                biases[l].data () + biases[l].get_rows ());
+  }
+}
+
+static void test_training (const std::vector<sample> &images)
+{
+  std::cout << "Checking deterministic training across thread counts"
+            << std::endl;
+  std::vector<float> expected, actual;
+  train (images, 1, expected);
+  for (int threads: {2, 3, TRAINER_SHARDS + 1})
+  {
+    train (images, threads, actual);
+    check (actual.size () == expected.size ()
+           && same_bits (actual.data (), expected.data (), actual.size ()),
+           "training with " + std::to_string (threads) + " threads");
+  }
+  kernels::set_isa_dispatch (false);
+  train (images, 2, actual);
+  kernels::set_isa_dispatch (true);
+  check (same_bits (actual.data (), expected.data (), actual.size ()),
+         "training on the portable kernels");
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  kernels::set_deterministic (true);
+  try
+  {
+    std::vector<sample> images = load_images (base);
+    test_kernels ();
+    test_network (base, images);
+    test_training (images);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All determinism checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,504 @@
+//
+// Differential test: the optimized Matrix kernels against the naive
+// reference implementations in MatrixReference.h.
+//
+// Usage: ./differential_test [ex1 directory]
+// The directory must contain the parameters/ and images/ folders, it
+// defaults to the working directory.
+//
+
+#include "MatrixKernels.h"
+#include "MatrixReference.h"
+#include "MaxPool2D.h"
+#include "MlpIO.h"
+#include "TestUtil.h"
+
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+
+#define SEED 2022
+#define RANDOM_CASES 100
+#define MAX_RANDOM_DIM 70
+#define PROBABILITY_TOL 1e-5f
+#define CONV_CASES 60
+#define HALF_DIM 200
+
+static const int edge_dims[] = {1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 33, 64,
+                                65, 127, 129};
+
+static std::mt19937 rng (SEED);
+
+static std::string shape (const Matrix &m)
+{
+  return std::to_string (m.get_rows ()) + "x" + std::to_string (m.get_cols ());
+}
+
+static Matrix random_matrix (int rows, int cols)
+{
+  std::uniform_real_distribution<float> values (-1.f, 1.f);
+  Matrix m (rows, cols);
+  for (int i = 0; i < rows * cols; ++i)
+  {
+    m[i] = values (rng);
+  }
+  return m;
+}
+
+/**
+ * Distance between two floats in units in the last place.
+ */
+static int64_t ulp_distance (float a, float b)
+{
+  int32_t ia, ib;
+  std::memcpy (&ia, &a, sizeof (float));
+  std::memcpy (&ib, &b, sizeof (float));
+  // map the sign-magnitude representation onto a monotonic integer line
+  int64_t la = ia < 0 ? (int64_t) INT32_MIN - ia : ia;
+  int64_t lb = ib < 0 ? (int64_t) INT32_MIN - ib : ib;
+  return la > lb ? la - lb : lb - la;
+}
+
+/**
+ * Reordering a float reduction of n terms moves the result by at most about
+ * n * epsilon * (sum of the absolute terms) in either direction.
+ */
+static bool within_reduction_error (float expected, float actual, int n,
+                                    float magnitude)
+{
+  return std::abs (expected - actual)
+         <= 2.f * (float) n * FLT_EPSILON * magnitude + FLT_MIN;
+}
+
+static bool bit_identical (const Matrix &expected, const Matrix &actual)
+{
+  if (expected.get_rows () != actual.get_rows ()
+      || expected.get_cols () != actual.get_cols ())
+  {
+    return false;
+  }
+  for (int i = 0; i < expected.get_rows () * expected.get_cols (); ++i)
+  {
+    if (ulp_distance (expected[i], actual[i]) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void check_elementwise (const Matrix &a, const Matrix &b)
+{
+  Matrix a_copy (a);
+  Matrix b_copy (b);
+  check (bit_identical (reference::add (a, b), a + b), "add " + shape (a));
+  check (bit_identical (reference::dot (a, b), a_copy.dot (b_copy)),
+         "dot " + shape (a));
+  check (bit_identical (reference::scale (a, 0.37f), a * 0.37f),
+         "scale " + shape (a));
+  check (bit_identical (reference::relu (a), activation::relu (a)),
+         "relu " + shape (a));
+}
+
+static void check_reductions (const Matrix &a)
+{
+  int n = a.get_rows () * a.get_cols ();
+  float magnitude = 0, squares = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    magnitude += std::abs (a[i]);
+    squares += a[i] * a[i];
+  }
+  check (within_reduction_error (reference::sum (a), a.sum (), n, magnitude),
+         "sum " + shape (a));
+  float ref_norm = reference::norm (a), norm = a.norm ();
+  check (within_reduction_error (ref_norm * ref_norm, norm * norm, n, squares),
+         "norm " + shape (a));
+
+  Matrix ref_softmax = reference::softmax (a);
+  Matrix softmax = activation::softmax (a);
+  bool ok = true;
+  for (int i = 0; i < n; ++i)
+  {
+    // the only difference is the order of the normalizer sum
+    ok = ok && within_reduction_error (ref_softmax[i], softmax[i], n,
+                                       ref_softmax[i]);
+  }
+  check (ok, "softmax " + shape (a));
+}
+
+static void check_multiply (const Matrix &a, const Matrix &b)
+{
+  Matrix expected = reference::multiply (a, b);
+  Matrix actual = a * b;
+  bool ok = expected.get_rows () == actual.get_rows ()
+            && expected.get_cols () == actual.get_cols ();
+  for (int i = 0; ok && i < a.get_rows (); ++i)
+  {
+    for (int j = 0; ok && j < b.get_cols (); ++j)
+    {
+      float magnitude = 0;
+      for (int k = 0; k < a.get_cols (); ++k)
+      {
+        magnitude += std::abs (a (i, k) * b (k, j));
+      }
+      ok = within_reduction_error (expected (i, j), actual (i, j),
+                                   a.get_cols (), magnitude);
+    }
+  }
+  check (ok, "multiply " + shape (a) + " * " + shape (b));
+}
+
+static void check_shape (int m, int k, int n)
+{
+  Matrix a = random_matrix (m, k);
+  Matrix b = random_matrix (k, n);
+  check_multiply (a, b);
+  check_elementwise (a, random_matrix (m, k));
+  check_reductions (a);
+}
+
+static void test_kernels ()
+{
+  std::cout << "Checking kernels on edge shapes" << std::endl;
+  for (int m : edge_dims)
+  {
+    for (int k : edge_dims)
+    {
+      check_shape (m, k, 1);
+      check_shape (1, k, m);
+      check_shape (m, k, 3);
+    }
+  }
+
+  std::cout << "Checking kernels on " << RANDOM_CASES << " random shapes"
+            << std::endl;
+  std::uniform_int_distribution<int> dim (1, MAX_RANDOM_DIM);
+  for (int i = 0; i < RANDOM_CASES; ++i)
+  {
+    check_shape (dim (rng), dim (rng), dim (rng));
+  }
+
+  // the same layer shapes the network runs
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    check_shape (weights_dims[i].rows, weights_dims[i].cols, 1);
+  }
+}
+
+static void check_conv (const image_shape &shape, int kernel,
+                        int out_channels)
+{
+  Matrix input = random_matrix (shape.channels * shape.height, shape.width);
+  Matrix weights = random_matrix (out_channels,
+                                  shape.channels * kernel * kernel);
+  Matrix bias = random_matrix (out_channels, 1);
+  std::string what = "conv2d " + std::to_string (shape.channels) + "x"
+                     + std::to_string (shape.height) + "x"
+                     + std::to_string (shape.width) + " k"
+                     + std::to_string (kernel);
+
+  Matrix expected = reference::relu (
+      reference::conv2d (input, shape, kernel, weights, bias));
+  std::vector<conv_algorithm> algorithms = {CONV_AUTO, CONV_IM2COL};
+  if (kernel == DIRECT_KERNEL_SIZE)
+  {
+    algorithms.push_back (CONV_DIRECT);
+  }
+  for (conv_algorithm algorithm: algorithms)
+  {
+    Conv2D conv (shape, kernel, weights, bias, activation::relu, algorithm);
+    Matrix actual = conv (input);
+    bool ok = actual.get_rows () == expected.get_rows ()
+              && actual.get_cols () == 1;
+    int taps = shape.channels * kernel * kernel;
+    for (int i = 0; ok && i < expected.get_rows (); ++i)
+    {
+      // inputs and weights are in [-1, 1], so taps + 1 bounds the magnitude
+      ok = within_reduction_error (expected[i], actual[i], taps + 1,
+                                   (float) taps + 1);
+    }
+    check (ok, what + " algorithm " + std::to_string (algorithm));
+  }
+
+  int pool = 1 + (int) (rng () % std::min (shape.height, shape.width));
+  MaxPool2D max_pool (shape, pool);
+  check (bit_identical (reference::max_pool (input, shape, pool),
+                        max_pool (input)),
+         "max pool " + std::to_string (pool) + " of " + what);
+}
+
+static void test_conv ()
+{
+  std::cout << "Checking Conv2D and MaxPool2D on " << CONV_CASES
+            << " random shapes" << std::endl;
+  std::uniform_int_distribution<int> channels (1, 4);
+  std::uniform_int_distribution<int> kernel (1, 5);
+  std::uniform_int_distribution<int> extra (0, 20);
+  for (int i = 0; i < CONV_CASES; ++i)
+  {
+    int k = i % 3 == 0 ? DIRECT_KERNEL_SIZE : kernel (rng);
+    image_shape shape{channels (rng), k + extra (rng), k + extra (rng)};
+    check_conv (shape, k, channels (rng));
+  }
+  check_conv (image_shape{1, img_dims.rows, img_dims.cols},
+              DIRECT_KERNEL_SIZE, 8);
+}
+
+static void check_conversions ()
+{
+  // ties round to the even neighbour, just past a tie rounds up
+  check (kernels::to_fp16 (1.f + std::ldexp (1.f, -11)) == 0x3c00,
+         "fp16 tie to even");
+  check (kernels::to_fp16 (1.f + 3 * std::ldexp (1.f, -11)) == 0x3c02,
+         "fp16 tie to odd neighbour");
+  check (kernels::to_fp16 (65504.f) == 0x7bff, "fp16 largest finite");
+  check (kernels::to_fp16 (65520.f) == 0x7c00, "fp16 overflow");
+  check (kernels::to_fp16 (std::ldexp (1.f, -25)) == 0, "fp16 subnormal tie");
+  check (kernels::to_fp16 (std::ldexp (3.f, -26)) == 1, "fp16 subnormal");
+  check (kernels::to_fp16 (-2.f) == 0xc000, "fp16 sign");
+  check (kernels::to_bf16 (1.f + std::ldexp (1.f, -8)) == 0x3f80,
+         "bf16 tie to even");
+  check (kernels::to_bf16 (1.f + 3 * std::ldexp (1.f, -8)) == 0x3f82,
+         "bf16 tie to odd neighbour");
+  for (uint32_t h = 0; h < 0x7c00; ++h)
+  {
+    if (kernels::to_fp16 (kernels::from_fp16 ((uint16_t) h)) != h
+        || kernels::to_bf16 (kernels::from_bf16 ((uint16_t) h)) != h)
+    {
+      check (false, "half round trip of " + std::to_string (h));
+      return;
+    }
+  }
+}
+
+/**
+ * The half precision gemv against the float gemm on the widened weights,
+ * the only difference is the order of the sums.
+ */
+static void check_half_gemv (int m, int k)
+{
+  Matrix a = random_matrix (m, k);
+  Matrix x = random_matrix (k, 1);
+  for (weight_precision precision: {FP16, BF16})
+  {
+    std::vector<uint16_t> half (m * k);
+    Matrix widened (m, k);
+    for (int i = 0; i < m * k; ++i)
+    {
+      half[i] = precision == FP16 ? kernels::to_fp16 (a[i])
+                                  : kernels::to_bf16 (a[i]);
+      widened[i] = precision == FP16 ? kernels::from_fp16 (half[i])
+                                     : kernels::from_bf16 (half[i]);
+    }
+    Matrix expected = reference::multiply (widened, x);
+    std::vector<float> y (m);
+    if (precision == FP16)
+    {
+      kernels::gemv_fp16 (half.data (), x.data (), y.data (), m, k);
+    }
+    else
+    {
+      kernels::gemv_bf16 (half.data (), x.data (), y.data (), m, k);
+    }
+    bool ok = true;
+    for (int i = 0; i < m; ++i)
+    {
+      float magnitude = 0;
+      for (int p = 0; p < k; ++p)
+      {
+        magnitude += std::abs (widened (i, p) * x[p]);
+      }
+      ok = ok && within_reduction_error (expected[i], y[i], k, magnitude);
+    }
+    check (ok, std::string (precision == FP16 ? "fp16" : "bf16")
+               + " gemv " + std::to_string (m) + "x" + std::to_string (k));
+  }
+}
+
+static void test_half ()
+{
+  std::cout << "Checking half precision conversions and gemv" << std::endl;
+  check_conversions ();
+  for (int k : edge_dims)
+  {
+    check_half_gemv (3, k);
+  }
+  std::uniform_int_distribution<int> dim (1, HALF_DIM);
+  for (int i = 0; i < RANDOM_CASES; ++i)
+  {
+    check_half_gemv (dim (rng), dim (rng));
+  }
+}
+
+/**
+ * Runs the images through FP16 and BF16 copies of the network and reports
+ * how far they are from FP32. Half precision must not change a prediction
+ * on the sample images.
+ */
+static void report_half_accuracy (Matrix weights[MLP_SIZE],
+                                  Matrix biases[MLP_SIZE],
+                                  const std::vector<Matrix> &images)
+{
+  MlpNetwork fp32 (weights, biases);
+  for (weight_precision precision: {FP16, BF16})
+  {
+    MlpNetwork half (weights, biases, precision);
+    std::string name = precision == FP16 ? "fp16" : "bf16";
+    int agree = 0;
+    float max_error = 0;
+    for (const Matrix &img: images)
+    {
+      digit expected = fp32 (img), actual = half (img);
+      agree += expected.value == actual.value;
+      max_error = std::max (max_error, std::abs (expected.probability
+                                                 - actual.probability));
+    }
+    std::cout << "  " << name << " weights: " << agree << "/"
+              << images.size () << " predictions match fp32, max probability"
+              << " error " << max_error << std::endl;
+    check (agree == (int) images.size (), name + " changed a prediction");
+  }
+}
+
+static bool same_digit (const digit &a, const digit &b)
+{
+  return a.value == b.value && ulp_distance (a.probability, b.probability) == 0;
+}
+
+/**
+ * Inference through an InferenceContext against operator()(matrix), on the
+ * MLP and on small conv networks. One context serves every network and
+ * grows as needed.
+ */
+static void check_contexts (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE],
+                            const std::vector<Matrix> &images)
+{
+  InferenceContext context;
+  std::vector<std::unique_ptr<MlpNetwork>> networks;
+  networks.emplace_back (new MlpNetwork (weights, biases));
+  networks.emplace_back (new MlpNetwork (weights, biases, FP16));
+  image_shape shape{1, img_dims.rows, img_dims.cols};
+  for (conv_algorithm algorithm: {CONV_IM2COL, CONV_DIRECT})
+  {
+    Matrix kernels = random_matrix (4, DIRECT_KERNEL_SIZE * DIRECT_KERNEL_SIZE);
+    Matrix conv_bias = random_matrix (4, 1);
+    Conv2D *conv = new Conv2D (shape, DIRECT_KERNEL_SIZE, kernels, conv_bias,
+                               activation::relu, algorithm);
+    MaxPool2D *pool = new MaxPool2D (conv->get_output_shape (), 2);
+    Matrix dense_w = random_matrix (10, pool->output_size ());
+    Matrix dense_b = random_matrix (10, 1);
+    Layer **layers = new Layer *[3]{conv, pool,
+                                    new Dense (dense_w, dense_b,
+                                               activation::softmax)};
+    networks.emplace_back (new MlpNetwork (layers, 3));
+  }
+
+  // more images than one fused tile, so the batch paths see a partial tile
+  std::vector<Matrix> batch;
+  for (int i = 0; i < 2 * networks[0]->tile_size () + 3; ++i)
+  {
+    batch.push_back (i < (int) images.size ()
+                     ? images[i] : random_matrix (img_dims.rows,
+                                                  img_dims.cols));
+  }
+  std::vector<digit> results (batch.size ());
+  for (size_t n = 0; n < networks.size (); ++n)
+  {
+    bool ok = true;
+    for (const Matrix &img: images)
+    {
+      ok = ok && same_digit ((*networks[n]) (img),
+                             (*networks[n]) (img, context));
+    }
+    check (ok, "inference context on network " + std::to_string (n));
+
+    for (batch_mode mode: {BATCH_FUSED, BATCH_LAYERWISE})
+    {
+      networks[n]->predict (batch.data (), (int) batch.size (),
+                            results.data (), context, mode);
+      ok = true;
+      for (size_t i = 0; i < batch.size (); ++i)
+      {
+        ok = ok && same_digit ((*networks[n]) (batch[i]), results[i]);
+      }
+      check (ok, "batch mode " + std::to_string (mode) + " on network "
+                 + std::to_string (n));
+    }
+  }
+
+  // more images than one layerwise slice, the last slice partial
+  std::vector<Matrix> slices (LAYERWISE_SLICE + 3, images[0]);
+  for (size_t i = 0; i < slices.size (); i += 97)
+  {
+    slices[i] = random_matrix (img_dims.rows, img_dims.cols);
+  }
+  std::vector<digit> fused (slices.size ()), layerwise (slices.size ());
+  networks[0]->predict (slices.data (), (int) slices.size (), fused.data (),
+                        context, BATCH_FUSED);
+  networks[0]->predict (slices.data (), (int) slices.size (),
+                        layerwise.data (), context, BATCH_LAYERWISE);
+  bool ok = true;
+  for (size_t i = 0; i < slices.size (); ++i)
+  {
+    ok = ok && same_digit (fused[i], layerwise[i]);
+  }
+  check (ok, "layerwise slices");
+}
+
+static void test_images (const std::string &base)
+{
+  std::cout << "Checking predictions on " << IMAGES_COUNT << " images"
+            << std::endl;
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  load_parameters (base + "parameters", weights, biases);
+  MlpNetwork mlp (weights, biases);
+  std::unique_ptr<MlpNetwork> model = load_model (base
+                                                  + "parameters/mlp.model");
+  std::vector<Matrix> images = load_image_matrices (base);
+  for (int i = 0; i < IMAGES_COUNT; ++i)
+  {
+    const Matrix &img = images[i];
+    std::string name = "im" + std::to_string (i);
+    digit expected = reference::predict (weights, biases, img);
+    digit actual = mlp (img);
+    check (expected.value == actual.value, "predicted digit of " + name);
+    check (std::abs (expected.probability - actual.probability)
+           <= PROBABILITY_TOL, "probability of " + name);
+    digit loaded = (*model) (img);
+    check (loaded.value == actual.value
+           && loaded.probability == actual.probability,
+           "model file prediction of " + name);
+  }
+  report_half_accuracy (weights, biases, images);
+  check_contexts (weights, biases, images);
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  try
+  {
+    test_kernels ();
+    test_conv ();
+    test_half ();
+    test_images (base);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All differential checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
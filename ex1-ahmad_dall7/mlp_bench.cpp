@@ -0,0 +1,775 @@
+//
+// Micro benchmarks for the ex1 network.
+//
+// Usage: ./mlp_bench [benchmark ...]
+// Runs every benchmark when none is named. Build with
+// -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+//
+
+#include "Cascade.h"
+#include "InferenceCache.h"
+#include "MatrixKernels.h"
+#include "MatrixReference.h"
+#include "MaxPool2D.h"
+#include "ModelHandle.h"
+#include "Trainer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_SEED 7
+#define INFERENCE_ITERATIONS 2000
+#define TRAIN_SAMPLES 2048
+#define TRAIN_BATCH 64
+#define CONV_CHANNELS 8
+#define CONV_POOL 2
+#define BATCH_IMAGES 4096
+#define CASCADE_SAMPLES 2000
+#define CASCADE_HARD_PERCENT 20
+#define CASCADE_EPOCHS 3
+#define CACHE_LOOKUPS 20000
+#define CACHE_CAPACITY 4096
+#define PAGES_ROWS 4096
+#define PAGES_COLS 4096
+#define PAGES_GATHERS 4000000
+#define PAGES_GEMVS 20
+#define SWAP_READERS 2
+#define SWAP_PHASE_MS 500
+#define SWAP_INTERVAL_MS 5
+
+typedef std::chrono::steady_clock bench_clock;
+
+// results are stored here so the timed calls can not be optimized away
+static volatile unsigned int sink;
+
+static double seconds_since (bench_clock::time_point start)
+{
+  return std::chrono::duration<double> (bench_clock::now () - start).count ();
+}
+
+static Matrix random_image (std::mt19937 &rng)
+{
+  std::uniform_real_distribution<float> pixels (0.f, 1.f);
+  Matrix img (img_dims.rows, img_dims.cols);
+  for (int i = 0; i < img_dims.rows * img_dims.cols; ++i)
+  {
+    img[i] = pixels (rng);
+  }
+  return img;
+}
+
+static void random_network (Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE])
+{
+  Trainer::random_parameters (weights_dims, BENCH_SEED, weights, biases);
+}
+
+/**
+ * Single image latency of the reference loops against MlpNetwork.
+ */
+static void bench_inference ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  random_network (weights, biases);
+  MlpNetwork mlp (weights, biases);
+  Matrix img = random_image (rng);
+
+  auto start = bench_clock::now ();
+  for (int i = 0; i < INFERENCE_ITERATIONS / 10; ++i)
+  {
+    sink = reference::predict (weights, biases, img).value;
+  }
+  double ref_us = seconds_since (start) * 1e6 / (INFERENCE_ITERATIONS / 10);
+
+  start = bench_clock::now ();
+  for (int i = 0; i < INFERENCE_ITERATIONS; ++i)
+  {
+    sink = mlp (img).value;
+  }
+  double mlp_us = seconds_since (start) * 1e6 / INFERENCE_ITERATIONS;
+
+  std::cout << "inference: reference " << ref_us << " us/image, MlpNetwork "
+            << mlp_us << " us/image (" << ref_us / mlp_us << "x)" << std::endl;
+}
+
+static Matrix random_matrix (std::mt19937 &rng, int rows, int cols)
+{
+  std::normal_distribution<float> values (0.f, 0.1f);
+  Matrix m (rows, cols);
+  for (int i = 0; i < rows * cols; ++i)
+  {
+    m[i] = values (rng);
+  }
+  return m;
+}
+
+template<typename F>
+static double us_per_call (F &&f, int iterations)
+{
+  auto start = bench_clock::now ();
+  for (int i = 0; i < iterations; ++i)
+  {
+    f ();
+  }
+  return seconds_since (start) * 1e6 / iterations;
+}
+
+/**
+ * Conv2D algorithms on the digit image, and a small conv network
+ * (conv 3x3 x8 -> max pool 2 -> dense 10) against the dense MLP.
+ */
+static void bench_conv ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  image_shape shape{1, img_dims.rows, img_dims.cols};
+  Matrix kernels = random_matrix (rng, CONV_CHANNELS, DIRECT_KERNEL_SIZE
+                                                      * DIRECT_KERNEL_SIZE);
+  Matrix conv_bias = random_matrix (rng, CONV_CHANNELS, 1);
+  Matrix img = random_image (rng);
+
+  for (conv_algorithm algorithm: {CONV_IM2COL, CONV_DIRECT})
+  {
+    Conv2D conv (shape, DIRECT_KERNEL_SIZE, kernels, conv_bias,
+                 activation::relu, algorithm);
+    double us = us_per_call ([&] ()
+                             { sink = (unsigned int) conv (img).get_rows (); },
+                             INFERENCE_ITERATIONS);
+    std::cout << "conv: " << (algorithm == CONV_DIRECT ? "direct 3x3 "
+                                                       : "im2col+gemm ")
+              << us << " us/image" << std::endl;
+  }
+
+  Conv2D *conv = new Conv2D (shape, DIRECT_KERNEL_SIZE, kernels, conv_bias,
+                             activation::relu);
+  MaxPool2D *pool = new MaxPool2D (conv->get_output_shape (), CONV_POOL);
+  Matrix dense_w = random_matrix (rng, 10, pool->output_size ());
+  Matrix dense_b = random_matrix (rng, 10, 1);
+  Layer **layers = new Layer *[3]{conv, pool, new Dense (dense_w, dense_b,
+                                                         activation::softmax)};
+  MlpNetwork conv_net (layers, 3);
+
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  random_network (weights, biases);
+  MlpNetwork mlp (weights, biases);
+
+  double conv_us = us_per_call ([&] () { sink = conv_net (img).value; },
+                                INFERENCE_ITERATIONS);
+  double mlp_us = us_per_call ([&] () { sink = mlp (img).value; },
+                               INFERENCE_ITERATIONS);
+  std::cout << "conv: conv network " << conv_us << " us/image, MLP "
+            << mlp_us << " us/image" << std::endl;
+}
+
+static std::unique_ptr<MlpNetwork> random_mlp (unsigned int seed)
+{
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (weights_dims, seed, weights, biases);
+  return std::unique_ptr<MlpNetwork> (new MlpNetwork (weights, biases));
+}
+
+/**
+ * Reader latency through a ModelHandle for SWAP_PHASE_MS without swaps and
+ * then for SWAP_PHASE_MS with a new network published every
+ * SWAP_INTERVAL_MS.
+ */
+static void bench_swap ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  Matrix img = random_image (rng);
+  ModelHandle handle (random_mlp (BENCH_SEED));
+
+  for (bool swapping: {false, true})
+  {
+    std::atomic<bool> done (false);
+    std::vector<std::vector<double>> latencies (SWAP_READERS);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < SWAP_READERS; ++r)
+    {
+      readers.emplace_back ([&, r] ()
+      {
+        while (!done.load ())
+        {
+          auto start = bench_clock::now ();
+          sink = handle (img).value;
+          latencies[r].push_back (seconds_since (start) * 1e6);
+        }
+      });
+    }
+
+    auto phase_start = bench_clock::now ();
+    int swaps = 0;
+    while (seconds_since (phase_start) * 1e3 < SWAP_PHASE_MS)
+    {
+      if (swapping)
+      {
+        // the network is built outside the handle, as reload() does
+        handle.publish (random_mlp (BENCH_SEED + ++swaps));
+      }
+      std::this_thread::sleep_for (std::chrono::milliseconds
+                                       (SWAP_INTERVAL_MS));
+    }
+    done.store (true);
+    for (std::thread &reader: readers)
+    {
+      reader.join ();
+    }
+
+    std::vector<double> all;
+    for (const auto &l: latencies)
+    {
+      all.insert (all.end (), l.begin (), l.end ());
+    }
+    std::sort (all.begin (), all.end ());
+    std::cout << "swap: " << (swapping ? std::to_string (swaps) + " swaps, "
+                                       : std::string ("no swaps, "))
+              << all.size () << " inferences, p50 " << all[all.size () / 2]
+              << " us, p99 " << all[all.size () * 99 / 100] << " us, max "
+              << all.back () << " us" << std::endl;
+  }
+}
+
+/**
+ * MLP latency with fp32, fp16 and bf16 weights.
+ */
+static void bench_half ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  random_network (weights, biases);
+  Matrix img = random_image (rng);
+  for (weight_precision precision: {FP32, FP16, BF16})
+  {
+    MlpNetwork mlp (weights, biases, precision);
+    double us = us_per_call ([&] () { sink = mlp (img).value; },
+                             INFERENCE_ITERATIONS);
+    std::cout << "half: " << (precision == FP32 ? "fp32"
+                              : precision == FP16 ? "fp16" : "bf16")
+              << " weights " << us << " us/image" << std::endl;
+  }
+}
+
+/**
+ * Inference throughput of 1..hardware_concurrency threads sharing one
+ * network, allocating per call against per-thread InferenceContexts.
+ */
+static void bench_context ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  Matrix img = random_image (rng);
+  std::unique_ptr<MlpNetwork> mlp = random_mlp (BENCH_SEED);
+  int max_threads = std::max (1u, std::thread::hardware_concurrency ());
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    for (bool with_context: {false, true})
+    {
+      auto start = bench_clock::now ();
+      std::vector<std::thread> workers;
+      for (int t = 0; t < threads; ++t)
+      {
+        workers.emplace_back ([&] ()
+        {
+          InferenceContext context (*mlp);
+          for (int i = 0; i < INFERENCE_ITERATIONS; ++i)
+          {
+            sink = with_context ? (*mlp) (img, context).value
+                                : (*mlp) (img).value;
+          }
+        });
+      }
+      for (std::thread &worker: workers)
+      {
+        worker.join ();
+      }
+      double seconds = seconds_since (start);
+      std::cout << "context: " << threads << " threads, "
+                << (with_context ? "InferenceContext " : "allocating ")
+                << threads * INFERENCE_ITERATIONS / seconds << " images/sec"
+                << std::endl;
+    }
+  }
+}
+
+/**
+ * Batched MLP inference: one image at a time, layer at a time over the
+ * whole batch, and fused tiles.
+ */
+static void bench_batch ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  std::unique_ptr<MlpNetwork> mlp = random_mlp (BENCH_SEED);
+  std::vector<Matrix> images;
+  for (int i = 0; i < BATCH_IMAGES; ++i)
+  {
+    images.push_back (random_image (rng));
+  }
+  std::vector<digit> results (BATCH_IMAGES);
+  InferenceContext context;
+
+  auto start = bench_clock::now ();
+  for (int i = 0; i < BATCH_IMAGES; ++i)
+  {
+    results[i] = (*mlp) (images[i], context);
+  }
+  std::cout << "batch: single images " << BATCH_IMAGES / seconds_since (start)
+            << " images/sec" << std::endl;
+  for (batch_mode mode: {BATCH_LAYERWISE, BATCH_FUSED})
+  {
+    // the first pass sizes the context
+    mlp->predict (images.data (), BATCH_IMAGES, results.data (), context,
+                  mode);
+    start = bench_clock::now ();
+    mlp->predict (images.data (), BATCH_IMAGES, results.data (), context,
+                  mode);
+    std::cout << "batch: " << (mode == BATCH_FUSED
+                               ? "fused tiles of "
+                                 + std::to_string (mlp->tile_size ()) + " "
+                               : std::string ("layer at a time "))
+              << BATCH_IMAGES / seconds_since (start) << " images/sec"
+              << std::endl;
+  }
+  sink = results[0].value;
+}
+
+/**
+ * Synthetic digits: noisy copies of ten random prototypes, most with
+ * little noise and CASCADE_HARD_PERCENT with a lot.
+ */
+static std::vector<sample> prototype_samples (std::mt19937 &rng, int count)
+{
+  std::vector<Matrix> prototypes;
+  for (int d = 0; d < 10; ++d)
+  {
+    prototypes.push_back (random_image (rng));
+  }
+  std::normal_distribution<float> easy (0.f, 0.1f), hard (0.f, 0.8f);
+  std::vector<sample> samples;
+  for (int i = 0; i < count; ++i)
+  {
+    unsigned int label = (unsigned int) (rng () % 10);
+    bool is_hard = (int) (rng () % 100) < CASCADE_HARD_PERCENT;
+    Matrix img (prototypes[label]);
+    for (int p = 0; p < img_dims.rows * img_dims.cols; ++p)
+    {
+      img[p] += is_hard ? hard (rng) : easy (rng);
+    }
+    samples.push_back (sample{img, label});
+  }
+  return samples;
+}
+
+static std::unique_ptr<MlpNetwork> trained_mlp (
+    const Matrix::dims dims[MLP_SIZE], const std::vector<sample> &data)
+{
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (dims, BENCH_SEED, weights, biases);
+  trainer_config config;
+  config.epochs = CASCADE_EPOCHS;
+  Trainer trainer (weights, biases, config);
+  trainer.train (data);
+  trainer.export_parameters (weights, biases);
+  return std::unique_ptr<MlpNetwork> (new MlpNetwork (weights, biases));
+}
+
+/**
+ * A 16-12-10 network in front of the full MLP, both trained on the same
+ * synthetic digits, for a few thresholds.
+ */
+static void bench_cascade ()
+{
+  static const Matrix::dims small_dims[MLP_SIZE] = {{16, 784}, {12, 16},
+                                                    {10, 12}, {10, 10}};
+  std::mt19937 rng (BENCH_SEED);
+  std::vector<sample> data = prototype_samples (rng, 2 * CASCADE_SAMPLES);
+  std::vector<sample> train (data.begin (), data.begin () + CASCADE_SAMPLES);
+  std::vector<sample> test (data.begin () + CASCADE_SAMPLES, data.end ());
+  InferenceContext context;
+
+  for (float threshold: {0.f, 0.5f, 0.9f, 0.99f, 1.f})
+  {
+    Cascade cascade;
+    if (threshold > 0.f)
+    {
+      cascade.add_stage (trained_mlp (small_dims, train), threshold);
+    }
+    if (threshold < 1.f)
+    {
+      cascade.add_stage (trained_mlp (weights_dims, train), 0.f);
+    }
+    int correct = 0;
+    for (const sample &s: test)
+    {
+      correct += cascade (s.image, context).value == s.label;
+    }
+    std::cout << "cascade: ";
+    if (threshold == 0.f || threshold == 1.f)
+    {
+      std::cout << (threshold == 0.f ? "full MLP only" : "small network only");
+    }
+    else
+    {
+      std::cout << "threshold " << threshold;
+    }
+    std::cout << ", accuracy " << (double) correct / test.size () << ", "
+              << cascade.average_us () << " us/image";
+    std::vector<stage_stats> stats = cascade.get_stats ();
+    for (size_t i = 0; i + 1 < stats.size (); ++i)
+    {
+      std::cout << ", stage " << i + 1 << " hit rate " << stats[i].hit_rate
+                << " (" << stats[i].average_us << " us)";
+    }
+    std::cout << std::endl;
+  }
+}
+
+/**
+ * Inference through an InferenceCache on streams where a given share of
+ * the images repeats an earlier one, against the network alone.
+ */
+static void bench_cache ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  std::unique_ptr<MlpNetwork> mlp = random_mlp (BENCH_SEED);
+  InferenceContext context (*mlp);
+  for (int duplicate_percent: {0, 50, 90, 99})
+  {
+    // repeats are drawn from the last CACHE_CAPACITY distinct images
+    std::vector<Matrix> distinct;
+    std::vector<int> stream;
+    std::uniform_int_distribution<int> percent (0, 99);
+    for (int i = 0; i < CACHE_LOOKUPS; ++i)
+    {
+      if (distinct.empty () || percent (rng) >= duplicate_percent)
+      {
+        distinct.push_back (random_image (rng));
+        stream.push_back ((int) distinct.size () - 1);
+        continue;
+      }
+      int window = std::min ((int) distinct.size (), CACHE_CAPACITY);
+      std::uniform_int_distribution<int> recent (1, window);
+      stream.push_back ((int) distinct.size () - recent (rng));
+    }
+
+    InferenceCache cache (CACHE_CAPACITY);
+    auto start = bench_clock::now ();
+    for (int i: stream)
+    {
+      sink = (*mlp) (distinct[i], context).value;
+    }
+    double direct = seconds_since (start);
+    start = bench_clock::now ();
+    for (int i: stream)
+    {
+      sink = cache (*mlp, distinct[i], context).value;
+    }
+    double cached = seconds_since (start);
+    std::cout << "cache: " << duplicate_percent << "% duplicates, network "
+              << CACHE_LOOKUPS / direct << " images/sec, cached "
+              << CACHE_LOOKUPS / cached << " images/sec, hit rate "
+              << cache.get_stats ().hit_rate << std::endl;
+  }
+}
+
+/**
+ * Data TLB read misses of this thread, where the kernel exposes the
+ * hardware counter (not in most VMs).
+ */
+class tlb_counter
+{
+ public:
+  tlb_counter ()
+  {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset (&attr, 0, sizeof (attr));
+    attr.size = sizeof (attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+                  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    _fd = (int) syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+
+  ~tlb_counter ()
+  {
+#ifdef __linux__
+    if (_fd >= 0)
+    {
+      close (_fd);
+    }
+#endif
+  }
+
+  bool available () const
+  {
+    return _fd >= 0;
+  }
+
+  void start ()
+  {
+#ifdef __linux__
+    if (_fd >= 0)
+    {
+      ioctl (_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl (_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  long stop ()
+  {
+    long long misses = 0;
+#ifdef __linux__
+    if (_fd >= 0)
+    {
+      ioctl (_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read (_fd, &misses, sizeof (misses)) != sizeof (misses))
+      {
+        misses = 0;
+      }
+    }
+#endif
+    return (long) misses;
+  }
+
+ private:
+  int _fd = -1;
+};
+
+/**
+ * @return kB of this process' anonymous memory on transparent huge pages,
+ *         0 where the kernel does not report it
+ */
+static long anon_huge_kb ()
+{
+  std::ifstream smaps ("/proc/self/smaps_rollup");
+  std::string key;
+  long kb = 0;
+  while (smaps >> key)
+  {
+    if (key == "AnonHugePages:")
+    {
+      smaps >> kb;
+      break;
+    }
+  }
+  return kb;
+}
+
+/**
+ * A 64MB weight matrix on normal pages, transparent huge pages and
+ * hugetlbfs pages: gemv over all of it, and random element reads that
+ * touch a new page almost every time.
+ */
+static void bench_pages ()
+{
+  static const std::pair<allocation::page_policy, const char *> policies[] = {
+      {allocation::NORMAL_PAGES, "normal pages"},
+      {allocation::TRANSPARENT_HUGE_PAGES, "transparent huge pages"},
+      {allocation::HUGETLB_PAGES, "hugetlbfs pages"}};
+  allocation::page_policy previous = allocation::get_policy ();
+  tlb_counter tlb;
+  std::vector<float> x (PAGES_COLS, 1.f), y (PAGES_ROWS);
+  for (const auto &policy: policies)
+  {
+    allocation::set_policy (policy.first);
+    allocation::allocation_stats before = allocation::get_stats ();
+    long huge_before = anon_huge_kb ();
+    Matrix weights (PAGES_ROWS, PAGES_COLS);
+    long huge_kb = anon_huge_kb () - huge_before;
+    allocation::allocation_stats after = allocation::get_stats ();
+    const char *backing = after.hugetlb > before.hugetlb ? "hugetlbfs"
+                          : after.transparent_huge > before.transparent_huge
+                            ? "madvised" : "plain";
+
+    tlb.start ();
+    double gemv_us = us_per_call ([&] ()
+                                  {
+                                      kernels::gemv (weights.data (), x.data (),
+                                                     y.data (), PAGES_ROWS,
+                                                     PAGES_COLS);
+                                  }, PAGES_GEMVS);
+    long gemv_misses = tlb.stop () / PAGES_GEMVS;
+
+    std::mt19937 rng (BENCH_SEED);
+    std::uniform_int_distribution<long> index (0, (long) PAGES_ROWS
+                                                  * PAGES_COLS - 1);
+    std::vector<long> indices (PAGES_GATHERS);
+    for (long &i: indices)
+    {
+      i = index (rng);
+    }
+    const float *data = weights.data ();
+    float total = 0.f;
+    tlb.start ();
+    auto start = bench_clock::now ();
+    for (long i: indices)
+    {
+      total += data[i];
+    }
+    double gather_ns = seconds_since (start) * 1e9 / PAGES_GATHERS;
+    long gather_misses = tlb.stop ();
+    sink = (unsigned int) total;
+
+    std::cout << "pages: " << policy.second << " (" << backing << ", "
+              << huge_kb / 1024 << "MB on huge pages), gemv " << gemv_us
+              << " us, random read " << gather_ns << " ns";
+    if (tlb.available ())
+    {
+      std::cout << ", dTLB misses " << gemv_misses << " per gemv, "
+                << (double) gather_misses / PAGES_GATHERS << " per read";
+    }
+    else
+    {
+      std::cout << ", dTLB counter unavailable";
+    }
+    std::cout << std::endl;
+  }
+  allocation::set_policy (previous);
+}
+
+/**
+ * Cost of deterministic mode: inference with and without it on the AVX2
+ * and the portable kernels, and training with fixed shards against one
+ * shard per thread.
+ */
+static void bench_deterministic ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  Matrix img = random_image (rng);
+  std::unique_ptr<MlpNetwork> mlp = random_mlp (BENCH_SEED);
+  InferenceContext context (*mlp);
+  for (bool dispatch: {true, false})
+  {
+    for (bool deterministic: {false, true})
+    {
+      kernels::set_isa_dispatch (dispatch);
+      kernels::set_deterministic (deterministic);
+      double us = us_per_call ([&] ()
+                               {
+                                   sink = (*mlp) (img, context).value;
+                               }, INFERENCE_ITERATIONS);
+      std::cout << "deterministic: inference, "
+                << (dispatch ? "ISA dispatch, " : "portable kernels, ")
+                << (deterministic ? "deterministic " : "fastest ") << us
+                << " us/image" << std::endl;
+    }
+  }
+  kernels::set_isa_dispatch (true);
+
+  std::vector<sample> data;
+  for (int i = 0; i < TRAIN_SAMPLES; ++i)
+  {
+    data.push_back (sample{random_image (rng), (unsigned int) (i % 10)});
+  }
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  random_network (weights, biases);
+  int max_threads = std::max (1u, std::thread::hardware_concurrency ());
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    for (bool deterministic: {false, true})
+    {
+      kernels::set_deterministic (deterministic);
+      trainer_config config;
+      config.batch_size = TRAIN_BATCH;
+      config.threads = threads;
+      config.deterministic = deterministic;
+      Trainer trainer (weights, biases, config);
+      epoch_stats stats = trainer.train_epoch (data);
+      std::cout << "deterministic: train, " << threads << " threads, "
+                << (deterministic ? "deterministic " : "fastest ")
+                << stats.samples_per_sec << " samples/sec" << std::endl;
+    }
+  }
+  kernels::set_deterministic (false);
+}
+
+/**
+ * Training throughput for 1..hardware_concurrency threads.
+ */
+static void bench_train ()
+{
+  std::mt19937 rng (BENCH_SEED);
+  std::vector<sample> data;
+  for (int i = 0; i < TRAIN_SAMPLES; ++i)
+  {
+    data.push_back (sample{random_image (rng), (unsigned int) (i % 10)});
+  }
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  random_network (weights, biases);
+
+  int max_threads = std::max (1u, std::thread::hardware_concurrency ());
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    trainer_config config;
+    config.batch_size = TRAIN_BATCH;
+    config.threads = threads;
+    Trainer trainer (weights, biases, config);
+    epoch_stats stats = trainer.train_epoch (data);
+    std::cout << "train: " << threads << " threads, "
+              << stats.samples_per_sec << " samples/sec, "
+              << stats.samples_per_sec_per_core << " samples/sec/core"
+              << std::endl;
+  }
+}
+
+int main (int argc, char **argv)
+{
+  std::map<std::string, std::function<void ()>> benchmarks = {
+      {"batch", bench_batch},
+      {"cache", bench_cache},
+      {"cascade", bench_cascade},
+      {"context", bench_context},
+      {"conv", bench_conv},
+      {"deterministic", bench_deterministic},
+      {"half", bench_half},
+      {"inference", bench_inference},
+      {"pages", bench_pages},
+      {"swap", bench_swap},
+      {"train", bench_train},
+  };
+
+  if (argc == 1)
+  {
+    for (const auto &it: benchmarks)
+    {
+      it.second ();
+    }
+    return EXIT_SUCCESS;
+  }
+  for (int i = 1; i < argc; ++i)
+  {
+    auto it = benchmarks.find (argv[i]);
+    if (it == benchmarks.end ())
+    {
+      std::cerr << "unknown benchmark: " << argv[i] << std::endl;
+      return EXIT_FAILURE;
+    }
+    it->second ();
+  }
+  return EXIT_SUCCESS;
+}
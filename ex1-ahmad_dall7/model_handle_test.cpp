@@ -0,0 +1,139 @@
+//
+// Tests for ModelHandle: readers keep inferring while the network is
+// swapped under them, every answer comes from a complete network and a
+// failed reload leaves the published one in place.
+//
+// Usage: ./model_handle_test [ex1 directory]
+//
+
+#include "ModelHandle.h"
+#include "MlpIO.h"
+#include "TestUtil.h"
+#include "Trainer.h"
+
+#include <thread>
+#include <vector>
+
+#define SEED 5
+#define READERS 3
+#define SWAPS 40
+
+static std::unique_ptr<MlpNetwork> random_network ()
+{
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (weights_dims, SEED, weights, biases);
+  return std::unique_ptr<MlpNetwork> (new MlpNetwork (weights, biases));
+}
+
+/**
+ * Even generations run the shipped parameters, odd ones a random network.
+ * Readers compare every answer with the one its generation must give, so a
+ * reader that saw a half published or freed network fails.
+ */
+static void test_swaps (const std::string &base,
+                        const std::vector<Matrix> &images)
+{
+  std::cout << "Swapping the network " << SWAPS << " times under "
+            << READERS << " readers" << std::endl;
+  std::string parameters = base + "parameters";
+  std::unique_ptr<MlpNetwork> shipped = load_model (parameters
+                                                    + "/mlp.model");
+  std::unique_ptr<MlpNetwork> random = random_network ();
+  std::vector<digit> expected[2];
+  for (const Matrix &img: images)
+  {
+    expected[0].push_back ((*shipped) (img));
+    expected[1].push_back ((*random) (img));
+  }
+
+  ModelHandle handle (std::move (shipped));
+  std::atomic<bool> done (false);
+  std::atomic<long> inferences (0);
+  std::atomic<long> wrong (0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < READERS; ++r)
+  {
+    readers.emplace_back ([&, r] ()
+    {
+      // odd readers share the networks through their own contexts
+      InferenceContext context;
+      for (int i = r; !done.load (); ++i)
+      {
+        ModelHandle::Pin model = handle.pin ();
+        int image = i % IMAGES_COUNT;
+        digit d = r % 2 == 0 ? (*model) (images[image])
+                             : (*model) (images[image], context);
+        const digit &want = expected[model.generation () % 2][image];
+        if (d.value != want.value || d.probability != want.probability)
+        {
+          ++wrong;
+        }
+        ++inferences;
+      }
+    });
+  }
+
+  for (int s = 1; s <= SWAPS; ++s)
+  {
+    unsigned long generation = s % 2 == 1
+                               ? handle.publish (random_network ())
+                               : handle.reload (parameters).get ();
+    check (generation == (unsigned long) s, "generation of swap "
+                                            + std::to_string (s));
+  }
+  done.store (true);
+  for (std::thread &reader: readers)
+  {
+    reader.join ();
+  }
+
+  check (wrong.load () == 0, std::to_string (wrong.load ())
+                             + " inferences saw the wrong network");
+  check (inferences.load () > 0, "readers made no progress");
+  check (handle.generation () == SWAPS, "final generation");
+}
+
+static void test_failed_reload (const std::string &base)
+{
+  std::cout << "Checking a failed reload keeps the published network"
+            << std::endl;
+  ModelHandle handle (load_model (base + "parameters/mlp.model"));
+  bool thrown = false;
+  try
+  {
+    handle.reload (base + "no_such_dir").get ();
+  }
+  catch (const std::invalid_argument &)
+  {
+    thrown = true;
+  }
+  check (thrown, "missing parameters were not reported");
+  check (handle.generation () == 0, "failed reload changed the network");
+  check (handle.reload (base + "parameters/mlp.model").get () == 1,
+         "reload after a failure");
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  try
+  {
+    std::vector<Matrix> images = load_image_matrices (base);
+    test_swaps (base, images);
+    test_failed_reload (base);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All model handle checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
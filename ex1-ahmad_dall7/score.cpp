@@ -0,0 +1,70 @@
+//
+// Command line bulk scorer: classifies every image of a manifest into a
+// JSONL or CSV results file, and picks up where an interrupted run stopped.
+//
+
+#include "BulkScorer.h"
+
+#include <iostream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpscore manifest model output [threads] " \
+                  "[jsonl|csv] [chunk_size] [max_chunks]\n" \
+                  "\tmanifest - one image path per line\n" \
+                  "\tmodel - a .model file or a parameters directory\n" \
+                  "\toutput - results file, rerun to resume an interrupted " \
+                  "job\n" \
+                  "\tmax_chunks - stop after this many chunks"
+#define MIN_ARGS 4
+#define MAX_ARGS 8
+#define THREADS_IDX 4
+#define FORMAT_IDX 5
+#define CHUNK_IDX 6
+#define MAX_CHUNKS_IDX 7
+
+int main (int argc, char **argv)
+{
+  if (argc < MIN_ARGS || argc > MAX_ARGS)
+  {
+    std::cout << USAGE_MSG << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    scoring_config config;
+    config.manifest = argv[1];
+    config.model = argv[2];
+    config.output = argv[3];
+    if (argc > THREADS_IDX)
+    {
+      config.threads = std::stoi (argv[THREADS_IDX]);
+    }
+    if (argc > FORMAT_IDX)
+    {
+      config.format = std::string (argv[FORMAT_IDX]) == "csv" ? CSV : JSONL;
+    }
+    if (argc > CHUNK_IDX)
+    {
+      config.chunk_size = std::stoi (argv[CHUNK_IDX]);
+    }
+    if (argc > MAX_CHUNKS_IDX)
+    {
+      config.max_chunks = std::stol (argv[MAX_CHUNKS_IDX]);
+    }
+
+    scoring_stats stats = score_manifest (config);
+    std::cout << "chunks " << stats.done_chunks << "/" << stats.total_chunks
+              << " (" << stats.resumed_chunks << " resumed)"
+              << " images " << stats.images
+              << " unreadable " << stats.failed
+              << " seconds " << stats.seconds
+              << " images/sec " << stats.images_per_sec << std::endl;
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
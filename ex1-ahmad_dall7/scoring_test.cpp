@@ -0,0 +1,187 @@
+//
+// Tests for score_manifest: a job stopped and resumed writes the same
+// results as one uninterrupted run, bytes written after the last checkpoint
+// are dropped on resume, checkpoints of other jobs are rejected and
+// unreadable images get error records.
+//
+// Usage: ./scoring_test [ex1 directory]
+//
+
+#include "BulkScorer.h"
+#include "MlpIO.h"
+#include "TestUtil.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#define REPEATS 5
+#define CHUNK_SIZE 4
+#define MANIFEST_FILE "scoring_test.manifest"
+#define FULL_OUTPUT "scoring_test_full.out"
+#define RESUMED_OUTPUT "scoring_test_resumed.out"
+
+static std::string read_file (const std::string &path)
+{
+  std::ifstream in (path, std::ios::in | std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf ();
+  return contents.str ();
+}
+
+static void remove_job (const std::string &output)
+{
+  std::remove (output.c_str ());
+  std::remove ((output + CHECKPOINT_SUFFIX).c_str ());
+}
+
+/**
+ * The images, several times over, with a missing image in the middle.
+ */
+static void write_manifest (const std::string &base)
+{
+  std::ofstream manifest (MANIFEST_FILE);
+  for (int r = 0; r < REPEATS; ++r)
+  {
+    for (int i = 0; i < IMAGES_COUNT; ++i)
+    {
+      manifest << base << "images/im" << i << "\n";
+    }
+    if (r == REPEATS / 2)
+    {
+      manifest << base << "images/missing\n";
+    }
+  }
+}
+
+static scoring_config job (const std::string &base, const std::string &output,
+                           output_format format)
+{
+  scoring_config config;
+  config.manifest = MANIFEST_FILE;
+  config.model = base + "parameters/mlp.model";
+  config.output = output;
+  config.threads = 3;
+  config.format = format;
+  config.chunk_size = CHUNK_SIZE;
+  return config;
+}
+
+static void test_resume (const std::string &base, output_format format)
+{
+  std::string name = format == JSONL ? "jsonl" : "csv";
+  std::cout << "Checking resumed " << name << " jobs" << std::endl;
+  remove_job (FULL_OUTPUT);
+  remove_job (RESUMED_OUTPUT);
+
+  scoring_stats full = score_manifest (job (base, FULL_OUTPUT, format));
+  long images = IMAGES_COUNT * REPEATS + 1;
+  check (full.images == images && full.failed == 1
+         && full.done_chunks == full.total_chunks
+         && full.total_chunks == (images + CHUNK_SIZE - 1) / CHUNK_SIZE,
+         name + " full run statistics");
+  std::string expected = read_file (FULL_OUTPUT);
+  std::istringstream lines (expected);
+  std::string line;
+  long records = 0, errors = 0;
+  while (std::getline (lines, line))
+  {
+    ++records;
+    errors += line.find ("unreadable image") != std::string::npos;
+  }
+  check (records == images + (format == CSV), name + " record count");
+  check (errors == 1, name + " error record");
+  check (format == CSV || expected.find (
+      "{\"path\":\"" + base + "images/im0\",\"digit\":5,") == 0,
+         name + " first record");
+
+  scoring_config stopped = job (base, RESUMED_OUTPUT, format);
+  stopped.max_chunks = 3;
+  scoring_stats first = score_manifest (stopped);
+  check (first.done_chunks == 3 && first.images == 3 * CHUNK_SIZE,
+         name + " stopped run statistics");
+
+  // a crash after writing but before checkpointing
+  std::ofstream (RESUMED_OUTPUT, std::ios::app) << "partial garbage";
+  stopped.max_chunks = 4;
+  stopped.threads = 1;
+  score_manifest (stopped);
+  std::ofstream (RESUMED_OUTPUT, std::ios::app) << "more garbage\n";
+  scoring_stats last = score_manifest (job (base, RESUMED_OUTPUT, format));
+  check (last.resumed_chunks == 7 && last.done_chunks == full.total_chunks
+         && last.images == images - 7 * CHUNK_SIZE,
+         name + " resumed run statistics");
+  check (read_file (RESUMED_OUTPUT) == expected, name + " resumed output");
+
+  scoring_stats again = score_manifest (job (base, RESUMED_OUTPUT, format));
+  check (again.images == 0 && read_file (RESUMED_OUTPUT) == expected,
+         name + " finished job is left alone");
+  remove_job (FULL_OUTPUT);
+  remove_job (RESUMED_OUTPUT);
+}
+
+static bool rejected (const scoring_config &config)
+{
+  try
+  {
+    score_manifest (config);
+    return false;
+  }
+  catch (const std::invalid_argument &)
+  {
+    return true;
+  }
+}
+
+static void test_mismatch (const std::string &base)
+{
+  std::cout << "Checking checkpoints of other jobs" << std::endl;
+  remove_job (RESUMED_OUTPUT);
+  scoring_config config = job (base, RESUMED_OUTPUT, JSONL);
+  config.max_chunks = 1;
+  score_manifest (config);
+
+  scoring_config other = config;
+  other.chunk_size = CHUNK_SIZE + 1;
+  check (rejected (other), "different chunk size");
+  other = config;
+  other.format = CSV;
+  check (rejected (other), "different format");
+  std::ofstream (RESUMED_OUTPUT + std::string (CHECKPOINT_SUFFIX))
+      << "not a checkpoint\n";
+  check (rejected (config), "corrupt checkpoint");
+  other = config;
+  other.chunk_size = 0;
+  check (rejected (other), "zero chunk size");
+  other = config;
+  other.manifest = "missing.manifest";
+  check (rejected (other), "missing manifest");
+  remove_job (RESUMED_OUTPUT);
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  try
+  {
+    write_manifest (base);
+    test_resume (base, JSONL);
+    test_resume (base, CSV);
+    test_mismatch (base);
+    std::remove (MANIFEST_FILE);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All scoring checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
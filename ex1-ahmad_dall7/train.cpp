@@ -0,0 +1,127 @@
+//
+// Command line trainer: trains the MLP on a labeled image manifest and
+// writes the w1..w4 / b1..b4 parameter files mlpnetwork loads.
+//
+
+#include "MlpIO.h"
+#include "Trainer.h"
+
+#include <fstream>
+#include <sstream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlptrain manifest out_dir [epochs] [batch_size] " \
+                  "[threads] [sgd|adam] [learning_rate] [init_dir]\n" \
+                  "\tmanifest - lines of '<image path> <label>'\n" \
+                  "\tout_dir - directory the parameter files are written to\n" \
+                  "\tinit_dir - parameters to start from, random if omitted"
+#define MANIFEST_ERR "Error: invalid manifest line: "
+#define MIN_ARGS 3
+#define MAX_ARGS 9
+#define EPOCHS_IDX 3
+#define BATCH_IDX 4
+#define THREADS_IDX 5
+#define OPTIMIZER_IDX 6
+#define LR_IDX 7
+#define INIT_IDX 8
+
+/**
+ * Reads every '<image path> <label>' line of the manifest.
+ * @throw std::invalid_argument on a malformed line or unreadable image
+ */
+static std::vector<sample> load_samples (const std::string &manifest)
+{
+  std::ifstream in (manifest);
+  if (!in.is_open ())
+  {
+    throw std::invalid_argument (MANIFEST_ERR + manifest);
+  }
+  std::vector<sample> samples;
+  std::string line;
+  while (std::getline (in, line))
+  {
+    std::istringstream fields (line);
+    std::string path;
+    int label;
+    if (line.empty ())
+    {
+      continue;
+    }
+    sample s{Matrix (img_dims.rows, img_dims.cols), 0};
+    if (!(fields >> path >> label) || label < 0
+        || !read_matrix_file (path, s.image))
+    {
+      throw std::invalid_argument (MANIFEST_ERR + line);
+    }
+    s.label = (unsigned int) label;
+    samples.push_back (s);
+  }
+  return samples;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < MIN_ARGS || argc > MAX_ARGS)
+  {
+    std::cout << USAGE_MSG << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try
+  {
+    trainer_config config;
+    if (argc > EPOCHS_IDX)
+    {
+      config.epochs = std::stoi (argv[EPOCHS_IDX]);
+    }
+    if (argc > BATCH_IDX)
+    {
+      config.batch_size = std::stoi (argv[BATCH_IDX]);
+    }
+    if (argc > THREADS_IDX)
+    {
+      config.threads = std::stoi (argv[THREADS_IDX]);
+    }
+    if (argc > OPTIMIZER_IDX)
+    {
+      config.optimizer = std::string (argv[OPTIMIZER_IDX]) == "sgd"
+                         ? SGD : ADAM;
+    }
+    if (argc > LR_IDX)
+    {
+      config.learning_rate = std::stof (argv[LR_IDX]);
+    }
+
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    if (argc > INIT_IDX)
+    {
+      load_parameters (argv[INIT_IDX], weights, biases);
+    }
+    else
+    {
+      Trainer::random_parameters (weights_dims, config.seed, weights, biases);
+    }
+
+    std::vector<sample> samples = load_samples (argv[1]);
+    Trainer trainer (weights, biases, config);
+    for (int e = 0; e < config.epochs; ++e)
+    {
+      epoch_stats stats = trainer.train_epoch (samples);
+      std::cout << "epoch " << e + 1 << ": loss " << stats.loss
+                << " accuracy " << stats.accuracy
+                << " samples/sec " << stats.samples_per_sec
+                << " samples/sec/core " << stats.samples_per_sec_per_core
+                << std::endl;
+    }
+
+    trainer.export_parameters (weights, biases);
+    save_parameters (argv[2], weights, biases);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+//
+// Tests for Trainer: analytic gradients against finite differences,
+// convergence on the sample images, thread count independence and the
+// round trip through the parameter files.
+//
+// Usage: ./training_test [ex1 directory]
+//
+
+#include "MlpIO.h"
+#include "TestUtil.h"
+#include "Trainer.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+#define SEED 11
+#define FD_STEP 1e-2f
+#define FD_TOL 2e-2f
+#define FD_CHECKS 20
+#define FIT_EPOCHS 60
+#define THREADS_TOL 1e-4f
+
+/**
+ * One SGD step with learning rate lr on a single sample moves every
+ * parameter by -lr * gradient, which gives the analytic gradient back
+ * without exposing the trainer's internals.
+ */
+static void test_gradients (const std::vector<sample> &images)
+{
+  std::cout << "Checking gradients against finite differences" << std::endl;
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (small_dims, SEED, weights, biases);
+  std::vector<sample> one (images.begin (), images.begin () + 1);
+
+  trainer_config config;
+  config.batch_size = 1;
+  config.optimizer = SGD;
+  config.learning_rate = 1e-3f;
+  Trainer stepped (weights, biases, config);
+  stepped.train_epoch (one);
+
+  std::mt19937 rng (SEED);
+  for (int c = 0; c < FD_CHECKS; ++c)
+  {
+    int layer = (int) (rng () % MLP_SIZE);
+    int index = (int) (rng () % (small_dims[layer].rows
+                                 * small_dims[layer].cols));
+    float analytic = (weights[layer][index]
+                      - stepped.get_weights (layer)[index])
+                     / config.learning_rate;
+
+    Matrix plus[MLP_SIZE], minus[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; ++i)
+    {
+      plus[i] = weights[i];
+      minus[i] = weights[i];
+    }
+    plus[layer][index] += FD_STEP;
+    minus[layer][index] -= FD_STEP;
+    float numeric = (Trainer (plus, biases, config).loss (one)
+                     - Trainer (minus, biases, config).loss (one))
+                    / (2 * FD_STEP);
+    check (std::abs (analytic - numeric)
+           <= FD_TOL * std::max (1.f, std::abs (numeric)),
+           "gradient of layer " + std::to_string (layer + 1) + " weight "
+           + std::to_string (index) + ": analytic " + std::to_string (analytic)
+           + " numeric " + std::to_string (numeric));
+  }
+}
+
+static void test_fit (const std::vector<sample> &images, const std::string &out)
+{
+  std::cout << "Checking the trainer fits the sample images" << std::endl;
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (weights_dims, SEED, weights, biases);
+
+  trainer_config config;
+  config.batch_size = 4;
+  config.epochs = FIT_EPOCHS;
+  Trainer trainer (weights, biases, config);
+  float before = trainer.loss (images);
+  std::vector<epoch_stats> stats = trainer.train (images);
+  check (trainer.loss (images) < before / 10, "loss did not decrease");
+  check (stats.back ().accuracy == 1.f, "sample images were not learned");
+  check (stats.back ().samples_per_sec > 0, "throughput was not measured");
+
+  // exported files must load into an MlpNetwork that agrees with training
+  trainer.export_parameters (weights, biases);
+  save_parameters (out, weights, biases);
+  Matrix loaded_w[MLP_SIZE];
+  Matrix loaded_b[MLP_SIZE];
+  load_parameters (out, loaded_w, loaded_b);
+  MlpNetwork mlp (loaded_w, loaded_b);
+  for (const auto &s: images)
+  {
+    check (mlp (s.image).value == s.label, "exported network prediction");
+  }
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    std::remove ((out + "/" WEIGHTS_FILE_PREFIX + std::to_string (i + 1))
+                     .c_str ());
+    std::remove ((out + "/" BIAS_FILE_PREFIX + std::to_string (i + 1))
+                     .c_str ());
+  }
+}
+
+static void test_threads (const std::vector<sample> &images)
+{
+  std::cout << "Checking thread count only changes the reduction order"
+            << std::endl;
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  Trainer::random_parameters (small_dims, SEED, weights, biases);
+
+  trainer_config config;
+  config.batch_size = IMAGES_COUNT;
+  config.epochs = 3;
+  // plain SGD: Adam divides by tiny second moments and would amplify the
+  // rounding differences this test tolerates
+  config.optimizer = SGD;
+  config.learning_rate = 0.01f;
+  Trainer serial (weights, biases, config);
+  config.threads = 4;
+  Trainer parallel (weights, biases, config);
+  serial.train (images);
+  parallel.train (images);
+  for (int l = 0; l < MLP_SIZE; ++l)
+  {
+    const Matrix &a = serial.get_weights (l);
+    const Matrix &b = parallel.get_weights (l);
+    bool ok = true;
+    for (int i = 0; i < a.get_rows () * a.get_cols (); ++i)
+    {
+      ok = ok && std::abs (a[i] - b[i]) <= THREADS_TOL;
+    }
+    check (ok, "threaded weights of layer " + std::to_string (l + 1));
+  }
+
+  // batches of 2 give only 2 of the 4 threads work
+  config.batch_size = 2;
+  Trainer narrow (weights, biases, config);
+  epoch_stats stats = narrow.train_epoch (images);
+  check (stats.samples_per_sec_per_core == stats.samples_per_sec / 2,
+         "throughput per core of the threads that ran");
+}
+
+int main (int argc, char **argv)
+{
+  std::string base = argc > 1 ? std::string (argv[1]) + "/" : "";
+  try
+  {
+    std::vector<sample> images = load_images (base);
+    test_gradients (images);
+    test_fit (images, ".");
+    test_threads (images);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "unexpected exception: " << e.what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (failures != 0)
+  {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All training checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
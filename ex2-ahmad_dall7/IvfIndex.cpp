@@ -0,0 +1,361 @@
+#include "IvfIndex.h"
+#include "Parallel.h"
+#include "TopK.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+static void unit_vector (const double *features, double norm, size_t size,
+                         double *out)
+/**
+ * writing features divided by their norm , zeros for a zero norm
+ * @param features
+ * @param norm
+ * @param size
+ * @param out
+ */
+{
+  for (size_t i = 0; i < size; ++i)
+    {
+      out[i] = norm == 0 ? 0 : features[i] / norm;
+    }
+}
+
+void IvfIndex::seed_centroid (const MovieCatalog &catalog, movie_id id,
+                              size_t list)
+/**
+ * moving the centroid of list to the direction of the movie . a movie
+ * without a direction gives the axis list % dimensions instead , so no
+ * centroid has a zero norm
+ * @param catalog
+ * @param id
+ * @param list
+ */
+{
+  double *centroid = m_centroids.data () + list * m_dimensions;
+  unit_vector (catalog.features (id), catalog.norm (id), m_dimensions,
+               centroid);
+  if (catalog.norm (id) == 0 && m_dimensions != 0)
+    {
+      centroid[list % m_dimensions] = 1;
+    }
+}
+
+size_t IvfIndex::nearest_list (const double *features, double norm) const
+/**
+ * the centroids have the same length , so the largest scalar multiply is
+ * the largest similarity . the first of equal ones wins
+ * @param features
+ * @param norm
+ * @return the list of the centroid most similar to features
+ */
+{
+  size_t best = 0;
+  if (norm == 0)
+    {
+      return best;
+    }
+  double best_product = 0;
+  for (size_t c = 0; c < m_lists.size (); ++c)
+    {
+      double product = scalar_multiply_vec (&m_centroids[c * m_dimensions],
+                                            features, m_dimensions);
+      if (c == 0 || product > best_product)
+        {
+          best = c;
+          best_product = product;
+        }
+    }
+  return best;
+}
+
+double
+IvfIndex::distance (size_t list, const double *features, double norm) const
+/**
+ * @param list
+ * @param features
+ * @param norm
+ * @return the distance of the unit vector of features from the centroid of
+ * list . a zero norm has a similarity of 0 to every query , 90 degrees ,
+ * so it is at sqrt(2) , the distance of a unit vector at 90 degrees , and
+ * bound never goes below 0 for a list that holds it
+ */
+{
+  if (norm == 0)
+    {
+      return std::sqrt (2.0);
+    }
+  const double *centroid = &m_centroids[list * m_dimensions];
+  double sum = 0;
+  for (size_t f = 0; f < m_dimensions; ++f)
+    {
+      double diff = features[f] / norm - centroid[f];
+      sum += diff * diff;
+    }
+  return std::sqrt (sum);
+}
+
+double IvfIndex::bound (size_t list, const double *unit_query) const
+/**
+ * a unit vector at distance r from the unit centroid is at an angle of at
+ * most 2 asin(r / 2) from it , so its angle from the query is at least the
+ * angle of the centroid less that . the cosine of it is at most
+ * query * centroid + r (Cauchy-Schwarz) , and tighter
+ * @param list
+ * @param unit_query
+ * @return no movie of list is more similar to the query
+ */
+{
+  double product = scalar_multiply_vec (&m_centroids[list * m_dimensions],
+                                        unit_query, m_dimensions);
+  double angle = std::acos (std::max (-1.0, std::min (1.0, product)))
+                 - 2 * std::asin (std::min (1.0, m_radii[list] / 2));
+  return angle <= 0 ? 1 : std::cos (angle);
+}
+
+void IvfIndex::build (const MovieCatalog &catalog, const ivf_config &config)
+/**
+ * spherical k-means : the centroids start at random movies , every round
+ * assigns the movies to their nearest centroids in parallel and moves each
+ * centroid to the direction of the sum of its movies . a centroid that
+ * lost all of its movies restarts at a random movie . an empty catalog
+ * gives one list , add seeds it with the first movie
+ * @param catalog
+ * @param config
+ */
+{
+  size_t movies = catalog.size ();
+  m_dimensions = catalog.dimensions ();
+  size_t lists = config.lists != 0 ? config.lists
+                                   : (size_t) std::lround (std::sqrt (movies));
+  lists = std::max ((size_t) 1, std::min (lists, movies));
+  std::mt19937 rng (config.seed);
+  std::vector<movie_id> order (movies);
+  std::iota (order.begin (), order.end (), 0);
+  std::shuffle (order.begin (), order.end (), rng);
+  std::uniform_int_distribution<size_t> random_movie
+      (0, std::max ((size_t) 1, movies) - 1);
+
+  m_centroids.assign (lists * m_dimensions, 0);
+  m_lists.assign (lists, std::vector<movie_id> ());
+  m_radii.assign (lists, 0);
+  m_size = movies;
+  m_built = true;
+  if (movies == 0)
+    {
+      return;
+    }
+  for (size_t c = 0; c < lists && c < movies; ++c)
+    {
+      seed_centroid (catalog, order[c], c);
+    }
+
+  std::vector<size_t> assigned (movies);
+  std::vector<double> sums (lists * m_dimensions);
+  std::vector<size_t> counts (lists);
+  for (int round = 0; round <= config.iterations; ++round)
+    {
+      parallel_for (movies, config.threads, DEFAULT_CHUNK,
+                    [&] (size_t begin, size_t end)
+                    {
+                      for (size_t i = begin; i < end; ++i)
+                        {
+                          assigned[i] = nearest_list
+                              (catalog.features ((movie_id) i),
+                               catalog.norm ((movie_id) i));
+                        }
+                    });
+      if (round == config.iterations)
+        {
+          break; // the last assignment is the lists
+        }
+      std::fill (sums.begin (), sums.end (), 0);
+      std::fill (counts.begin (), counts.end (), 0);
+      for (size_t i = 0; i < movies; ++i)
+        {
+          double norm = catalog.norm ((movie_id) i);
+          const double *features = catalog.features ((movie_id) i);
+          double *sum = &sums[assigned[i] * m_dimensions];
+          for (size_t f = 0; norm != 0 && f < m_dimensions; ++f)
+            {
+              sum[f] += features[f] / norm;
+            }
+          ++counts[assigned[i]];
+        }
+      for (size_t c = 0; c < lists; ++c)
+        {
+          double *centroid = &m_centroids[c * m_dimensions];
+          double *sum = &sums[c * m_dimensions];
+          if (counts[c] == 0)
+            {
+              seed_centroid (catalog, (movie_id) random_movie (rng), c);
+            }
+          else if (vector_norm (sum, m_dimensions) != 0)
+            {
+              unit_vector (sum, vector_norm (sum, m_dimensions),
+                           m_dimensions, centroid);
+            }
+        }
+    }
+
+  for (size_t i = 0; i < movies; ++i)
+    {
+      m_lists[assigned[i]].push_back ((movie_id) i);
+      m_radii[assigned[i]] = std::max
+          (m_radii[assigned[i]], distance (assigned[i],
+                                           catalog.features ((movie_id) i),
+                                           catalog.norm ((movie_id) i)));
+    }
+}
+
+void IvfIndex::add (const MovieCatalog &catalog, movie_id id)
+/**
+ * the index of an empty catalog has no dimensions yet , it takes them and
+ * its one centroid from the first movie added
+ * @param catalog
+ * @param id
+ */
+{
+  if (m_size == 0)
+    {
+      m_dimensions = catalog.dimensions ();
+      m_centroids.assign (m_lists.size () * m_dimensions, 0);
+      for (size_t c = 0; c < m_lists.size (); ++c)
+        {
+          seed_centroid (catalog, id, c);
+        }
+    }
+  size_t list = nearest_list (catalog.features (id), catalog.norm (id));
+  m_lists[list].push_back (id);
+  m_radii[list] = std::max (m_radii[list], distance (list,
+                                                     catalog.features (id),
+                                                     catalog.norm (id)));
+  ++m_size;
+}
+
+bool IvfIndex::built () const
+{
+  return m_built;
+}
+
+size_t IvfIndex::size () const
+{
+  return m_size;
+}
+
+size_t IvfIndex::lists () const
+{
+  return m_lists.size ();
+}
+
+size_t IvfIndex::dimensions () const
+{
+  return m_dimensions;
+}
+
+std::vector<std::pair<double, movie_id>>
+IvfIndex::search (const MovieCatalog &catalog, const double *query,
+                  double query_norm, size_t n, size_t probes,
+                  const std::vector<bool> &excluded) const
+/**
+ * choosing the lists by the similarity of their centroids to query , then
+ * comparing query with their movies
+ * @param catalog
+ * @param query
+ * @param query_norm
+ * @param n
+ * @param probes
+ * @param excluded
+ * @return the movies and their similarities , the most similar first
+ */
+{
+  TopK<size_t> nearest (std::max ((size_t) 1, probes));
+  for (size_t c = 0; c < m_lists.size (); ++c)
+    {
+      nearest.push (scalar_multiply_vec (&m_centroids[c * m_dimensions],
+                                         query, m_dimensions), c);
+    }
+  TopK<movie_id> best (n);
+  for (const auto &list: nearest.take ())
+    {
+      for (movie_id id: m_lists[list.second])
+        {
+          if (id < excluded.size () && excluded[id])
+            {
+              continue;
+            }
+          best.push (get_vec_similarity (query, query_norm,
+                                         catalog.features (id),
+                                         catalog.norm (id), m_dimensions),
+                     id);
+        }
+    }
+  return best.take ();
+}
+
+std::vector<std::pair<double, movie_id>>
+IvfIndex::search_exact (const MovieCatalog &catalog, const double *query,
+                        double query_norm, size_t n,
+                        const std::vector<bool> &excluded) const
+/**
+ * the similarities are the ones of the full scan , so the best and the
+ * ties are the same . the n best are kept in a heap with the lowest at the
+ * front . a list is skipped only when its bound is below the lowest of n
+ * by more than PRUNE_MARGIN , a list that may hold an equal movie is still
+ * compared since that movie may come first
+ * @param catalog
+ * @param query
+ * @param query_norm
+ * @param n
+ * @param excluded
+ * @return the movies and their similarities
+ */
+{
+  std::vector<double> unit_query (m_dimensions);
+  unit_vector (query, query_norm, m_dimensions, unit_query.data ());
+  TopK<size_t> by_bound (m_lists.size ());
+  for (size_t c = 0; c < m_lists.size (); ++c)
+    {
+      by_bound.push (bound (c, unit_query.data ()), c);
+    }
+  auto better = [&catalog] (const std::pair<double, movie_id> &a,
+                            const std::pair<double, movie_id> &b)
+  {
+    return a.first > b.first
+           || (a.first == b.first
+               && *catalog.movie (a.second) < *catalog.movie (b.second));
+  };
+  std::vector<std::pair<double, movie_id>> best;
+  for (const auto &list: by_bound.take ())
+    {
+      if (n == 0 || (best.size () == n
+                     && list.first + PRUNE_MARGIN < best.front ().first))
+        {
+          break; // the next bounds are not higher
+        }
+      for (movie_id id: m_lists[list.second])
+        {
+          if (id < excluded.size () && excluded[id])
+            {
+              continue;
+            }
+          std::pair<double, movie_id> found
+              (get_vec_similarity (query, query_norm, catalog.features (id),
+                                   catalog.norm (id), m_dimensions), id);
+          if (best.size () < n)
+            {
+              best.push_back (found);
+              std::push_heap (best.begin (), best.end (), better);
+            }
+          else if (better (found, best.front ()))
+            {
+              std::pop_heap (best.begin (), best.end (), better);
+              best.back () = found;
+              std::push_heap (best.begin (), best.end (), better);
+            }
+        }
+    }
+  std::sort_heap (best.begin (), best.end (), better);
+  return best;
+}
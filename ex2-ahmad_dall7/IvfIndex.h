@@ -0,0 +1,129 @@
+#ifndef IVFINDEX_H
+#define IVFINDEX_H
+
+#include "MovieCatalog.h"
+
+#define DEFAULT_PROBES 8
+#define DEFAULT_KMEANS_ITERATIONS 10
+#define DEFAULT_KMEANS_SEED 5489
+// slack for rounding when search_exact compares a bound of a list with a
+// similarity , so a list is only skipped when it surely can not tie
+#define PRUNE_MARGIN 1e-9
+
+/**
+ * @struct ivf_config
+ * @brief How an IvfIndex is built.
+ * @var lists - number of lists , 0 means about sqrt(movies)
+ * @var iterations - k-means rounds
+ * @var seed - of the first centroids
+ * @var threads - 0 means default_threads ()
+ */
+typedef struct ivf_config
+{
+    size_t lists = 0;
+    int iterations = DEFAULT_KMEANS_ITERATIONS;
+    unsigned seed = DEFAULT_KMEANS_SEED;
+    unsigned threads = 0;
+} ivf_config;
+
+/**
+ * an approximate index for the movies most similar to a query vector : the
+ * movies are split by spherical k-means into lists around unit centroids ,
+ * and a search only compares the query with the movies of the probes lists
+ * whose centroids are most similar to it.
+ * more probes find the true best more often and cost more , all the lists
+ * give the exact answer . similarities of the movies found are exactly the
+ * ones of MovieCatalog , so they compare with a full scan.
+ * every list also keeps its radius , the largest distance of a unit vector
+ * of its movies from its centroid , sqrt(2) for a movie without features ,
+ * which is 90 degrees from every query . no movie of a list is more similar to a
+ * query than the cosine of the angle of the query from the centroid less
+ * the angle of the radius , which lets search_exact skip whole lists and
+ * still find the true best.
+ */
+class IvfIndex
+{
+ public:
+  /**
+   * builds the index of every movie in catalog
+   * @param catalog
+   * @param config
+   */
+  void build (const MovieCatalog &catalog, const ivf_config &config);
+
+  /**
+   * adds the next movie of catalog to the list of its nearest centroid ,
+   * the centroids do not move . the first movie added to an index of an
+   * empty catalog sets its centroid
+   * @param catalog the catalog the index was built from
+   * @param id
+   */
+  void add (const MovieCatalog &catalog, movie_id id);
+
+  bool built () const;
+
+  /**
+   * @return the number of movies in the index
+   */
+  size_t size () const;
+
+  size_t lists () const;
+
+  /**
+   * @return the number of features of the movies in the index , 0 until
+   * the index of an empty catalog has its first movie
+   */
+  size_t dimensions () const;
+
+  /**
+   * the n movies most similar to query in the probes nearest lists
+   * @param catalog
+   * @param query catalog.dimensions() features
+   * @param query_norm vector_norm of query
+   * @param n
+   * @param probes
+   * @param excluded by id , movies to skip , movies past its end are not
+   * excluded
+   * @return the movies and their similarities , the most similar first
+   */
+  std::vector<std::pair<double, movie_id>>
+  search (const MovieCatalog &catalog, const double *query, double query_norm,
+          size_t n, size_t probes, const std::vector<bool> &excluded) const;
+
+  /**
+   * the n movies most similar to query , exactly like a scan of all the
+   * movies in Movie::operator< order : of equal similarities the lower movie
+   * ranks higher. the lists are searched by their bounds , the highest
+   * first , until no bound can reach the n-th similarity found
+   * @param catalog
+   * @param query catalog.dimensions() features
+   * @param query_norm vector_norm of query
+   * @param n
+   * @param excluded by id , movies to skip , movies past its end are not
+   * excluded
+   * @return the movies and their similarities , the most similar first
+   */
+  std::vector<std::pair<double, movie_id>>
+  search_exact (const MovieCatalog &catalog, const double *query,
+                double query_norm, size_t n,
+                const std::vector<bool> &excluded) const;
+
+ private:
+  void seed_centroid (const MovieCatalog &catalog, movie_id id, size_t list);
+
+  size_t nearest_list (const double *features, double norm) const;
+
+  double distance (size_t list, const double *features, double norm) const;
+
+  double bound (size_t list, const double *unit_query) const;
+
+  bool m_built = false;
+  size_t m_dimensions = 0;
+  // unit length centroids , rows of m_dimensions
+  std::vector<double> m_centroids;
+  std::vector<std::vector<movie_id>> m_lists;
+  std::vector<double> m_radii;
+  size_t m_size = 0;
+};
+
+#endif //IVFINDEX_H
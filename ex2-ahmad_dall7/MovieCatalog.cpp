@@ -0,0 +1,147 @@
+#include "MovieCatalog.h"
+#include <math.h>
+#include <stdexcept>
+
+double vector_norm (const double *vec, size_t size)
+/**
+ * the sum of the squares , then its square root
+ * @param vec
+ * @param size
+ * @return the norm
+ */
+{
+  double sum_power2 = 0;
+  for (size_t i = 0; i < size; ++i)
+    {
+      sum_power2 += pow (vec[i], 2);
+    }
+
+  return sqrt (sum_power2);
+}
+
+double
+scalar_multiply_vec (const double *vec1, const double *vec2, size_t size)
+/**
+* a function to calculate scalar_multiply of two vectors
+* @param vec1
+* @param vec2
+* @param size
+* @return sum of multiply each element in both vectors
+*/
+{
+  double result = 0;
+  for (size_t i = 0; i < size; ++i)
+    {
+      result += vec1[i] * vec2[i];
+    }
+  return result;
+}
+
+double
+get_vec_similarity (const double *vec1, double norm1,
+                    const double *vec2, double norm2, size_t size)
+/**
+* the similarity process
+* @param vec1
+* @param norm1
+* @param vec2
+* @param norm2
+* @param size
+* @return the similarity of the two given vectors
+*/
+{
+  double norms_multiply = norm1 * norm2;
+  return norms_multiply == 0 ? 0 : scalar_multiply_vec (vec1, vec2, size)
+                                   / norms_multiply; // return 0 if norm ==0
+                                   // to avoid zero divisor
+}
+
+bool movie_order::operator() (const sp_movie &a, const sp_movie &b) const
+{
+  return *a < *b;
+}
+
+bool movie_order::operator() (const sp_movie &a, const movie_key &b) const
+{
+  return a->get_year () < b.year
+         || (a->get_year () == b.year && a->get_name () < b.name);
+}
+
+bool movie_order::operator() (const movie_key &a, const sp_movie &b) const
+{
+  return a.year < b->get_year ()
+         || (a.year == b->get_year () && a.name < b->get_name ());
+}
+
+movie_id MovieCatalog::add (const sp_movie &movie,
+                            const std::vector<double> &features)
+/**
+ * appending the movie and its features row , the first movie decides the
+ * number of features
+ * @param movie
+ * @param features
+ * @return the id of the movie
+ */
+{
+  if (m_movies.empty ())
+    {
+      m_dimensions = features.size ();
+    }
+  else if (features.size () != m_dimensions)
+    {
+      throw std::runtime_error (FEATURES_SIZE_ERR);
+    }
+  m_movies.push_back (movie);
+  m_features.insert (m_features.end (), features.begin (), features.end ());
+  m_norms.push_back (vector_norm (features.data (), features.size ()));
+  return (movie_id) (m_movies.size () - 1);
+}
+
+void MovieCatalog::reserve (size_t movies)
+/**
+ * reserving the movies vector and the matrix rows
+ * @param movies
+ */
+{
+  m_movies.reserve (movies);
+  m_norms.reserve (movies);
+  if (!m_movies.empty ())
+    {
+      m_features.reserve (movies * m_dimensions);
+    }
+}
+
+size_t MovieCatalog::size () const
+{
+  return m_movies.size ();
+}
+
+size_t MovieCatalog::dimensions () const
+{
+  return m_dimensions;
+}
+
+const sp_movie &MovieCatalog::movie (movie_id id) const
+{
+  return m_movies[id];
+}
+
+const double *MovieCatalog::features (movie_id id) const
+/**
+ * @param id
+ * @return the start of the features row of the movie
+ */
+{
+  return m_features.data () + (size_t) id * m_dimensions;
+}
+
+double MovieCatalog::norm (movie_id id) const
+{
+  return m_norms[id];
+}
+
+double MovieCatalog::similarity (movie_id a, movie_id b) const
+{
+  return get_vec_similarity (features (a), norm (a), features (b), norm (b),
+                             m_dimensions);
+}
@@ -0,0 +1,119 @@
+#ifndef MOVIECATALOG_H
+#define MOVIECATALOG_H
+
+#include "Movie.h"
+#include <cstdint>
+
+#define FEATURES_SIZE_ERR "invalid features , every movie should have the " \
+                          "same number of features"
+
+typedef uint32_t movie_id;
+
+/**
+ * function that calculate vector norm
+ * @param vec
+ * @param size
+ * @return sqrt of the vector inner product
+ */
+double vector_norm (const double *vec, size_t size);
+
+/**
+ * @param vec1
+ * @param vec2
+ * @param size
+ * @return sum of multiply each element in both vectors
+ */
+double scalar_multiply_vec (const double *vec1, const double *vec2,
+                            size_t size);
+
+/**
+ * the cosine similarity of two vectors , with their norms already known so
+ * it is a single scalar multiply
+ * @param vec1
+ * @param norm1 vector_norm of vec1
+ * @param vec2
+ * @param norm2 vector_norm of vec2
+ * @param size
+ * @return the similarity , 0 if one of the norms is 0
+ */
+double get_vec_similarity (const double *vec1, double norm1,
+                           const double *vec2, double norm2, size_t size);
+
+/**
+ * a movie by its name and year , to look movies up without building one
+ */
+typedef struct movie_key
+{
+    const std::string &name;
+    int year;
+} movie_key;
+
+/**
+ * orders movies like Movie::operator< , and compares them with movie_keys
+ * too so ordered containers of sp_movie can be searched by a movie_key
+ */
+struct movie_order
+{
+  typedef void is_transparent;
+
+  bool operator() (const sp_movie &a, const sp_movie &b) const;
+  bool operator() (const sp_movie &a, const movie_key &b) const;
+  bool operator() (const movie_key &a, const sp_movie &b) const;
+};
+
+/**
+ * the movies of a recommender system by a dense integer id , the order
+ * they were added in , with all of their features in one row major matrix :
+ * the features of movie id are the dimensions() doubles starting at
+ * features(id) , so scoring passes read them contiguously and never copy
+ * them.
+ * the norm of every features row is calculated once , when it is added.
+ */
+class MovieCatalog
+{
+ public:
+  /**
+   * adds a movie as the next id
+   * @param movie
+   * @param features must have as many features as the movies already in
+   * the catalog
+   * @return the id of the movie
+   * @throw std::runtime_error if the number of features is different
+   */
+  movie_id add (const sp_movie &movie,
+                const std::vector<double> &features) noexcept(false);
+
+  /**
+   * makes room for movies movies in total
+   */
+  void reserve (size_t movies);
+
+  size_t size () const;
+
+  /**
+   * @return the number of features of every movie
+   */
+  size_t dimensions () const;
+
+  const sp_movie &movie (movie_id id) const;
+
+  const double *features (movie_id id) const;
+
+  /**
+   * @return vector_norm of the features of movie id
+   */
+  double norm (movie_id id) const;
+
+  /**
+   * @return get_vec_similarity of the features of movies a and b
+   */
+  double similarity (movie_id a, movie_id b) const;
+
+ private:
+  std::vector<sp_movie> m_movies;
+  std::vector<double> m_features;
+  std::vector<double> m_norms;
+  size_t m_dimensions = 0;
+};
+
+#endif //MOVIECATALOG_H
@@ -0,0 +1,196 @@
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+ * the threads parallel_for runs on besides the calling one . they are
+ * started the first time a call needs them and wait for the next call
+ * after that , so a call costs a wake up and not a thread start.
+ * one call uses the pool at a time
+ */
+class thread_pool
+{
+ public:
+  thread_pool () = default;
+
+  thread_pool (const thread_pool &) = delete;
+
+  thread_pool &operator= (const thread_pool &) = delete;
+
+  ~thread_pool ();
+
+  /**
+   * runs task on the calling thread and on up to helpers threads of the
+   * pool , and returns when all of them are done
+   * @param helpers
+   * @param task
+   * @return false , without running task , when the pool is running
+   * another task
+   */
+  bool run (unsigned helpers, const std::function<void ()> &task);
+
+ private:
+  void work ();
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  std::vector<std::thread> m_workers;
+  const std::function<void ()> *m_task = nullptr;
+  unsigned m_tickets = 0; // threads that may still join the task
+  unsigned m_running = 0; // threads running it
+  bool m_busy = false;
+  bool m_stop = false;
+};
+
+thread_pool::~thread_pool ()
+{
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all ();
+  for (std::thread &t: m_workers)
+    {
+      t.join ();
+    }
+}
+
+bool thread_pool::run (unsigned helpers, const std::function<void ()> &task)
+/**
+ * the pool grows to helpers threads . the ones that did not join the task
+ * by the time the calling thread finished it are not waited for , the
+ * task had nothing left for them
+ * @param helpers
+ * @param task
+ * @return whether task ran
+ */
+{
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    if (m_busy)
+      {
+        return false;
+      }
+    try
+      {
+        while (m_workers.size () < helpers)
+          {
+            m_workers.emplace_back (&thread_pool::work, this);
+          }
+      }
+    catch (const std::system_error &)
+      {
+        // the threads that started are enough
+      }
+    m_busy = true;
+    m_task = &task;
+    m_tickets = std::min (helpers, (unsigned) m_workers.size ());
+  }
+  m_wake.notify_all ();
+  task ();
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_tickets = 0;
+  m_done.wait (lock, [this] ()
+  { return m_running == 0; });
+  m_task = nullptr;
+  m_busy = false;
+  return true;
+}
+
+void thread_pool::work ()
+{
+  std::unique_lock<std::mutex> lock (m_mutex);
+  for (;;)
+    {
+      m_wake.wait (lock, [this] ()
+      { return m_stop || m_tickets != 0; });
+      if (m_stop)
+        {
+          return;
+        }
+      --m_tickets;
+      ++m_running;
+      const std::function<void ()> *task = m_task;
+      lock.unlock ();
+      (*task) ();
+      lock.lock ();
+      if (--m_running == 0)
+        {
+          m_done.notify_all ();
+        }
+    }
+}
+
+unsigned default_threads ()
+{
+  return std::max (1u, std::thread::hardware_concurrency ());
+}
+
+void parallel_for (size_t count, unsigned threads, size_t chunk,
+                   const std::function<void (size_t, size_t)> &body)
+/**
+ * the threads share a counter of the next chunk , the calling thread works
+ * too so one thread wakes no thread at all . the other threads come from a
+ * pool that lives as long as the program . a call while the pool is busy ,
+ * from a body or from another thread , takes all the chunks on the calling
+ * thread
+ * @param count
+ * @param threads
+ * @param chunk
+ * @param body
+ */
+{
+  chunk = std::max ((size_t) 1, chunk);
+  size_t chunks = (count + chunk - 1) / chunk;
+  threads = threads == 0 ? default_threads () : threads;
+  threads = (unsigned) std::min ((size_t) threads, chunks);
+  if (threads <= 1)
+    {
+      for (size_t begin = 0; begin < count; begin += chunk)
+        {
+          body (begin, std::min (count, begin + chunk));
+        }
+      return;
+    }
+
+  std::atomic<size_t> next_chunk (0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&] ()
+  {
+    for (size_t c = next_chunk++; c < chunks; c = next_chunk++)
+      {
+        try
+          {
+            body (c * chunk, std::min (count, (c + 1) * chunk));
+          }
+        catch (...)
+          {
+            std::lock_guard<std::mutex> lock (error_mutex);
+            if (!error)
+              {
+                error = std::current_exception ();
+              }
+            // the other threads stop after their current chunk
+            next_chunk = chunks;
+          }
+      }
+  };
+
+  static thread_pool pool;
+  if (!pool.run (threads - 1, worker))
+    {
+      worker ();
+    }
+  if (error)
+    {
+      std::rethrow_exception (error);
+    }
+}
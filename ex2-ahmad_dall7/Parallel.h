@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// work items a thread takes at once
+#define DEFAULT_CHUNK 64
+
+/**
+ * @return the number of threads the hardware runs at once , at least 1
+ */
+unsigned default_threads ();
+
+/**
+ * runs body (begin, end) over [0, count) in chunks of chunk items , on
+ * threads threads including the calling one , and returns when all the
+ * chunks are done . the threads take the next chunk as they finish one , so
+ * the chunks of a thread are not contiguous.
+ * the threads besides the calling one are kept in a pool between the
+ * calls . one call runs on the pool at a time , a call that finds it busy ,
+ * like a parallel_for in a body , runs on the calling thread alone.
+ * the first exception a body throws is thrown again here , after the other
+ * threads stop taking chunks.
+ * @param count
+ * @param threads 0 means default_threads ()
+ * @param chunk
+ * @param body
+ */
+void parallel_for (size_t count, unsigned threads, size_t chunk,
+                   const std::function<void (size_t, size_t)> &body)
+noexcept(false);
+
+#endif //PARALLEL_H
@@ -28,12 +28,19 @@ RSUser::RSUser (const std::string &name, const rank_map &map,
                 recommender_system_p rs)
     : m_name (name), m_rank_map (map), m_rs (rs)
 /**
- * constructor to build the object
+ * constructor to build the object , and the profile of the ranks
  * @param name
  * @param map
  * @param rs
  */
 {
+  if (m_rs != nullptr)
+    {
+      for (const auto &it: m_rank_map)
+        {
+          m_rs->add_to_profile (m_profile, it.first, it.second);
+        }
+    }
 }
 
 const std::string &RSUser::get_name () const
@@ -57,7 +64,10 @@ void RSUser::add_movie_to_rs (const std::string &name, int year,
  */
 {
   sp_movie movie = m_rs->add_movie (name, year, features);
-  m_rank_map.emplace (movie, rate);
+  if (m_rank_map.emplace (movie, rate).second) // a rank does not change
+    {
+      m_rs->add_to_profile (m_profile, movie, rate);
+    }
 }
 
 const rank_map &RSUser::get_ranks () const
@@ -69,6 +79,15 @@ const rank_map &RSUser::get_ranks () const
   return m_rank_map;
 }
 
+const user_profile &RSUser::get_profile () const
+/**
+ * getter method that return the sums of the ranked movies
+ * @return
+ */
+{
+  return m_profile;
+}
+
 sp_movie RSUser::get_recommendation_by_content () const
 /**
  * a method that return the recommended movie by content
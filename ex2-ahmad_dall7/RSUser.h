@@ -9,6 +9,7 @@
 #include <string>
 #include <memory>
 #include <algorithm>
+#include <cstdint>
 #include "Movie.h"
 
 
@@ -17,6 +18,30 @@ typedef std::unordered_map<sp_movie, double, hash_func, equal_func> rank_map;
 typedef std::shared_ptr<RecommenderSystem> recommender_system_p;
 typedef std::unique_ptr<RecommenderSystem> recommender_system_unique_p;
 
+/**
+ * the sums of the ranked movies of a user that content recommendations
+ * need , kept up to date as the user ranks movies . the preference vector
+ * is kept centered on the rank mean , not as a difference of two large
+ * sums that cancel when the ranks are close to their mean
+ * @var system - the system of the ids , nullptr before the first movie
+ * @var ids - of the ranked movies in system
+ * @var preference - the sum of (rank - rank_mean) * features
+ * @var features - the sum of the features
+ * @var rank_mean - the mean of the ranks
+ * @var count - the number of ranked movies in system
+ * @var missing - ranked movies that were not in system
+ */
+typedef struct user_profile
+{
+	const RecommenderSystem* system = nullptr;
+	std::vector<uint32_t> ids;
+	std::vector<double> preference;
+	std::vector<double> features;
+	double rank_mean = 0;
+	size_t count = 0;
+	size_t missing = 0;
+} user_profile;
+
 class RSUser
 {
 
@@ -24,6 +49,7 @@ private:
 	std::string m_name;
 	rank_map m_rank_map;
 	recommender_system_p m_rs;
+	user_profile m_profile;
 
 
 	static double get_rank_average(const rank_map& rankMap);
@@ -61,6 +87,12 @@ public:
 	 */
 	const rank_map& get_ranks() const;
 
+	/**
+	 * a getter for the sums of the ranked movies
+	 * @return
+	 */
+	const user_profile& get_profile() const;
+
 	/**
 	 * returns a recommendation according to the movie's content
 	 * @return recommendation
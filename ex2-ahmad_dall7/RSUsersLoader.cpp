@@ -1,90 +1,93 @@
 #include "RSUsersLoader.h"
-#include <fstream>
-#include <sstream>
+#include "TextScanner.h"
+#include <algorithm>
 #include <string>
 
-typedef std::pair<std::string, int> movie_entry;
 #define MIN_RANK 1
 #define MAX_RANK 10
 #define RANK_ERROR "Rank is not in range"
+#define MOVIE_ERR "invalid movie , movies should be name-year"
 
-static movie_entry get_movie(const std::string& movie_details)
+static sp_movie get_movie(const text_token& movie_details,
+	const recommender_system_p& rs)
 /**
- * a method for splitting movie_details
+ * a method for splitting movie_details then looking the movie up
  * @param movie_details
- * @return
+ * @param rs
+ * @return the movie of the system
  */
 {
-  // finding the separator index
-  size_t separator = movie_details.find(SEPARATOR);
-  // cutting the line and getting the name of the movie
-  std::string name = movie_details.substr(0, separator);
-  // converting the year number from string to integer
-  int year = std::stoi(movie_details.substr
-	(separator + 1, name.length() - (separator + 1)));
-  return movie_entry(name, year); // make it pair [name, year]
+  // finding the separator
+  const char* separator =
+      std::find(movie_details.begin, movie_details.end, SEPARATOR);
+  // cutting the token and getting the name of the movie
+  std::string name(movie_details.begin, separator);
+  // converting the year number to integer , like stoi
+  text_token year_token = movie_details;
+  if (separator != movie_details.end)
+  {
+    year_token.begin = separator + 1;
+  }
+  int year;
+  if (!parse_int(year_token, year))
+  {
+    throw std::runtime_error(MOVIE_ERR);
+  }
+  return rs->get_movie(name, year);
 }
 
-static std::vector<movie_entry> extract_movies(const std::string& movies_s)
+static std::vector<sp_movie> extract_movies(TextScanner& movies_s,
+	const recommender_system_p& rs)
 /**
  * extract movie details from the first line (name-year)
- * then adding it to a vector as pairs
- * each pair contain movie name and publish year
+ * then looking each movie up once for all the users
  * @param movies_s
- * @return
+ * @param rs
+ * @return the movies of the columns
  */
 {
-	std::vector<movie_entry> movies;
-	std::istringstream s_stream(movies_s);
-	std::string movie_details;
-	while (!s_stream.eof()) // while not reaching the end
+	std::vector<sp_movie> movies;
+	text_token movie_details;
+	while (movies_s.next_token(movie_details)) // while not reaching the end
 	{
-		s_stream >> movie_details;
-		movies.emplace_back(get_movie(movie_details)); // emplace after
-        // splitting merge them in pairs
+		movies.emplace_back(get_movie(movie_details, rs));
 	}
 	return movies;
 }
 
 
 static RSUser create_user
-(const std::string& user_data, const std::vector<movie_entry>& movies,
+(TextScanner& user_data, const std::vector<sp_movie>& movies,
 	recommender_system_p& rs)
 /**
  * after getting the first line in the input file , this method
  * get each user name and ranks then emplace them in rank_map
- * @param user_data
+ * @param user_data the line of the user
  * @param movies
  * @param rs
  * @return
  */
 {
 	rank_map rank_map(0, sp_movie_hash, sp_movie_equal);
-	std::istringstream line_stream(user_data);
-	std::string name, in;
+	text_token name, in;
 	double rank;
 
-	line_stream >> name;
-	for (size_t i = 0; i < movies.size(); ++i)
+	user_data.next_token(name);
+	for (size_t i = 0; i < movies.size() && user_data.next_token(in); ++i)
 	{
-		line_stream >> in;
-		if (in == NA) // only need ranked movies
+		if (in.equals(NA)) // only need ranked movies
 		{
 			continue;
 		}
-		rank = std::stod(in);
-      if (rank < MIN_RANK || rank > MAX_RANK) // checking valid rank
+      if (!parse_double(in, rank) || rank < MIN_RANK || rank > MAX_RANK)
       {
-        throw std::runtime_error(RANK_ERROR);
+        throw std::runtime_error(RANK_ERROR); // checking valid rank
       }
-		sp_movie movie =
-			rs->get_movie(movies[i].first, movies[i].second);
-
-		rank_map.emplace(movie, rank);
+		rank_map.emplace(movies[i], rank);
 
 	}
 
-	return RSUser(name, rank_map, rs);
+	return RSUser(name.str(), rank_map, rs);
 }
 
 
@@ -93,35 +96,35 @@ create_users_from_file(const std::string& users_file_path,
 	recommender_system_unique_p rs) noexcept(false)
 /**
  * reading an input file that contain the whole movies in the first line ,
- * then usernames with them ranks for them movies
+ * then usernames with them ranks for them movies . one pass over the
+ * mapped file without copying its lines or tokens
  * @param users_file_path
  * @param rs
  * @return
  */
 {
 	std::vector<RSUser> users;
-	std::ifstream input(users_file_path, std::ifstream::in);
-	std::string line;
-	std::istringstream line_stream;
-	std::vector<movie_entry> movies;
+	MappedFile input(users_file_path);
+	std::vector<sp_movie> movies;
 	recommender_system_p shared_rs = std::move(rs);
 	if (!input.is_open())
 	{
 		throw std::runtime_error(FILE_ERR); // valid path file
 	}
-	std::getline(input, line); // get the first line which is the movies
-	movies = extract_movies(line); // split the line [name-year]
-	while (!input.eof()) // while not reaching the end of the file
+	TextScanner text(input.begin(), input.end()), line(nullptr, nullptr);
+	if (text.next_line(line)) // get the first line which is the movies
+	{
+		movies = extract_movies(line, shared_rs); // split the line [name-year]
+	}
+	while (text.next_line(line)) // while not reaching the end of the file
 	{
-		std::vector<double> features;
-		std::string user;
-		std::getline(input, line); // get the first line
-		if (line.length() == 0) // if the line is empty -> skip it
+		TextScanner user = line;
+		text_token token;
+		if (!line.next_token(token)) // if the line is empty -> skip it
 		{
 			continue;
 		}
-		users.emplace_back(create_user(line, movies, shared_rs));
+		users.emplace_back(create_user(user, movies, shared_rs));
 	}
-	input.close(); // closing the file after reading it
 	return users;
 }
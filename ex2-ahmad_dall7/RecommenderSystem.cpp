@@ -1,5 +1,8 @@
 #include "RecommenderSystem.h"
-#include <math.h>
+#include "Parallel.h"
+#include "TopK.h"
+#include <cmath>
+#include <numeric>
 
 bool compare_function_map (const sp_movie &a, const sp_movie &b)
 /**
@@ -13,25 +16,45 @@ bool compare_function_map (const sp_movie &a, const sp_movie &b)
   return *a < *b;
 }
 
-static std::vector<double>
-get_movie_features (const std::map<sp_movie, std::vector<double>,
-    sp_movie_comapre_func> &movies, const sp_movie &movie)
-    /**
-     * getter method to get movie feature vector which allocated in movies map
-     *  via the sp_movie as a key .
-     * @param movies the rank map
-     * @param movie the sp_movie
-     * @return movie feature vector
-     */
-{
+// a movie of the system by its id , with a rank or a similarity
+typedef std::pair<movie_id, double> id_score;
 
-  return movies.find (movie)->second;
+// candidates a thread scores at once
+#define SCORE_CHUNK 256
+// scoring below this many multiplications is done on the calling thread ,
+// starting threads would cost more
+#define PARALLEL_WORK (1 << 18)
+// the largest table of similarities recommend_all_by_cf shares , 128 MB
+#define MAX_SHARED_SIMILARITIES (1 << 24)
+
+static std::vector<id_score>
+get_ranked_ids (const rank_map &ranks, const m_movies &movies)
+/**
+ * a function that looks the ranked movies up once , so the rest of the
+ * calculation works with their ids only .
+ * movies that are not in the system have no features and are skipped .
+ * @param ranks map that contain sp_movie as key and the rank as value
+ * @param movies
+ * @return ids and ranks of the ranked movies , in the order of ranks
+ */
+{
+  std::vector<id_score> ranked;
+  ranked.reserve (ranks.size ());
+  for (const auto &it: ranks)
+    {
+      auto movie = movies.find (it.first);
+      if (movie != movies.end ())
+        {
+          ranked.emplace_back (movie->second, it.second);
+        }
+    }
+  return ranked;
 }
 
-static double get_ranks_avg (const rank_map &ranks)
+static double get_ranks_avg (const std::vector<id_score> &ranks)
 /**
  * a function that return the average of ranked movies by the user
- * @param ranks map that contain sp_movie as key and the rank as value
+ * @param ranks ids and ranks of the ranked movies
  * @return the average of the ranks
  */
 {
@@ -45,14 +68,15 @@ static double get_ranks_avg (const rank_map &ranks)
 
 }
 
-static rank_map normalize_ranks (const rank_map &ranks)
+static std::vector<id_score> normalize_ranks (const std::vector<id_score>
+                                              &ranks)
 /**
  * a function to decrease movie rank by the rank average
- * @param ranks ranked movies map
+ * @param ranks ids and ranks of the ranked movies
  * @return the rank after the decreasing process
  */
 {
-  rank_map norm_ranks (ranks);
+  std::vector<id_score> norm_ranks (ranks);
   double ranks_avg = get_ranks_avg (norm_ranks);
   for (auto &it: norm_ranks)
     {
@@ -62,174 +86,218 @@ static rank_map normalize_ranks (const rank_map &ranks)
   return norm_ranks;
 }
 
-static void multiply_vector (std::vector<double> &vec, double val)
+static void
+add_scaled_features (std::vector<double> &vec, const double *features,
+                     double val)
 /**
- * a function to multiply vector elements by given value
+ * a function to add features multiplied by given value to a vector
  * @param vec the vector
+ * @param features vec.size() of them
  * @param val
  */
 {
-  for (auto &num: vec)
+  for (size_t i = 0; i < vec.size (); ++i)
     {
-      num *= val;
+      vec[i] += features[i] * val;
     }
 }
 
-static void
-add_to_vector (std::vector<double> &vec1, std::vector<double> &vec2)
+template<typename Similarity>
+static std::vector<std::pair<double, double>>
+get_most_similar_k_movies (movie_id movie,
+                           const std::vector<id_score> &ranks,
+                           Similarity similarity,
+                           int k)
 /**
- * a function to sum two given vectors
- * @param vec1
- * @param vec2
+ * a function that create a vector who contain pairs of the similarity
+ * and the rank of the must similar k movies , keeping only the best k
+ * while going over the ranked movies .
+ * @param movie
+ * @param ranks ids and ranks of the ranked movies
+ * @param similarity (movie , ranked movie) -> their similarity
+ * @param k any k , no more than ranks.size() movies are returned
+ * @return vector who contain pairs of the similarity and the rank , the
+ * must similar first
  */
 {
-  if (vec1.size () != vec2.size ()) // checking if they have the same size
-    {
-      return;
-    }
-
-  for (size_t i = 0; i < vec1.size (); ++i)
+  TopK<double> most_similar (k < 0 ? 0 : (size_t) k);
+  for (const auto &it: ranks)
     {
-      vec1[i] += vec2[i];
+      most_similar.push (similarity (movie, it.first), it.second);
     }
+  return most_similar.take ();
 }
 
-static double vector_norm (const std::vector<double> &vec)
+static std::vector<double>
+get_rank_of (const std::vector<id_score> &ranks,
+             const SimilarityIndex &index)
 /**
- * function that calculate vector norm
- * @param vec
- * @return sqrt of the vector inner product
+ * the ranks by id , for looking the neighbours of the index up
+ * @param ranks ids and ranks of the ranked movies
+ * @param index
+ * @return the rank of every movie of the index , NAN if it is unranked .
+ * empty if the index is not built
  */
 {
-  double sum_power2 = 0;
-  for (const auto &num: vec)
+  std::vector<double> rank_of;
+  if (index.built ())
     {
-      sum_power2 += pow (num, 2);
+      rank_of.assign (index.size (), NAN);
+      for (const auto &it: ranks)
+        {
+          if (it.first < index.size ())
+            {
+              rank_of[it.first] = it.second;
+            }
+        }
     }
-
-  return sqrt (sum_power2);
+  return rank_of;
 }
 
-static double
-scalar_multiply_vec (const std::vector<double> &vec1,
-                     const std::vector<double> &vec2)
+static bool
+predict_by_index (movie_id movie, size_t ranked,
+                  const std::vector<double> &rank_of,
+                  const SimilarityIndex &index, int k, double &prediction)
 /**
-* a function to calculate scalar_multiply of two vectors
-* @param vec1
-* @param vec2
-* @return sum of multiply each element in both vectors
-*/
+ * the prediction from the neighbours of the movie in the index : the first
+ * k ranked ones are the k must similar ranked movies , when the list has k
+ * ranked ones or has every movie .
+ * @param movie
+ * @param ranked the number of ranked movies
+ * @param rank_of get_rank_of the ranks
+ * @param index
+ * @param k
+ * @param prediction set when the index has the answer
+ * @return false if the full calculation is needed
+ */
 {
-  double result = 0;
-  if (vec1.size () == vec2.size ())
+  if (movie >= rank_of.size () || !std::isnan (rank_of[movie]))
+    {
+      return false; // a new movie , or a ranked one which is its own best
+    }
+  size_t wanted = k < 0 ? 0 : std::min ((size_t) k, ranked);
+  size_t found = 0;
+  double s_sim = 0, s_rank_sim = 0;
+  const neighbour *list = index.list (movie);
+  for (size_t i = 0; i < index.count (movie) && found < wanted; ++i)
     {
-      for (size_t i = 0; i < vec1.size (); ++i)
+      double rank = rank_of[list[i].id];
+      if (!std::isnan (rank))
         {
-          result += vec1[i] * vec2[i];
+          s_rank_sim += list[i].similarity * rank;
+          s_sim += list[i].similarity;
+          ++found;
         }
     }
-  return result;
-}
-
-static double
-get_vec_similarity (const std::vector<double> &vec1,
-                    const std::vector<double> &vec2)
-/**
-* the similarity process
-* @param vec1
-* @param vec2
-* @return the similarity of the two given vectors
-*/
-{
-  double norms_multiply = (vector_norm (vec1) * vector_norm (vec2));
-  return norms_multiply == 0 ? 0 : scalar_multiply_vec (vec1, vec2)
-                                   / norms_multiply; // return 0 if norm ==0
-                                   // to avoid zero divisor
+  if (found < wanted && !index.complete (movie))
+    {
+      return false;
+    }
+  prediction = s_sim == 0 ? 0 : s_rank_sim / s_sim; // avoiding zero divisor
+  return true;
 }
 
-static std::vector<std::pair<sp_movie, double>>
-get_most_similar_k_movies (const sp_movie &movie,
-                           const rank_map &ranks,
-                           const std::map<sp_movie,
-                               std::vector<double>,
-                               sp_movie_comapre_func> &movies,
-                           int k)
+template<typename Similarity>
+static double predict_score (movie_id movie,
+                             const std::vector<id_score> &ranks,
+                             const std::vector<double> &rank_of,
+                             Similarity similarity,
+                             const SimilarityIndex &index, int k)
 /**
- * a function that create a vector who contain pairs of movies details
- * and the similarity .
- * sorting the vector after creating it to get the must similar k movies .
+ * the prediction of predict_movie_score , by ids . from the index when it
+ * can , else from the similarity to every ranked movie
  * @param movie
- * @param ranks
- * @param movies
+ * @param ranks ids and ranks of the ranked movies
+ * @param rank_of get_rank_of the ranks
+ * @param similarity (movie , ranked movie) -> their similarity
+ * @param index
  * @param k
- * @return vector who contain pairs of movies details and the similarity
+ * @return the ranking prediction
  */
 {
-  std::vector<std::pair<sp_movie, double>> ranked_similarities;
-  std::vector<double> movie_features = get_movie_features (movies, movie);
-  for (const auto &it: ranks)
+  double prediction;
+  if (predict_by_index (movie, ranks.size (), rank_of, index, k, prediction))
     {
-      ranked_similarities.emplace_back (it.first, get_vec_similarity
-      (movie_features,get_movie_features (movies, it.first)));
+      return prediction;
     }
-
-  std::sort (ranked_similarities.begin (), ranked_similarities.end (),
-             [&] (const auto &a, const auto &b)
-             { return b.second < a.second; });
-  auto it = std::next (ranked_similarities.begin (), k);
-  return std::vector<std::pair<sp_movie, double>>
-      (ranked_similarities.begin (), it);
+  auto movies = get_most_similar_k_movies (movie, ranks, similarity, k);
+  double s_sim = 0, s_rank_sim = 0;
+  for (auto &it: movies) // the calculation
+    {
+      s_rank_sim += it.first * it.second;
+      s_sim += it.first;
+    }
+  return s_sim == 0 ? 0 : s_rank_sim / s_sim; // avoiding zero divisor
 }
 
-static std::vector<double> create_rc_vec (const rank_map &ranks,
-                                          const std::map<sp_movie,
-                                              std::vector<double>,
-                                              sp_movie_comapre_func> &movies)
+static std::vector<double> create_rc_vec (const std::vector<id_score> &ranks,
+                                          const MovieCatalog &catalog)
 /**
  * creating the recommended vector to compare it with the other movies
- * @param ranks
- * @param movies
+ * @param ranks ids and ranks of the ranked movies
+ * @param catalog
  * @return the normed recommendation_vector
  */
 {
-  rank_map norm_ranks = normalize_ranks (ranks);
-  std::vector<double> recommendation_vector;
+  std::vector<id_score> norm_ranks = normalize_ranks (ranks);
+  std::vector<double> recommendation_vector (catalog.dimensions (), 0);
 
   for (auto &it: norm_ranks)
     {
-      std::vector<double> movie_features (get_movie_features (movies,
-                                                              it.first));
-      multiply_vector (movie_features, it.second);
-      if (recommendation_vector.empty ()) // if it's empty then make it
-        {
-          recommendation_vector = movie_features;
-        }
-      else // add it to the vector after the normalize process
-        {
-          add_to_vector (recommendation_vector, movie_features);
-        }
+      // add it to the vector after the normalize process
+      add_scaled_features (recommendation_vector,
+                           catalog.features (it.first), it.second);
     }
   return recommendation_vector;
 }
 
-static std::vector<sp_movie> get_unranked_movies (const rank_map &ranks,
-                                                  const std::map<sp_movie,
-                                                 std::vector<double>,
-                                               sp_movie_comapre_func> &movies)
+static std::vector<bool>
+get_ranked (const std::vector<id_score> &ranks, size_t catalog_size)
+/**
+ * @param ranks ids and ranks of the ranked movies
+ * @param catalog_size
+ * @return for every id , whether it is ranked
+ */
+{
+  std::vector<bool> ranked (catalog_size, false);
+  for (const auto &it: ranks)
+    {
+      ranked[it.first] = true;
+    }
+  return ranked;
+}
+
+static std::vector<movie_id> get_movie_order (const m_movies &movies)
+/**
+ * @param movies
+ * @return the ids of movies , in the order of the map
+ */
+{
+  std::vector<movie_id> order;
+  order.reserve (movies.size ());
+  for (const auto &it: movies)
+    {
+      order.push_back (it.second);
+    }
+  return order;
+}
+
+static std::vector<movie_id>
+get_unranked_movies (const std::vector<bool> &ranked,
+                     const std::vector<movie_id> &order)
 /**
  * a function to get all unranked movies and emplace them in a vector
  * if the movie doesnt exist in movies map , then its unranked
  * because we added only movies with rank in UsersLoader .
- * @param ranks
- * @param movies
- * @return unranked movies vector
+ * @param ranked get_ranked of the ranks
+ * @param order get_movie_order of the movies map
+ * @return ids of the unranked movies , in the order of movies map
  */
 {
-  std::vector<sp_movie> new_movies;
-  for (const auto &it: movies)
+  std::vector<movie_id> new_movies;
+  for (movie_id movie: order)
     {
-      sp_movie movie = it.first;
-      if (ranks.find (movie) == ranks.end ())
+      if (!ranked[movie])
         {
           new_movies.emplace_back (movie);
         }
@@ -238,10 +306,127 @@ static std::vector<sp_movie> get_unranked_movies (const rank_map &ranks,
   return new_movies;
 }
 
-RecommenderSystem::RecommenderSystem () : rec_system (compare_function_map)
+template<typename Score>
+static std::vector<std::pair<double, movie_id>>
+best_candidates (const std::vector<movie_id> &candidates, size_t n,
+                 size_t work, unsigned threads, Score score)
+/**
+ * scoring the candidates , in chunks on all the threads when there is
+ * enough work . every chunk keeps its own n best , and the bests are
+ * merged in the order of the chunks , so the first of equal scores ranks
+ * higher like in a serial loop
+ * @param candidates
+ * @param n
+ * @param work multiplications to score one candidate
+ * @param threads for enough work , 0 means default_threads ()
+ * @param score candidate -> score , called from several threads
+ * @return the best candidates and their scores , the best first
+ */
+{
+  size_t chunks = (candidates.size () + SCORE_CHUNK - 1) / SCORE_CHUNK;
+  threads = candidates.size () * work < PARALLEL_WORK ? 1 : threads;
+  std::vector<std::vector<std::pair<double, movie_id>>> bests (chunks);
+  parallel_for (candidates.size (), threads, SCORE_CHUNK,
+                [&] (size_t begin, size_t end)
+                {
+                  TopK<movie_id> best (n);
+                  for (size_t i = begin; i < end; ++i)
+                    {
+                      best.push (score (candidates[i]), candidates[i]);
+                    }
+                  bests[begin / SCORE_CHUNK] = best.take ();
+                });
+  TopK<movie_id> best (n);
+  for (const auto &chunk: bests)
+    {
+      for (const auto &it: chunk)
+        {
+          best.push (it.first, it.second);
+        }
+    }
+  return best.take ();
+}
+
+static std::vector<std::pair<double, movie_id>>
+best_by_content (const std::vector<double> &recommendation_vector,
+                 const std::vector<bool> &ranked,
+                 const std::vector<movie_id> &order,
+                 const MovieCatalog &catalog, const IvfIndex &index,
+                 size_t n, unsigned threads)
+/**
+ * the movies of recommend_top_by_content , by ids
+ * @param recommendation_vector the preference of the user
+ * @param ranked get_ranked of the ranks
+ * @param order get_movie_order of the movies map
+ * @param catalog
+ * @param index the content index , searched exactly when it holds every
+ * movie of catalog with its features
+ * @param n
+ * @param threads
+ * @return the recommended movies and their similarities , the best first
+ */
+{
+  double recommendation_norm = vector_norm (recommendation_vector.data (),
+                                            recommendation_vector.size ());
+  if (index.built () && index.size () == catalog.size ()
+      && index.dimensions () == catalog.dimensions ())
+    {
+      // the same movie as the scan , without comparing with all of them
+      return index.search_exact (catalog, recommendation_vector.data (),
+                                 recommendation_norm, n, ranked);
+    }
+
+  // getting all unranked movies , the first of the must similar ones wins
+  auto new_movies = get_unranked_movies (ranked, order);
+  return best_candidates
+      (new_movies, n, catalog.dimensions (), threads, [&] (movie_id movie)
+      {
+        return get_vec_similarity (recommendation_vector.data (),
+                                   recommendation_norm,
+                                   catalog.features (movie),
+                                   catalog.norm (movie),
+                                   catalog.dimensions ());
+      });
+}
+
+template<typename Similarity>
+static std::vector<std::pair<double, movie_id>>
+best_by_cf (const std::vector<id_score> &ranks,
+            const std::vector<movie_id> &order, const MovieCatalog &catalog,
+            const SimilarityIndex &index, int k, size_t n, unsigned threads,
+            Similarity similarity)
+/**
+ * the movies of recommend_top_by_cf , by ids
+ * @param ranks ids and ranks of the ranked movies
+ * @param order get_movie_order of the movies map
+ * @param catalog
+ * @param index
+ * @param k
+ * @param n
+ * @param threads
+ * @param similarity (movie , ranked movie) -> their similarity
+ * @return the recommended movies and their predictions , the best first
+ */
+{
+  std::vector<double> rank_of = get_rank_of (ranks, index);
+  std::vector<movie_id> unranked_movies =
+      get_unranked_movies (get_ranked (ranks, catalog.size ()), order);
+  // getting the whole unranked movies , the first of the best predictions
+  // wins . without the index every prediction compares with all the ranked
+  // movies
+  size_t work = ranks.size () * catalog.dimensions ();
+  return best_candidates (unranked_movies, n, work, threads,
+                          [&] (movie_id movie)
+                          {
+                            return predict_score (movie, ranks, rank_of,
+                                                  similarity, index, k);
+                          });
+}
+
+RecommenderSystem::RecommenderSystem ()
 /**
- * constructor for the RecommenderSystem class , with adding the compare
- * function in it.
+ * constructor for the RecommenderSystem class , movie_order compares the
+ * movies of the map .
  */
 {
 }
@@ -255,11 +440,25 @@ RecommenderSystem::add_movie (const std::string &name, int year,
  * @param name
  * @param year
  * @param features
- * @return the sp_move after making it shared
+ * @return the sp_move after making it shared , or the one already in the
+ * system
  */
 {
-  sp_movie movie = std::make_shared<Movie> (name, year);
-  rec_system.emplace (movie, features);
+  sp_movie movie = get_movie (name, year);
+  if (movie == nullptr)
+    {
+      movie = std::make_shared<Movie> (name, year);
+      movie_id id = catalog.add (movie, features);
+      rec_system.emplace (movie, id);
+      if (similarity_index.built ())
+        {
+          similarity_index.add (catalog, id);
+        }
+      if (content_index.built ())
+        {
+          content_index.add (catalog, id);
+        }
+    }
 
   for (auto &it: rec_system)
     {
@@ -269,6 +468,76 @@ RecommenderSystem::add_movie (const std::string &name, int year,
   return movie;
 }
 
+std::vector<sp_movie>
+RecommenderSystem::add_movies (const std::vector<movie_record> &records)
+/**
+ * sorting the records by movie order , then inserting each one with the
+ * position of the previous one as a hint , which costs O(1) per movie when
+ * it belongs right after it .
+ * @param records
+ * @return the movies in the system , in the order of records
+ */
+{
+  std::vector<sp_movie> movies;
+  movies.reserve (records.size ());
+  size_t dimensions = catalog.size () != 0 || records.empty ()
+                      ? catalog.dimensions () : records[0].features.size ();
+  for (const auto &record: records)
+    {
+      // checking all of them , so a bad record throws before adding anything
+      if (record.features.size () != dimensions)
+        {
+          throw std::runtime_error (FEATURES_SIZE_ERR);
+        }
+      movies.emplace_back (std::make_shared<Movie> (record.name, record.year));
+    }
+  catalog.reserve (catalog.size () + records.size ());
+  std::vector<size_t> order (records.size ());
+  std::iota (order.begin (), order.end (), 0);
+  auto older = [&] (size_t a, size_t b)
+  { return *movies[a] < *movies[b]; };
+  // stable , so the first of two equal records is inserted first and wins
+  if (!std::is_sorted (order.begin (), order.end (), older))
+    {
+      std::stable_sort (order.begin (), order.end (), older);
+    }
+
+  auto hint = rec_system.begin ();
+  for (size_t i: order)
+    {
+      const Movie &movie = *movies[i];
+      // hint must be the first movie not older than this one , it usually
+      // already is : the movie right after the previous record
+      if ((hint != rec_system.begin () && !(*std::prev (hint)->first < movie))
+          || (hint != rec_system.end () && *hint->first < movie))
+        {
+          hint = rec_system.lower_bound (movies[i]);
+        }
+      if (hint != rec_system.end () && !(movie < *hint->first))
+        {
+          movies[i] = hint->first; // already in the system
+          continue;
+        }
+      hint = std::next (rec_system.emplace_hint
+          (hint, movies[i], catalog.add (movies[i], records[i].features)));
+    }
+  if (similarity_index.built ())
+    {
+      for (size_t id = similarity_index.size (); id < catalog.size (); ++id)
+        {
+          similarity_index.add (catalog, (movie_id) id);
+        }
+    }
+  if (content_index.built ())
+    {
+      for (size_t id = content_index.size (); id < catalog.size (); ++id)
+        {
+          content_index.add (catalog, (movie_id) id);
+        }
+    }
+  return movies;
+}
+
 sp_movie RecommenderSystem::get_movie (const std::string &name, int year) const
 /**
  * getter method that return movie details
@@ -277,10 +546,78 @@ sp_movie RecommenderSystem::get_movie (const std::string &name, int year) const
  * @return movie details
  */
 {
-  auto it = rec_system.find (std::make_shared<Movie> (name, year));
+  auto it = rec_system.find (movie_key{name, year}); // no Movie to build
   return it == rec_system.end () ? nullptr : it->first; // if it's no exist
   // return null , else return the movie details .
 }
+void RecommenderSystem::add_to_profile (user_profile &profile,
+                                        const sp_movie &movie,
+                                        double rank) const
+/**
+ * adding the rank and the features of the movie to the sums , the first
+ * movie makes them sums of this system . when the mean moves by d , every
+ * rank already in preference moves by -d , which is -d * features . ranks
+ * that are all equal keep the mean and a zero preference exactly
+ * @param profile
+ * @param movie
+ * @param rank
+ */
+{
+  auto it = rec_system.find (movie);
+  if (it == rec_system.end () || (profile.system != nullptr
+                                  && profile.system != this))
+    {
+      ++profile.missing;
+      return;
+    }
+  if (profile.system == nullptr)
+    {
+      profile.system = this;
+      profile.preference.assign (catalog.dimensions (), 0);
+      profile.features.assign (catalog.dimensions (), 0);
+    }
+  const double *features = catalog.features (it->second);
+  double mean = profile.rank_mean
+                + (rank - profile.rank_mean) / (double) (profile.count + 1);
+  profile.ids.push_back (it->second);
+  add_scaled_features (profile.preference, profile.features.data (),
+                       profile.rank_mean - mean);
+  add_scaled_features (profile.preference, features, rank - mean);
+  add_scaled_features (profile.features, features, 1);
+  profile.rank_mean = mean;
+  ++profile.count;
+}
+
+std::vector<double>
+RecommenderSystem::get_preference (const RSUser &user,
+                                   std::vector<bool> &ranked) const
+/**
+ * the preference vector of create_rc_vec , from the profile of the user in
+ * O(features) when it has all of its ranks in this system , else from the
+ * ranks
+ * @param user
+ * @param ranked set to get_ranked of the ranks
+ * @return the preference vector
+ */
+{
+  const user_profile &profile = user.get_profile ();
+  if (profile.missing != 0 || profile.count != user.get_ranks ().size ()
+      || (profile.count != 0 && profile.system != this))
+    {
+      std::vector<id_score> ranks = get_ranked_ids (user.get_ranks (),
+                                                    rec_system);
+      ranked = get_ranked (ranks, catalog.size ());
+      return create_rc_vec (ranks, catalog); // normalize the vector
+    }
+  ranked.assign (catalog.size (), false);
+  for (movie_id id: profile.ids)
+    {
+      ranked[id] = true;
+    }
+  return profile.count != 0 ? profile.preference
+                            : std::vector<double> (catalog.dimensions (), 0);
+}
+
 sp_movie RecommenderSystem::recommend_by_content (const RSUser &user)
 /**
  * getting the recommended movie by content calculation
@@ -288,28 +625,36 @@ sp_movie RecommenderSystem::recommend_by_content (const RSUser &user)
  * @return the recommended movie
  */
 {
-  sp_movie recommended_movie = nullptr;
-  double max_similarity = -1;
-  std::vector<double> recommendation_vector = create_rc_vec
-      (user.get_ranks (), rec_system); // normalize the vector
+  std::vector<bool> ranked;
+  std::vector<double> recommendation_vector = get_preference (user, ranked);
+  auto best = best_by_content (recommendation_vector, ranked,
+                               get_movie_order (rec_system), catalog,
+                               content_index, 1, threads);
+  return best.empty () ? nullptr : catalog.movie (best[0].second);
+}
 
-  // getting all unranked movies
-  auto new_movies = get_unranked_movies (user.get_ranks (),
-                                         rec_system);
-  for (auto &movie: new_movies)
+sp_movie RecommenderSystem::recommend_by_content_approximate
+    (const RSUser &user, size_t probes)
+/**
+ * the recommend_by_content calculation , comparing only with the movies of
+ * the nearest lists of the content index
+ * @param user
+ * @param probes
+ * @return the recommended movie
+ */
+{
+  if (!content_index.built ())
     {
-      double similarity = get_vec_similarity
-          (recommendation_vector,
-           get_movie_features (rec_system, movie));
-      // if it is greater than the last movie make it the required movie
-      // and place the max_similarly to continue compare process
-      if (similarity > max_similarity)
-        {
-          recommended_movie = movie;
-          max_similarity = similarity;
-        }
+      return recommend_by_content (user);
     }
-  return recommended_movie;
+  std::vector<bool> ranked;
+  std::vector<double> recommendation_vector = get_preference (user, ranked);
+  auto best = content_index.search
+      (catalog, recommendation_vector.data (),
+       vector_norm (recommendation_vector.data (),
+                    recommendation_vector.size ()),
+       1, probes, ranked);
+  return best.empty () ? nullptr : catalog.movie (best[0].second);
 }
 
 double
@@ -323,16 +668,19 @@ RecommenderSystem::predict_movie_score
  * @return the ranking prediction
  */
 {
-  auto ranks = user.get_ranks ();
-  auto movies = get_most_similar_k_movies (movie,
-                                           ranks, rec_system, k);
-  double s_sim = 0, s_rank_sim = 0;
-  for (auto &it: movies) // the calculation
+  auto it = rec_system.find (movie);
+  if (it == rec_system.end ()) // a movie without features
     {
-      s_rank_sim += it.second * ranks.find (it.first)->second;
-      s_sim += it.second;
+      return 0;
     }
-  return s_sim == 0 ? 0 : s_rank_sim / s_sim; // avoiding zero divisor
+  std::vector<id_score> ranks = get_ranked_ids (user.get_ranks (),
+                                                rec_system);
+  return predict_score (it->second, ranks,
+                        get_rank_of (ranks, similarity_index),
+                        [this] (movie_id a, movie_id b)
+                        {
+                          return catalog.similarity (a, b);
+                        }, similarity_index, k);
 }
 
 
@@ -344,24 +692,206 @@ sp_movie RecommenderSystem::recommend_by_cf (const RSUser &user, int k)
  * @return recommended movie
  */
 {
-  sp_movie result = nullptr;
-  double max_pred = -1;
-  std::vector<sp_movie> unranked_movies =
-      get_unranked_movies (user.get_ranks(), rec_system);
-  // getting the whole unranked movies
-  for (auto &movie: unranked_movies)
+  std::vector<id_score> ranks = get_ranked_ids (user.get_ranks (),
+                                                rec_system);
+  auto best = best_by_cf (ranks, get_movie_order (rec_system), catalog,
+                          similarity_index, k, 1, threads,
+                          [this] (movie_id a, movie_id b)
+                          {
+                            return catalog.similarity (a, b);
+                          });
+  return best.empty () ? nullptr : catalog.movie (best[0].second);
+}
+
+static std::vector<scored_movie>
+get_scored_movies (const std::vector<std::pair<double, movie_id>> &best,
+                   const MovieCatalog &catalog)
+/**
+ * @param best ids and scores
+ * @param catalog
+ * @return the movies of the ids and their scores , in the same order
+ */
+{
+  std::vector<scored_movie> movies;
+  movies.reserve (best.size ());
+  for (const auto &it: best)
+    {
+      movies.emplace_back (catalog.movie (it.second), it.first);
+    }
+  return movies;
+}
+
+std::vector<scored_movie>
+RecommenderSystem::recommend_top_by_content (const RSUser &user, size_t n)
+/**
+ * the recommend_by_content calculation , keeping the n best
+ * @param user
+ * @param n
+ * @return the recommended movies and their similarities
+ */
+{
+  std::vector<bool> ranked;
+  std::vector<double> recommendation_vector = get_preference (user, ranked);
+  return get_scored_movies (best_by_content (recommendation_vector, ranked,
+                                             get_movie_order (rec_system),
+                                             catalog, content_index, n,
+                                             threads), catalog);
+}
+
+std::vector<scored_movie>
+RecommenderSystem::recommend_top_by_cf (const RSUser &user, int k, size_t n)
+/**
+ * the recommend_by_cf calculation , keeping the n best
+ * @param user
+ * @param k
+ * @param n
+ * @return the recommended movies and their predictions
+ */
+{
+  std::vector<id_score> ranks = get_ranked_ids (user.get_ranks (),
+                                                rec_system);
+  return get_scored_movies (best_by_cf (ranks, get_movie_order (rec_system),
+                                        catalog, similarity_index, k, n,
+                                        threads,
+                                        [this] (movie_id a, movie_id b)
+                                        {
+                                          return catalog.similarity (a, b);
+                                        }), catalog);
+}
+
+std::vector<sp_movie>
+RecommenderSystem::recommend_all_by_content (const std::vector<RSUser> &users)
+/**
+ * the users on the threads , every one scored on its thread alone
+ * @param users
+ * @return the recommended movies , in the order of users
+ */
+{
+  std::vector<movie_id> order = get_movie_order (rec_system);
+  std::vector<sp_movie> recommended (users.size ());
+  parallel_for (users.size (), threads, 1, [&] (size_t begin, size_t end)
+  {
+    for (size_t u = begin; u < end; ++u)
+      {
+        std::vector<bool> ranked;
+        std::vector<double> recommendation_vector = get_preference
+            (users[u], ranked);
+        auto best = best_by_content (recommendation_vector, ranked, order,
+                                     catalog, content_index, 1, 1);
+        recommended[u] = best.empty () ? nullptr
+                                       : catalog.movie (best[0].second);
+      }
+  });
+  return recommended;
+}
+
+std::vector<sp_movie>
+RecommenderSystem::recommend_all_by_cf (const std::vector<RSUser> &users,
+                                        int k)
+/**
+ * the users share the similarities of every movie to the movies any of
+ * them ranked , a table of movies x ranked columns calculated once in
+ * parallel , instead of one similarity per user and pair . it is skipped
+ * with the similarity index , which answers most predictions , and when
+ * it is larger than MAX_SHARED_SIMILARITIES . then the users go on the
+ * threads , every one scored on its thread alone
+ * @param users
+ * @param k
+ * @return the recommended movies , in the order of users
+ */
+{
+  std::vector<movie_id> order = get_movie_order (rec_system);
+  std::vector<std::vector<id_score>> ranks;
+  std::vector<size_t> column (catalog.size (), SIZE_MAX);
+  std::vector<movie_id> columns; // the movies ranked by any user
+  for (const RSUser &user: users)
     {
-      double prediction = predict_movie_score (user, movie, k);
-      // checking if the predication greater than the last one
-      // then make it the required movie and place the max_prediction
-      // to continue compare process
-      if (prediction > max_pred)
+      ranks.push_back (get_ranked_ids (user.get_ranks (), rec_system));
+      for (const auto &it: ranks.back ())
         {
-          result = movie;
-          max_pred = prediction;
+          if (column[it.first] == SIZE_MAX)
+            {
+              column[it.first] = columns.size ();
+              columns.push_back (it.first);
+            }
         }
     }
-  return result;
+
+  std::vector<double> shared;
+  if (!similarity_index.built ()
+      && catalog.size () * columns.size () <= MAX_SHARED_SIMILARITIES)
+    {
+      shared.resize (catalog.size () * columns.size ());
+      parallel_for (catalog.size (), threads, DEFAULT_CHUNK,
+                    [&] (size_t begin, size_t end)
+                    {
+                      for (size_t movie = begin; movie < end; ++movie)
+                        {
+                          for (size_t c = 0; c < columns.size (); ++c)
+                            {
+                              shared[movie * columns.size () + c] =
+                                  catalog.similarity ((movie_id) movie,
+                                                      columns[c]);
+                            }
+                        }
+                    });
+    }
+
+  std::vector<sp_movie> recommended (users.size ());
+  parallel_for (users.size (), threads, 1, [&] (size_t begin, size_t end)
+  {
+    for (size_t u = begin; u < end; ++u)
+      {
+        std::vector<std::pair<double, movie_id>> best;
+        if (shared.empty ())
+          {
+            best = best_by_cf (ranks[u], order, catalog, similarity_index, k,
+                               1, 1, [this] (movie_id a, movie_id b)
+                               {
+                                 return catalog.similarity (a, b);
+                               });
+          }
+        else
+          {
+            best = best_by_cf (ranks[u], order, catalog, similarity_index, k,
+                               1, 1, [&] (movie_id a, movie_id b)
+                               {
+                                 return shared[a * columns.size ()
+                                               + column[b]];
+                               });
+          }
+        recommended[u] = best.empty () ? nullptr
+                                       : catalog.movie (best[0].second);
+      }
+  });
+  return recommended;
+}
+
+void RecommenderSystem::build_similarity_index (size_t neighbours,
+                                                unsigned threads)
+/**
+ * building the index of the movies in the system , add_movie and
+ * add_movies keep it up to date after that
+ * @param neighbours
+ * @param threads
+ */
+{
+  similarity_index.build (catalog, neighbours, threads);
+}
+
+void RecommenderSystem::build_content_index (const ivf_config &config)
+/**
+ * building the content index of the movies in the system , add_movie and
+ * add_movies add the next movies to it
+ * @param config
+ */
+{
+  content_index.build (catalog, config);
+}
+
+void RecommenderSystem::set_threads (unsigned threads)
+{
+  this->threads = threads;
 }
 
 std::ostream &operator<< (std::ostream &out, const RecommenderSystem &rs)
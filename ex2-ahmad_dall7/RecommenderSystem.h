@@ -5,18 +5,46 @@
 #ifndef SCHOOL_SOLUTION_RECOMMENDERSYSTEM_H
 #define SCHOOL_SOLUTION_RECOMMENDERSYSTEM_H
 #include "RSUser.h"
+#include "MovieCatalog.h"
+#include "IvfIndex.h"
+#include "SimilarityIndex.h"
 #include <map>
 
 typedef bool(*sp_movie_comapre_func) (const sp_movie& a, const sp_movie& b);
 bool compare_function_map(const sp_movie& a, const sp_movie& b);
-typedef std::map<sp_movie, std::vector<double>, sp_movie_comapre_func>
+// the movies in order , with their id in the catalog . movie_order finds
+// a movie by a movie_key too , without building a Movie
+typedef std::map<sp_movie, movie_id, movie_order>
 m_movies;
 
+/**
+ * one movie of a catalog , as the loaders read it
+ */
+typedef struct movie_record
+{
+    std::string name;
+    int year;
+    std::vector<double> features;
+} movie_record;
+
+/**
+ * a recommended movie and its score , a similarity or a predicted rank
+ */
+typedef std::pair<sp_movie, double> scored_movie;
+
 class RecommenderSystem
 {
 
 private:
     m_movies rec_system;
+    MovieCatalog catalog;
+    SimilarityIndex similarity_index;
+    IvfIndex content_index;
+    // the recommendations score on , 0 means all the hardware threads
+    unsigned threads = 0;
+
+    std::vector<double> get_preference(const RSUser& user,
+        std::vector<bool>& ranked) const;
 
 public:
 
@@ -28,22 +56,63 @@ public:
    * @param year year it was made
    * @param features features for movie
    * @return shared pointer for movie in system
+   * @throw std::runtime_error if it has a different number of features than
+   * the movies in the system
    */
     sp_movie add_movie(const std::string& name, int year,
         const std::vector<double>& features);
 
+    /**
+     * adds a whole catalog at once , without printing anything.
+     * the records are sorted once and inserted in order , so n movies cost
+     * O(n log n) , or O(n) when they are already sorted.
+     * a movie that is already in the system (or repeated in records) keeps
+     * its first features , like add_movie.
+     * @param records movies to add
+     * @return shared pointers to the movies in the system , in the order of
+     * records
+     * @throw std::runtime_error , before adding anything , if the records
+     * have different numbers of features
+     */
+    std::vector<sp_movie> add_movies(const std::vector<movie_record>& records);
+
 
     /**
      * a function that calculates the movie with highest score based on movie
-     * features
+     * features , scoring many candidates on several threads . with a
+     * content index the lists that can not hold it are skipped , the movie
+     * is still exactly the one of the full scan
      * @param ranks user ranking to use for algorithm
      * @return shared pointer to movie in system
      */
     sp_movie recommend_by_content(const RSUser& user);
 
+    /**
+     * recommend_by_content through the content index , comparing with the
+     * movies of the probes lists nearest to the user instead of all of
+     * them . it is usually the same movie , more probes make it more likely
+     * and slower . without an index it is recommend_by_content.
+     * @param user
+     * @param probes
+     * @return shared pointer to movie in system
+     */
+    sp_movie recommend_by_content_approximate(const RSUser& user,
+        size_t probes = DEFAULT_PROBES);
+
+    /**
+     * adds a ranked movie to the sums of a user , O(features) . a movie that
+     * is not in the system only counts as missing , the recommendations
+     * calculate the preference of such a user from all of its ranks
+     * @param profile of the user , of this system or of none
+     * @param movie
+     * @param rank
+     */
+    void add_to_profile(user_profile& profile, const sp_movie& movie,
+        double rank) const;
+
     /**
      * a function that calculates the movie with highest predicted score based
-     * on ranking of other movies
+     * on ranking of other movies , scoring many candidates on several threads
      * @param ranks user ranking to use for algorithm
      * @param k
      * @return shared pointer to movie in system
@@ -51,6 +120,49 @@ public:
     sp_movie recommend_by_cf(const RSUser& user, int k);
 
 
+    /**
+     * the n best movies of the recommend_by_content calculation , in one
+     * pass
+     * @param user
+     * @param n
+     * @return the movies and their similarities to the user , the best
+     * first and of equal ones the first in the order of the movies . fewer
+     * than n if there are fewer unranked movies
+     */
+    std::vector<scored_movie> recommend_top_by_content(const RSUser& user,
+        size_t n);
+
+    /**
+     * the n best movies of the recommend_by_cf calculation , in one pass
+     * @param user
+     * @param k
+     * @param n
+     * @return the movies and their predicted ranks , the best first and of
+     * equal ones the first in the order of the movies . fewer than n if
+     * there are fewer unranked movies
+     */
+    std::vector<scored_movie> recommend_top_by_cf(const RSUser& user, int k,
+        size_t n);
+
+    /**
+     * recommend_by_content of every user , the users on several threads
+     * @param users
+     * @return the recommended movies , in the order of users
+     */
+    std::vector<sp_movie> recommend_all_by_content(
+        const std::vector<RSUser>& users);
+
+    /**
+     * recommend_by_cf of every user , the users on several threads . the
+     * users share the similarities of the movies to the ones they ranked ,
+     * so a batch costs less than calling recommend_by_cf for each
+     * @param users like RSUsersLoader creates them
+     * @param k
+     * @return the recommended movies , in the order of users
+     */
+    std::vector<sp_movie> recommend_all_by_cf(const std::vector<RSUser>& users,
+        int k);
+
     /**
      * Predict a user rating for a movie given argument using item cf procedure
      * with k most similar movies.
@@ -71,6 +183,36 @@ public:
      */
     sp_movie get_movie(const std::string& name, int year) const;
 
+    /**
+     * builds the item item similarity index : the neighbours most similar
+     * movies of every movie , so cf predictions look the most similar
+     * ranked movies up instead of comparing with all of them . a prediction
+     * the list of a movie can not answer (the user ranked less than k of
+     * its neighbours) is calculated in full , so the results do not change
+     * , except for the order of equal similarities.
+     * building costs O(movies^2) similarities , on threads threads . after
+     * it every added movie costs O(movies).
+     * @param neighbours the length of the lists
+     * @param threads 0 means all the hardware threads
+     */
+    void build_similarity_index(size_t neighbours, unsigned threads = 0);
+
+    /**
+     * builds the content index of recommend_by_content_approximate and of
+     * the exact recommend_by_content , an IvfIndex of the movie features .
+     * later movies are added to the list of their nearest centroid
+     * @param config
+     */
+    void build_content_index(const ivf_config& config = ivf_config());
+
+    /**
+     * sets the threads recommend_by_content and recommend_by_cf score the
+     * candidates on , when there are enough of them . the recommendations
+     * do not depend on it
+     * @param threads 0 means all the hardware threads
+     */
+    void set_threads(unsigned threads);
+
     friend std::ostream& operator<<
         (std::ostream& out, const RecommenderSystem& rs);
 
@@ -1,76 +1,78 @@
 #include "RecommenderSystemLoader.h"
-#include <fstream>
-#include <sstream>
+#include "TextScanner.h"
+#include <algorithm>
 
 
 
-static void add_movie
-(const recommender_system_unique_p& rs, const std::string& movie_details,
-	const std::vector<double>& features)
+static movie_record make_record
+(const text_token& movie_details, std::vector<double>& features)
 /**
- * a method for splitting movie_details which it's the rest of the line
- * we get in the input file , then adding it's details
- * for the recommended system
- * @param rs
+ * a method for splitting movie_details which it's the first token of the
+ * line we get in the input file , then building the movie record of the line
  * @param movie_details
- * @param features
+ * @param features moved into the record
+ * @return the movie record
  */
 {
-  // finding the separator index
-  size_t separator = movie_details.find(SEPARATOR);
-  // cutting the line and getting the name of the movie
-  std::string name = movie_details.substr(0, separator);
-  // converting the year number from string to integer
-  int year =
-      atoi(movie_details.substr(separator + 1,
-          name.length() - (separator + 1)).c_str());
-  // adding all of the details for the recommendation system
-  rs->add_movie(name, year, features);
+  // finding the separator
+  const char* separator =
+      std::find(movie_details.begin, movie_details.end, SEPARATOR);
+  // cutting the token and getting the name of the movie
+  std::string name(movie_details.begin, separator);
+  // converting the year number to integer , like atoi
+  text_token year_token = movie_details;
+  if (separator != movie_details.end)
+  {
+    year_token.begin = separator + 1;
+  }
+  int year;
+  parse_int(year_token, year);
+  return movie_record{name, year, std::move(features)};
 }
 
 
 recommender_system_unique_p RecommenderSystemLoader::create_rs_from_movies_file
 (const std::string& movies_file_path) noexcept(false)
 /**
- * reading the given input file and adding the information to the system
+ * reading the given input file and adding the information to the system ,
+ * in one pass over the mapped file without copying its lines or tokens
  * @param movies_file_path
  * @return the recommendation system after adding the information
  */
 {
 	recommender_system_unique_p rs = std::make_unique<RecommenderSystem>();
-	std::ifstream input(movies_file_path, std::ifstream::in);
-	std::string line;
-	std::istringstream line_stream;
+	std::vector<movie_record> records;
+	MappedFile input(movies_file_path);
 
 	if (!input.is_open())
 	{
 		throw std::runtime_error(FILE_ERR); // invalid file path
 	}
-	while (!input.eof()) // while we are not at END OF FILE
+	TextScanner text(input.begin(), input.end()), line(nullptr, nullptr);
+	size_t features_size = 0;
+	while (text.next_line(line)) // while we are not at END OF FILE
 	{
-		std::vector<double> features;
-		std::string move_details;
-		std::getline(input, line); // getting the first line
-		if (line.length() == 0) // it might be empty file !
+		text_token move_details, token;
+		if (!line.next_token(move_details)) // it might be empty file !
 		{
 			continue;
 		}
-		line_stream = std::istringstream(line);
-		line_stream >> move_details;
-		while (!line_stream.eof())
+		std::vector<double> features;
+		features.reserve(features_size); // like the previous movie
+		while (line.next_token(token))
 		{
 			double feature;
-			line_stream >> feature;
-            if (feature < MIN_MOVIE_FEATURE || feature > MAX_MOVIE_FEATURE)
+            if (!parse_double(token, feature)
+                || feature < MIN_MOVIE_FEATURE || feature > MAX_MOVIE_FEATURE)
             {
               throw std::runtime_error(FEATURE_ERR); // invalid movie
               // feature (should between 1 - 10)
             }
 			features.push_back(feature); // adding it to the features victor
 		}
-		add_movie(rs, move_details, features); // add all the
-        // information to the system
+		features_size = features.size();
+		records.push_back(make_record(move_details, features));
 	}
-	input.close(); // closing the file after reading all of it
+	rs->add_movies(records); // one sorted insert , no printing
 	return rs;
 }
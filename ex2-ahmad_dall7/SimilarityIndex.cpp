@@ -0,0 +1,120 @@
+#include "SimilarityIndex.h"
+#include "Parallel.h"
+#include "TopK.h"
+
+// movies a thread indexes at once , every one compares with all the others
+#define BUILD_CHUNK 16
+
+static size_t
+most_similar (const MovieCatalog &catalog, movie_id id, size_t movies,
+              size_t neighbours, neighbour *list)
+/**
+ * writing the list of a movie , the movies are pushed by id so the lower
+ * id wins between equal similarities
+ * @param catalog
+ * @param id
+ * @param movies compared with the first movies of the catalog
+ * @param neighbours
+ * @param list room for neighbours of them
+ * @return the number of neighbours written
+ */
+{
+  TopK<movie_id> top (neighbours);
+  for (movie_id other = 0; other < movies; ++other)
+    {
+      if (other != id)
+        {
+          top.push (catalog.similarity (id, other), other);
+        }
+    }
+  auto best = top.take ();
+  for (size_t i = 0; i < best.size (); ++i)
+    {
+      list[i] = neighbour{best[i].first, best[i].second};
+    }
+  return best.size ();
+}
+
+void SimilarityIndex::build (const MovieCatalog &catalog, size_t neighbours,
+                             unsigned threads)
+/**
+ * every thread writes the lists of its own movies
+ * @param catalog
+ * @param neighbours
+ * @param threads
+ */
+{
+  size_t movies = catalog.size ();
+  m_neighbours = std::max ((size_t) 1, neighbours);
+  m_lists.assign (movies * m_neighbours, neighbour{0, 0});
+  m_counts.assign (movies, 0);
+  parallel_for (movies, threads, BUILD_CHUNK, [&] (size_t begin, size_t end)
+  {
+    for (size_t id = begin; id < end; ++id)
+      {
+        m_counts[id] = most_similar (catalog, (movie_id) id, movies,
+                                     m_neighbours,
+                                     &m_lists[id * m_neighbours]);
+      }
+  });
+}
+
+void SimilarityIndex::add (const MovieCatalog &catalog, movie_id id)
+/**
+ * the new movie has the highest id , so it goes into a list only when it
+ * is more similar than the last neighbour , or the list is not full
+ * @param catalog
+ * @param id
+ */
+{
+  size_t movies = m_counts.size ();
+  m_lists.resize ((movies + 1) * m_neighbours, neighbour{0, 0});
+  m_counts.push_back (most_similar (catalog, id, movies, m_neighbours,
+                                    &m_lists[movies * m_neighbours]));
+  for (movie_id other = 0; other < movies; ++other)
+    {
+      double similarity = catalog.similarity (other, id);
+      neighbour *list = &m_lists[other * m_neighbours];
+      size_t &count = m_counts[other];
+      if (count == m_neighbours && !(similarity > list[count - 1].similarity))
+        {
+          continue;
+        }
+      size_t i = count < m_neighbours ? count++ : count - 1;
+      for (; i > 0 && similarity > list[i - 1].similarity; --i)
+        {
+          list[i] = list[i - 1];
+        }
+      list[i] = neighbour{similarity, id};
+    }
+}
+
+bool SimilarityIndex::built () const
+{
+  return m_neighbours != 0;
+}
+
+size_t SimilarityIndex::size () const
+{
+  return m_counts.size ();
+}
+
+size_t SimilarityIndex::neighbours () const
+{
+  return m_neighbours;
+}
+
+const neighbour *SimilarityIndex::list (movie_id id) const
+{
+  return &m_lists[(size_t) id * m_neighbours];
+}
+
+size_t SimilarityIndex::count (movie_id id) const
+{
+  return m_counts[id];
+}
+
+bool SimilarityIndex::complete (movie_id id) const
+{
+  return m_counts[id] + 1 == m_counts.size ();
+}
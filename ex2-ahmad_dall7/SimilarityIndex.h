@@ -0,0 +1,76 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+
+#include "MovieCatalog.h"
+
+/**
+ * a neighbour of a movie in the similarity index
+ */
+typedef struct neighbour
+{
+    double similarity;
+    movie_id id;
+} neighbour;
+
+/**
+ * the item item similarity index of a catalog : for every movie , its m
+ * most similar other movies , the most similar first and the lower id first
+ * of equal ones . the lists are rows of one matrix , list(id) has
+ * count(id) neighbours.
+ * a list with all the other movies of the catalog is complete , any movie
+ * that is not in an incomplete list is no more similar than its last one.
+ */
+class SimilarityIndex
+{
+ public:
+  /**
+   * an index of no movies , not built
+   */
+  SimilarityIndex () = default;
+
+  /**
+   * builds the index of every movie in catalog , the movies in parallel
+   * @param catalog
+   * @param neighbours m , the length of the lists
+   * @param threads 0 means default_threads ()
+   */
+  void build (const MovieCatalog &catalog, size_t neighbours,
+              unsigned threads = 0);
+
+  /**
+   * adds the next movie of catalog : its own list , and the movie to the
+   * lists it belongs in . O(movies * (features + m))
+   * @param catalog the catalog the index was built from , with id its
+   * movie right after the ones in the index
+   * @param id
+   */
+  void add (const MovieCatalog &catalog, movie_id id);
+
+  /**
+   * @return whether build was called
+   */
+  bool built () const;
+
+  /**
+   * @return the number of movies in the index
+   */
+  size_t size () const;
+
+  size_t neighbours () const;
+
+  const neighbour *list (movie_id id) const;
+
+  size_t count (movie_id id) const;
+
+  /**
+   * @return whether the list of id has every other movie
+   */
+  bool complete (movie_id id) const;
+
+ private:
+  size_t m_neighbours = 0;
+  std::vector<neighbour> m_lists;
+  std::vector<size_t> m_counts;
+};
+
+#endif //SIMILARITYINDEX_H
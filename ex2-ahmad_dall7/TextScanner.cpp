@@ -0,0 +1,293 @@
+#include "TextScanner.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#endif
+
+// the most digits a uint64_t mantissa takes without overflowing
+#define MAX_MANTISSA_DIGITS 19
+// powers of ten that are exact doubles
+#define MAX_EXACT_POWER 22
+// the largest integer every smaller one of is an exact double , 2^53
+#define MAX_EXACT_MANTISSA 9007199254740992ULL
+// tokens parse_double copies to the stack for strtod
+#define SHORT_TOKEN 64
+
+MappedFile::MappedFile (const std::string &path)
+/**
+ * mmap of the whole file , an empty file has nothing to map . without
+ * mmap , or when it fails , the file is read in one read
+ * @param path
+ */
+{
+#ifdef HAVE_MMAP
+  int fd = ::open (path.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return;
+    }
+  struct stat info;
+  if (fstat (fd, &info) == 0 && S_ISREG (info.st_mode))
+    {
+      m_size = (size_t) info.st_size;
+      void *data = m_size == 0 ? MAP_FAILED
+                                : mmap (nullptr, m_size, PROT_READ,
+                                        MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+        {
+          madvise (data, m_size, MADV_SEQUENTIAL);
+          m_data = (const char *) data;
+          m_mapped = true;
+          m_open = true;
+        }
+    }
+  close (fd);
+  if (m_open)
+    {
+      return;
+    }
+#endif
+  std::ifstream input (path, std::ifstream::in | std::ifstream::binary);
+  if (!input.is_open ())
+    {
+      return;
+    }
+  std::ostringstream content;
+  content << input.rdbuf ();
+  m_buffer = content.str ();
+  m_data = m_buffer.data ();
+  m_size = m_buffer.size ();
+  m_open = true;
+}
+
+MappedFile::~MappedFile ()
+{
+#ifdef HAVE_MMAP
+  if (m_mapped)
+    {
+      munmap ((void *) m_data, m_size);
+    }
+#endif
+}
+
+bool MappedFile::is_open () const
+{
+  return m_open;
+}
+
+const char *MappedFile::begin () const
+{
+  return m_data;
+}
+
+const char *MappedFile::end () const
+{
+  return m_data + m_size;
+}
+
+bool text_token::equals (const char *text) const
+{
+  size_t length = std::strlen (text);
+  return size () == length && std::memcmp (begin, text, length) == 0;
+}
+
+static bool is_space (char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+TextScanner::TextScanner (const char *begin, const char *end)
+    : m_position (begin), m_end (end)
+{
+}
+
+bool TextScanner::next_line (TextScanner &line)
+{
+  if (m_position == m_end)
+    {
+      return false;
+    }
+  const char *line_end = (const char *) std::memchr
+      (m_position, '\n', (size_t) (m_end - m_position));
+  if (line_end == nullptr)
+    {
+      line_end = m_end;
+    }
+  line = TextScanner (m_position, line_end);
+  m_position = line_end == m_end ? m_end : line_end + 1;
+  return true;
+}
+
+bool TextScanner::next_token (text_token &token)
+{
+  while (m_position != m_end && is_space (*m_position))
+    {
+      ++m_position;
+    }
+  if (m_position == m_end)
+    {
+      return false;
+    }
+  token.begin = m_position;
+  while (m_position != m_end && !is_space (*m_position))
+    {
+      ++m_position;
+    }
+  token.end = m_position;
+  return true;
+}
+
+static bool is_digit (char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static bool parse_with_strtod (const text_token &token, double &value)
+/**
+ * the slow path , a terminated copy of the token for strtod
+ * @param token
+ * @param value
+ * @return whether strtod took the whole token
+ */
+{
+  char short_copy[SHORT_TOKEN];
+  std::string long_copy;
+  const char *text = short_copy;
+  if (token.size () < SHORT_TOKEN)
+    {
+      std::memcpy (short_copy, token.begin, token.size ());
+      short_copy[token.size ()] = '\0';
+    }
+  else
+    {
+      long_copy = token.str ();
+      text = long_copy.c_str ();
+    }
+  char *parsed_end;
+  value = std::strtod (text, &parsed_end);
+  return parsed_end == text + token.size ();
+}
+
+bool parse_double (const text_token &token, double &value)
+/**
+ * [sign] digits [. digits] [e [sign] digits] . a mantissa of up to 2^53
+ * with a power of ten of up to 22 is one multiply or divide of two exact
+ * doubles , so it is correctly rounded like strtod (Clinger's fast path) .
+ * any other number of that form goes to strtod
+ * @param token
+ * @param value
+ * @return whether the token is a number
+ */
+{
+  const char *p = token.begin, *end = token.end;
+  bool negative = p != end && *p == '-';
+  if (p != end && (*p == '-' || *p == '+'))
+    {
+      ++p;
+    }
+  uint64_t mantissa = 0;
+  int digits = 0, scale = 0;
+  bool any_digit = false, exact = true;
+  for (; p != end && is_digit (*p); ++p, any_digit = true)
+    {
+      if (mantissa == 0 && *p == '0')
+        {
+          continue; // leading zeros
+        }
+      if (digits++ < MAX_MANTISSA_DIGITS)
+        {
+          mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+        }
+      else
+        {
+          exact = false;
+        }
+    }
+  if (p != end && *p == '.')
+    {
+      for (++p; p != end && is_digit (*p); ++p, any_digit = true)
+        {
+          if (mantissa == 0 && *p == '0')
+            {
+              --scale;
+              continue;
+            }
+          if (digits++ < MAX_MANTISSA_DIGITS)
+            {
+              mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+              --scale;
+            }
+          else
+            {
+              exact = false;
+            }
+        }
+    }
+  if (!any_digit)
+    {
+      return false;
+    }
+  if (p != end && (*p == 'e' || *p == 'E'))
+    {
+      ++p;
+      bool negative_exponent = p != end && *p == '-';
+      if (p != end && (*p == '-' || *p == '+'))
+        {
+          ++p;
+        }
+      if (p == end || !is_digit (*p))
+        {
+          return false;
+        }
+      int exponent = 0;
+      for (; p != end && is_digit (*p); ++p)
+        {
+          exponent = exponent < 10000 ? exponent * 10 + (*p - '0')
+                                      : exponent;
+        }
+      scale += negative_exponent ? -exponent : exponent;
+    }
+  if (p != end)
+    {
+      return false;
+    }
+  if (!exact || mantissa > MAX_EXACT_MANTISSA || scale > MAX_EXACT_POWER
+      || scale < -MAX_EXACT_POWER)
+    {
+      return parse_with_strtod (token, value);
+    }
+  static const double powers[MAX_EXACT_POWER + 1] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+      1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  value = scale < 0 ? (double) mantissa / powers[-scale]
+                    : (double) mantissa * powers[scale];
+  value = negative ? -value : value;
+  return true;
+}
+
+bool parse_int (const text_token &token, int &value)
+{
+  const char *p = token.begin;
+  bool negative = p != token.end && *p == '-';
+  if (p != token.end && (*p == '-' || *p == '+'))
+    {
+      ++p;
+    }
+  long long result = 0;
+  bool any_digit = false;
+  for (; p != token.end && is_digit (*p); ++p, any_digit = true)
+    {
+      result = result < INT32_MAX ? result * 10 + (*p - '0') : result;
+    }
+  value = (int) (negative ? -result : result);
+  return any_digit;
+}
@@ -0,0 +1,106 @@
+#ifndef TEXTSCANNER_H
+#define TEXTSCANNER_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * a read only view of a whole file , mapped into memory where the system
+ * supports it and read into one buffer where it does not . the file is
+ * not copied into strings , the loaders scan it in place.
+ */
+class MappedFile
+{
+ public:
+  /**
+   * opens and maps the file , is_open() tells whether it worked
+   * @param path
+   */
+  explicit MappedFile (const std::string &path);
+
+  ~MappedFile ();
+
+  MappedFile (const MappedFile &) = delete;
+
+  MappedFile &operator= (const MappedFile &) = delete;
+
+  bool is_open () const;
+
+  const char *begin () const;
+
+  const char *end () const;
+
+ private:
+  bool m_open = false;
+  bool m_mapped = false;
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  std::string m_buffer; // the file , when it is not mapped
+};
+
+/**
+ * a piece of the text , not terminated
+ */
+typedef struct text_token
+{
+    const char *begin = nullptr;
+    const char *end = nullptr;
+
+    size_t size () const
+    {
+      return (size_t) (end - begin);
+    }
+
+    bool equals (const char *text) const;
+
+    std::string str () const
+    {
+      return std::string (begin, end);
+    }
+} text_token;
+
+/**
+ * goes over text by lines and the lines by whitespace separated tokens ,
+ * like std::getline and operator>> without copying anything . a '\r'
+ * before a line end is whitespace.
+ */
+class TextScanner
+{
+ public:
+  TextScanner (const char *begin, const char *end);
+
+  /**
+   * @param line set to a scanner of the next line , without its '\n'
+   * @return false at the end of the text
+   */
+  bool next_line (TextScanner &line);
+
+  /**
+   * @param token set to the next token
+   * @return false if only whitespace is left
+   */
+  bool next_token (text_token &token);
+
+ private:
+  const char *m_position;
+  const char *m_end;
+};
+
+/**
+ * parses a whole token as a double , the same value std::stod gives for
+ * it . decimal numbers only , without nan , inf or hex
+ * @param token
+ * @param value
+ * @return false if the token is not such a number
+ */
+bool parse_double (const text_token &token, double &value);
+
+/**
+ * the integer at the start of the token , like atoi
+ * @param token
+ * @param value 0 when there are no digits
+ * @return false if there are no digits
+ */
+bool parse_int (const text_token &token, int &value);
+
+#endif //TEXTSCANNER_H
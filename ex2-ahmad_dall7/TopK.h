@@ -0,0 +1,84 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/**
+ * keeps the k items with the highest scores out of all the items pushed to
+ * it , in a bounded heap : n pushes cost O(n log k) and O(k) memory.
+ * of two items with the same score the one pushed first ranks higher , so
+ * the result only depends on the order of the pushes.
+ * any k is fine : with k = 0 nothing is kept , and with more than k pushes
+ * all of them are.
+ */
+template<typename T>
+class TopK
+{
+ public:
+  explicit TopK (size_t k) : m_k (k)
+  {
+  }
+
+  /**
+   * @param score
+   * @param item
+   * @return whether the item is in the top k for now
+   */
+  bool push (double score, const T &item)
+  {
+    entry e{score, m_pushed++, item};
+    if (m_heap.size () < m_k)
+      {
+        m_heap.push_back (e);
+        std::push_heap (m_heap.begin (), m_heap.end (), better);
+        return true;
+      }
+    // the front is the lowest of the kept ones
+    if (m_k == 0 || !better (e, m_heap.front ()))
+      {
+        return false;
+      }
+    std::pop_heap (m_heap.begin (), m_heap.end (), better);
+    m_heap.back () = e;
+    std::push_heap (m_heap.begin (), m_heap.end (), better);
+    return true;
+  }
+
+  /**
+   * @return the kept items and their scores , the highest first . the heap
+   * is empty after it
+   */
+  std::vector<std::pair<double, T>> take ()
+  {
+    std::sort_heap (m_heap.begin (), m_heap.end (), better);
+    std::vector<std::pair<double, T>> result;
+    result.reserve (m_heap.size ());
+    for (auto &e: m_heap)
+      {
+        result.emplace_back (e.score, std::move (e.item));
+      }
+    m_heap.clear ();
+    return result;
+  }
+
+ private:
+  typedef struct entry
+  {
+      double score;
+      size_t order;
+      T item;
+  } entry;
+
+  static bool better (const entry &a, const entry &b)
+  {
+    return a.score > b.score || (a.score == b.score && a.order < b.order);
+  }
+
+  size_t m_k;
+  size_t m_pushed = 0;
+  std::vector<entry> m_heap;
+};
+
+#endif //TOPK_H
@@ -0,0 +1,269 @@
+//
+// Benchmarks for the recommender system on a synthetic catalog.
+//
+// Usage: ./recommender_bench [benchmark ...]
+// Runs every benchmark when none is named. Build with
+// -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+//
+
+#include "RecommenderSystemLoader.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+
+#define BENCH_SEED 44
+#define BENCH_FEATURES 20
+#define BENCH_CLUSTERS 64
+#define CLUSTER_SPREAD 1.5
+#define LOAD_MOVIES 100000
+#define CF_MOVIES 4000
+#define CF_NEIGHBOURS 100
+#define CF_K 10
+// the index helps users who ranked many movies , the others mostly need
+// the full calculation
+#define CF_RANKS 1000
+#define BATCH_USERS 200
+// the movies of the users file , every user ranks some of them
+#define BATCH_RANKED 200
+#define RECALL_MOVIES 50000
+#define RECALL_USERS 200
+#define USER_RANKS 30
+#define FIRST_YEAR 1900
+#define YEARS 120
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since (bench_clock::time_point start)
+{
+  return std::chrono::duration<double> (bench_clock::now () - start).count ();
+}
+
+/**
+ * movies around BENCH_CLUSTERS random centers , features kept in range
+ */
+static std::vector<movie_record> synthetic_catalog (int movies)
+{
+  std::mt19937 rng (BENCH_SEED);
+  std::uniform_real_distribution<double> uniform (MIN_MOVIE_FEATURE,
+                                                  MAX_MOVIE_FEATURE);
+  std::normal_distribution<double> noise (0, CLUSTER_SPREAD);
+  std::uniform_int_distribution<int> cluster (0, BENCH_CLUSTERS - 1);
+  std::vector<std::vector<double>> centers (BENCH_CLUSTERS);
+  for (auto &center: centers)
+    {
+      for (int f = 0; f < BENCH_FEATURES; ++f)
+        {
+          center.push_back (uniform (rng));
+        }
+    }
+  std::vector<movie_record> records;
+  for (int i = 0; i < movies; ++i)
+    {
+      movie_record record{"movie" + std::to_string (i),
+                          FIRST_YEAR + i % YEARS, {}};
+      for (double center: centers[cluster (rng)])
+        {
+          double feature = center + noise (rng);
+          record.features.push_back (
+              std::min ((double) MAX_MOVIE_FEATURE,
+                        std::max ((double) MIN_MOVIE_FEATURE, feature)));
+        }
+      records.push_back (record);
+    }
+  return records;
+}
+
+static std::vector<RSUser>
+synthetic_users (const recommender_system_p &rs,
+                 const std::vector<sp_movie> &movies, int users,
+                 int user_ranks = USER_RANKS)
+{
+  std::mt19937 rng (BENCH_SEED + 1);
+  std::uniform_int_distribution<size_t> movie (0, movies.size () - 1);
+  std::uniform_int_distribution<int> rank (1, 10);
+  std::vector<RSUser> result;
+  for (int u = 0; u < users; ++u)
+    {
+      rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+      for (int r = 0; r < user_ranks; ++r)
+        {
+          ranks[movies[movie (rng)]] = rank (rng);
+        }
+      result.emplace_back ("user" + std::to_string (u), ranks, rs);
+    }
+  return result;
+}
+
+static void bench_load ()
+{
+  std::vector<movie_record> records = synthetic_catalog (LOAD_MOVIES);
+  std::string path = "recommender_bench_movies.txt";
+  double megabytes;
+  {
+    std::ofstream file (path);
+    for (const auto &record: records)
+      {
+        file << record.name << SEPARATOR << record.year;
+        for (double feature: record.features)
+          {
+            file << " " << feature;
+          }
+        file << "\n";
+      }
+    megabytes = (double) file.tellp () / 1e6;
+  }
+  bench_clock::time_point start = bench_clock::now ();
+  recommender_system_unique_p rs =
+      RecommenderSystemLoader::create_rs_from_movies_file (path);
+  double seconds = seconds_since (start);
+  std::remove (path.c_str ());
+  std::printf ("load: %d movies (%.1f MB) in %.3f s , %.0f MB/s\n",
+               LOAD_MOVIES, megabytes, seconds, megabytes / seconds);
+}
+
+static void bench_cf ()
+{
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (synthetic_catalog
+                                                     (CF_MOVIES));
+  std::vector<RSUser> users = synthetic_users (rs, movies, 1, CF_RANKS);
+  bench_clock::time_point start = bench_clock::now ();
+  sp_movie full = users[0].get_recommendation_by_cf (CF_K);
+  double full_seconds = seconds_since (start);
+  start = bench_clock::now ();
+  rs->build_similarity_index (CF_NEIGHBOURS);
+  double build_seconds = seconds_since (start);
+  start = bench_clock::now ();
+  sp_movie indexed = users[0].get_recommendation_by_cf (CF_K);
+  double indexed_seconds = seconds_since (start);
+  std::printf ("cf: %d movies , %d ranks , k %d: full %.2f ms , index of %d "
+               "neighbours %.2f ms (built in %.3f s)%s\n", CF_MOVIES,
+               CF_RANKS, CF_K,
+               full_seconds * 1e3, CF_NEIGHBOURS, indexed_seconds * 1e3,
+               build_seconds,
+               sp_movie_equal (full, indexed) ? "" : " , DIFFERENT movie");
+}
+
+static void bench_recall ()
+{
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (synthetic_catalog
+                                                     (RECALL_MOVIES));
+  std::vector<RSUser> users = synthetic_users (rs, movies, RECALL_USERS);
+  std::vector<sp_movie> exact;
+  bench_clock::time_point start = bench_clock::now ();
+  for (const RSUser &user: users)
+    {
+      exact.push_back (user.get_recommendation_by_content ());
+    }
+  double exact_seconds = seconds_since (start) / RECALL_USERS;
+
+  start = bench_clock::now ();
+  rs->build_content_index ();
+  std::printf ("recall: %d movies , %d users , full scan %.3f ms per user , "
+               "index built in %.3f s\n", RECALL_MOVIES, RECALL_USERS,
+               exact_seconds * 1e3, seconds_since (start));
+  for (size_t probes: {1, 2, 4, 8, 16, 32})
+    {
+      int found = 0;
+      start = bench_clock::now ();
+      for (size_t u = 0; u < users.size (); ++u)
+        {
+          found += sp_movie_equal
+              (rs->recommend_by_content_approximate (users[u], probes),
+               exact[u]);
+        }
+      std::printf ("  %2zu probes: recall@1 %.3f , %.3f ms per user\n",
+                   probes, (double) found / RECALL_USERS,
+                   seconds_since (start) / RECALL_USERS * 1e3);
+    }
+}
+
+static void bench_batch ()
+{
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (synthetic_catalog
+                                                     (CF_MOVIES));
+  std::vector<RSUser> users = synthetic_users
+      (rs, std::vector<sp_movie> (movies.begin (),
+                                  movies.begin () + BATCH_RANKED),
+       BATCH_USERS);
+  bench_clock::time_point start = bench_clock::now ();
+  std::vector<sp_movie> one_by_one;
+  for (const RSUser &user: users)
+    {
+      one_by_one.push_back (user.get_recommendation_by_cf (CF_K));
+    }
+  double single_seconds = seconds_since (start);
+  start = bench_clock::now ();
+  std::vector<sp_movie> batch = rs->recommend_all_by_cf (users, CF_K);
+  double batch_seconds = seconds_since (start);
+  std::printf ("batch: %d movies , %d users ranking %d of %d movies , k %d: "
+               "one by one %.1f ms , batch %.1f ms%s\n", CF_MOVIES,
+               BATCH_USERS, USER_RANKS, BATCH_RANKED, CF_K,
+               single_seconds * 1e3, batch_seconds * 1e3,
+               batch == one_by_one ? "" : " , DIFFERENT movies");
+}
+
+static void bench_exact ()
+{
+  recommender_system_p plain = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = plain->add_movies (synthetic_catalog
+                                                        (RECALL_MOVIES));
+  std::vector<RSUser> users = synthetic_users (plain, movies, RECALL_USERS);
+  std::vector<sp_movie> scanned;
+  bench_clock::time_point start = bench_clock::now ();
+  for (const RSUser &user: users)
+    {
+      scanned.push_back (user.get_recommendation_by_content ());
+    }
+  double scan_seconds = seconds_since (start) / RECALL_USERS;
+
+  plain->build_content_index ();
+  int same = 0;
+  start = bench_clock::now ();
+  for (size_t u = 0; u < users.size (); ++u)
+    {
+      same += sp_movie_equal (users[u].get_recommendation_by_content (),
+                              scanned[u]);
+    }
+  std::printf ("exact: %d movies , %d users , full scan %.3f ms per user , "
+               "pruned %.3f ms per user , %d of %d the same\n",
+               RECALL_MOVIES, RECALL_USERS, scan_seconds * 1e3,
+               seconds_since (start) / RECALL_USERS * 1e3, same,
+               RECALL_USERS);
+}
+
+int main (int argc, char **argv)
+{
+  std::map<std::string, std::function<void ()>> benchmarks = {
+      {"batch", bench_batch},
+      {"cf", bench_cf},
+      {"exact", bench_exact},
+      {"load", bench_load},
+      {"recall", bench_recall},
+  };
+
+  if (argc == 1)
+    {
+      for (const auto &it: benchmarks)
+        {
+          it.second ();
+        }
+      return EXIT_SUCCESS;
+    }
+  for (int i = 1; i < argc; ++i)
+    {
+      auto it = benchmarks.find (argv[i]);
+      if (it == benchmarks.end ())
+        {
+          std::cerr << "unknown benchmark: " << argv[i] << std::endl;
+          return EXIT_FAILURE;
+        }
+      it->second ();
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1021 @@
+//
+// Tests for the recommender system: a catalog added with add_movies gives
+// the same system as adding its movies one by one with add_movie, loading
+// it prints nothing, movies with a different number of features are
+// rejected, lookups by name and year find the movies of the system,
+// TopK selects like a stable sort for any k, the similarity index
+// predicts like the full calculation, the content index searching all
+// of its lists recommends like the full scan, also when it was built
+// before the system had movies, and the exact content search with the
+// index gives the movie of the full scan, ties and movies without
+// features included, scoring on several threads picks the movie of a
+// serial loop, the thread pool of parallel_for takes nested and
+// concurrent calls, and the batch
+// recommendations of all the users are the ones of each user, and
+// the top n recommendations are the first n of all the scores sorted, and
+// the profile a user keeps as it ranks movies recommends like its ranks,
+// and the parsers of the loaders read numbers like std::stod and reject
+// the files the old ones rejected.
+//
+// Usage: ./recommender_test
+//
+
+#include "Parallel.h"
+#include "RSUsersLoader.h"
+#include "TextScanner.h"
+#include "TopK.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#define SEED 38
+#define FEATURES 4
+#define LARGE_CATALOG 100000
+#define FIRST_YEAR 1900
+#define YEARS 120
+#define RANK_BUCKETS 10
+#define NEIGHBOURS 2
+// enough candidates that the recommendations score them on all the threads
+#define PARALLEL_CONTENT 70000
+#define PARALLEL_CF 4000
+
+static std::mt19937 rng (SEED);
+static int failures = 0;
+
+static void check (bool ok, const std::string &what)
+{
+  if (!ok)
+    {
+      ++failures;
+      std::cerr << "FAILED: " << what << std::endl;
+    }
+}
+
+static std::vector<movie_record> random_catalog (int movies,
+                                                bool fractions = false)
+{
+  std::uniform_real_distribution<double> fraction (MIN_MOVIE_FEATURE,
+                                                   MAX_MOVIE_FEATURE);
+  std::uniform_int_distribution<int> years (FIRST_YEAR,
+                                            FIRST_YEAR + YEARS - 1);
+  std::uniform_int_distribution<int> features (MIN_MOVIE_FEATURE,
+                                               MAX_MOVIE_FEATURE);
+  std::vector<movie_record> records;
+  for (int i = 0; i < movies; ++i)
+    {
+      movie_record record{"movie" + std::to_string (i), years (rng), {}};
+      for (int f = 0; f < FEATURES; ++f)
+        {
+          record.features.push_back (fractions ? fraction (rng)
+                                               : features (rng));
+        }
+      records.push_back (record);
+    }
+  return records;
+}
+
+/**
+ * the system of records , added one by one with add_movie
+ */
+static recommender_system_p one_by_one (const std::vector<movie_record>
+                                        &records)
+{
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::streambuf *out = std::cout.rdbuf (nullptr); // add_movie prints
+  for (const auto &record: records)
+    {
+      rs->add_movie (record.name, record.year, record.features);
+    }
+  std::cout.rdbuf (out);
+  return rs;
+}
+
+static std::string printed (const RecommenderSystem &rs)
+{
+  std::ostringstream out;
+  out << rs;
+  return out.str ();
+}
+
+/**
+ * ranks every third movie of records in rs
+ */
+static rank_map some_ranks (const RecommenderSystem &rs,
+                            const std::vector<movie_record> &records)
+{
+  rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+  for (size_t i = 0; i < records.size (); i += 3)
+    {
+      ranks[rs.get_movie (records[i].name, records[i].year)] =
+          (double) (1 + i % RANK_BUCKETS);
+    }
+  return ranks;
+}
+
+static void test_same_as_add_movie ()
+{
+  std::cout << "Checking add_movies against add_movie" << std::endl;
+  std::vector<movie_record> records = random_catalog (100);
+  // a repeated movie keeps its first features
+  records.push_back (records[5]);
+  records.back ().features.assign (FEATURES, MAX_MOVIE_FEATURE);
+  recommender_system_p expected = one_by_one (records);
+
+  recommender_system_p actual = std::make_shared<RecommenderSystem> ();
+  std::ostringstream output;
+  std::streambuf *out = std::cout.rdbuf (output.rdbuf ());
+  std::vector<sp_movie> movies = actual->add_movies (records);
+  std::cout.rdbuf (out);
+  check (output.str ().empty (), "add_movies prints nothing");
+  check (printed (*actual) == printed (*expected), "movie order");
+
+  bool same_movies = movies.size () == records.size ();
+  for (size_t i = 0; same_movies && i < records.size (); ++i)
+    {
+      same_movies = movies[i] == actual->get_movie (records[i].name,
+                                                    records[i].year);
+    }
+  check (same_movies, "returned movies");
+
+  RSUser expected_user ("expected", some_ranks (*expected, records),
+                        expected);
+  RSUser actual_user ("actual", some_ranks (*actual, records), actual);
+  check (sp_movie_equal (expected_user.get_recommendation_by_content (),
+                         actual_user.get_recommendation_by_content ()),
+         "content recommendation");
+  check (sp_movie_equal (expected_user.get_recommendation_by_cf (NEIGHBOURS),
+                         actual_user.get_recommendation_by_cf (NEIGHBOURS)),
+         "cf recommendation");
+
+  // adding to a system that already has movies , sorted input
+  std::vector<movie_record> more = random_catalog (150);
+  more.erase (more.begin (), more.begin () + 100);
+  std::vector<movie_record> all = records;
+  all.insert (all.end (), more.begin (), more.end ());
+  std::sort (more.begin (), more.end (),
+             [] (const movie_record &a, const movie_record &b)
+             { return Movie (a.name, a.year) < Movie (b.name, b.year); });
+  actual->add_movies (more);
+  check (printed (*actual) == printed (*one_by_one (all)),
+         "adding to a filled system");
+}
+
+static void test_large_catalog ()
+{
+  std::cout << "Checking a catalog of " << LARGE_CATALOG << " movies"
+            << std::endl;
+  std::vector<movie_record> records = random_catalog (LARGE_CATALOG);
+  std::string path = "recommender_test_movies.txt";
+  {
+    std::ofstream file (path);
+    for (const auto &record: records)
+      {
+        file << record.name << SEPARATOR << record.year;
+        for (double feature: record.features)
+          {
+            file << " " << feature;
+          }
+        file << "\n";
+      }
+  }
+  std::ostringstream output;
+  std::streambuf *out = std::cout.rdbuf (output.rdbuf ());
+  recommender_system_unique_p rs =
+      RecommenderSystemLoader::create_rs_from_movies_file (path);
+  std::cout.rdbuf (out);
+  std::remove (path.c_str ());
+  check (output.str ().empty (), "loading prints nothing");
+  bool found = true;
+  for (const auto &record: records)
+    {
+      found = found && rs->get_movie (record.name, record.year) != nullptr;
+    }
+  check (found, "every loaded movie is in the system");
+}
+
+static void test_feature_sizes ()
+{
+  std::cout << "Checking feature sizes" << std::endl;
+  std::vector<movie_record> records = random_catalog (10);
+  RecommenderSystem rs;
+  rs.add_movies (records);
+  std::string before = printed (rs);
+
+  std::vector<movie_record> more = random_catalog (20);
+  more.erase (more.begin (), more.begin () + 10);
+  more.back ().features.pop_back ();
+  bool thrown = false;
+  try
+    {
+      rs.add_movies (more);
+    }
+  catch (const std::runtime_error &)
+    {
+      thrown = true;
+    }
+  check (thrown && printed (rs) == before, "add_movies rejects all records");
+
+  thrown = false;
+  std::streambuf *out = std::cout.rdbuf (nullptr);
+  try
+    {
+      rs.add_movie ("longer", FIRST_YEAR,
+                    std::vector<double> (FEATURES + 1, MIN_MOVIE_FEATURE));
+    }
+  catch (const std::runtime_error &)
+    {
+      thrown = true;
+    }
+  std::cout.rdbuf (out);
+  check (thrown && printed (rs) == before, "add_movie rejects the movie");
+}
+
+static void test_lookups ()
+{
+  std::cout << "Checking lookups" << std::endl;
+  std::vector<movie_record> records = random_catalog (10);
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (records);
+  check (rs->get_movie (records[3].name, records[3].year) == movies[3],
+         "get_movie");
+  check (rs->get_movie (records[3].name, records[3].year + 1) == nullptr,
+         "get_movie of a missing movie");
+
+  std::streambuf *out = std::cout.rdbuf (nullptr);
+  sp_movie again = rs->add_movie (records[3].name, records[3].year,
+                                  records[4].features);
+  std::cout.rdbuf (out);
+  check (again == movies[3], "add_movie of a movie in the system");
+
+  RSUser user ("user", some_ranks (*rs, records), rs);
+  check (rs->predict_movie_score (user, std::make_shared<Movie> ("missing", 1),
+                                  NEIGHBOURS) == 0,
+         "prediction of a missing movie");
+}
+
+static void test_top_k ()
+{
+  std::cout << "Checking TopK" << std::endl;
+  // few distinct scores , so there are many ties
+  std::uniform_int_distribution<int> scores (0, 9);
+  std::vector<std::pair<double, int>> items;
+  for (int i = 0; i < 50; ++i)
+    {
+      items.emplace_back (scores (rng), i);
+    }
+  std::vector<std::pair<double, int>> sorted (items);
+  std::stable_sort (sorted.begin (), sorted.end (),
+                    [] (const std::pair<double, int> &a,
+                        const std::pair<double, int> &b)
+                    { return a.first > b.first; });
+  bool ok = true;
+  for (size_t k: {0, 1, 7, 50, 80})
+    {
+      TopK<int> top (k);
+      for (const auto &item: items)
+        {
+          top.push (item.first, item.second);
+        }
+      std::vector<std::pair<double, int>> expected
+          (sorted.begin (), sorted.begin () + std::min (k, sorted.size ()));
+      ok = ok && top.take () == expected;
+    }
+  check (ok, "top k of tied scores");
+
+  std::vector<movie_record> records = random_catalog (30);
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  rs->add_movies (records);
+  RSUser user ("user", some_ranks (*rs, records), rs);
+  sp_movie movie = rs->get_movie (records[1].name, records[1].year);
+  check (rs->predict_movie_score (user, movie, INT_MAX)
+         == rs->predict_movie_score (user, movie, 10)
+         && rs->predict_movie_score (user, movie, -1) == 0,
+         "prediction with k out of range");
+}
+
+/**
+ * predictions for every movie and cf recommendations of rs and of a
+ * system without an index must be the same
+ */
+static bool same_predictions (const recommender_system_p &rs,
+                              const std::vector<movie_record> &records,
+                              const rank_map &ranks)
+{
+  recommender_system_p plain = std::make_shared<RecommenderSystem> ();
+  plain->add_movies (records);
+  RSUser user ("user", ranks, rs);
+  RSUser plain_user ("user", ranks, plain);
+  bool same = true;
+  for (int k: {1, 3, NEIGHBOURS, 1000})
+    {
+      for (const auto &record: records)
+        {
+          same = same && user.get_prediction_score_for_movie
+              (record.name, record.year, k)
+                         == plain_user.get_prediction_score_for_movie
+                             (record.name, record.year, k);
+        }
+      same = same && sp_movie_equal (user.get_recommendation_by_cf (k),
+                                     plain_user.get_recommendation_by_cf (k));
+    }
+  return same;
+}
+
+static void test_similarity_index ()
+{
+  std::cout << "Checking the similarity index" << std::endl;
+  // fractions , so there are no equal similarities
+  std::vector<movie_record> records = random_catalog (300, true);
+  std::vector<movie_record> first (records.begin (), records.begin () + 200);
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  rs->add_movies (first);
+  rs->build_similarity_index (8, 3);
+  rank_map ranks = some_ranks (*rs, first);
+  check (same_predictions (rs, first, ranks), "built index");
+
+  // 50 more movies in bulk , then 50 one by one
+  rs->add_movies (std::vector<movie_record> (records.begin () + 200,
+                                             records.begin () + 250));
+  std::streambuf *out = std::cout.rdbuf (nullptr);
+  for (size_t i = 250; i < records.size (); ++i)
+    {
+      rs->add_movie (records[i].name, records[i].year, records[i].features);
+    }
+  std::cout.rdbuf (out);
+  check (same_predictions (rs, records, ranks), "index after adding movies");
+
+  recommender_system_p small = std::make_shared<RecommenderSystem> ();
+  small->add_movies (first);
+  small->build_similarity_index (1000, 1); // complete lists
+  check (same_predictions (small, first, ranks), "complete index");
+}
+
+static void test_content_index ()
+{
+  std::cout << "Checking the content index" << std::endl;
+  std::vector<movie_record> records = random_catalog (400, true);
+  std::vector<movie_record> first (records.begin (), records.begin () + 300);
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (first);
+  std::vector<RSUser> users;
+  for (size_t u = 0; u < 20; ++u)
+    {
+      rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+      for (size_t i = u, j = 0; i < movies.size (); i += 20 + u, ++j)
+        {
+          ranks[movies[i]] = (double) (1 + (j + u) % RANK_BUCKETS);
+        }
+      users.emplace_back ("user" + std::to_string (u), ranks, rs);
+    }
+
+  ivf_config config;
+  config.lists = 10;
+  config.threads = 2;
+  rs->build_content_index (config);
+  // 50 more movies in bulk , then 50 one by one
+  rs->add_movies (std::vector<movie_record> (records.begin () + 300,
+                                             records.begin () + 350));
+  std::streambuf *out = std::cout.rdbuf (nullptr);
+  for (size_t i = 350; i < records.size (); ++i)
+    {
+      rs->add_movie (records[i].name, records[i].year, records[i].features);
+    }
+  std::cout.rdbuf (out);
+
+  bool same = true, ranked = false;
+  int found = 0;
+  for (const RSUser &user: users)
+    {
+      sp_movie exact = rs->recommend_by_content (user);
+      same = same && rs->recommend_by_content_approximate (user, 10) == exact;
+      sp_movie approximate = rs->recommend_by_content_approximate (user, 2);
+      found += approximate == exact;
+      ranked = ranked || user.get_ranks ().count (approximate) != 0;
+    }
+  check (same, "all the lists give the full scan");
+  check (!ranked, "ranked movies are not recommended");
+  // the lists are clusters , two of ten should find the best mostly
+  check (found >= 10, "two lists find the best");
+}
+
+/**
+ * users of plain ranking the same movies as the users of rs , with the
+ * recommendations of the full scan of plain
+ */
+static bool same_as_scan (const recommender_system_p &rs,
+                          const recommender_system_p &plain,
+                          const std::vector<movie_record> &records,
+                          bool approximate)
+{
+  bool same = true;
+  for (size_t u = 1; u < 20; ++u)
+    {
+      rank_map ranks (0, sp_movie_hash, sp_movie_equal),
+          plain_ranks (0, sp_movie_hash, sp_movie_equal);
+      for (size_t i = u, j = 0; i < records.size (); i += 5 + u, ++j)
+        {
+          double rank = (double) (1 + (j + u) % RANK_BUCKETS);
+          ranks[rs->get_movie (records[i].name, records[i].year)] = rank;
+          plain_ranks[plain->get_movie (records[i].name,
+                                        records[i].year)] = rank;
+        }
+      RSUser user ("user", ranks, rs), plain_user ("user", plain_ranks,
+                                                   plain);
+      sp_movie found = approximate
+                       ? rs->recommend_by_content_approximate (user, 1)
+                       : rs->recommend_by_content (user);
+      sp_movie scanned = plain->recommend_by_content (plain_user);
+      same = same && found != nullptr
+             && found->get_name () == scanned->get_name ()
+             && found->get_year () == scanned->get_year ();
+    }
+  return same;
+}
+
+static void test_empty_content_index ()
+{
+  std::cout << "Checking the content index of an empty system" << std::endl;
+  // the first movie has no direction , it may not leave a zero centroid
+  std::vector<movie_record> records = random_catalog (300, true);
+  records.front ().features.assign (FEATURES, 0);
+  recommender_system_p plain = std::make_shared<RecommenderSystem> ();
+  plain->add_movies (records);
+
+  // built before any movie , the first one added sets its one list
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  rs->build_content_index ();
+  std::streambuf *out = std::cout.rdbuf (nullptr);
+  for (size_t i = 0; i < 100; ++i)
+    {
+      rs->add_movie (records[i].name, records[i].year, records[i].features);
+    }
+  std::cout.rdbuf (out);
+  rs->add_movies (std::vector<movie_record> (records.begin () + 100,
+                                             records.end ()));
+  check (same_as_scan (rs, plain, records, true),
+         "an index built empty searches the added movies");
+  check (same_as_scan (rs, plain, records, false),
+         "recommend_by_content after building an empty index");
+
+  // a list of every movie , the zero one among the first centroids
+  recommender_system_p seeded = std::make_shared<RecommenderSystem> ();
+  seeded->add_movies (records);
+  ivf_config config;
+  config.lists = records.size ();
+  config.iterations = 0;
+  seeded->build_content_index (config);
+  check (same_as_scan (seeded, plain, records, false),
+         "a movie without a direction seeds a centroid");
+}
+
+static void test_zero_movie_search ()
+{
+  std::cout << "Checking the exact search of a movie without features"
+            << std::endl;
+  // the preference points away from every movie but Zero , whose
+  // similarity 0 is the best , its list may not be skipped
+  std::vector<movie_record> records = {{"A", 2000, {1, 0}},
+                                       {"Zero", 2001, {0, 0}},
+                                       {"M", 2002, {0.292, 0.956}},
+                                       {"R1", 2003, {2, 0}},
+                                       {"R2", 2004, {1, 0}}};
+  bool same = true;
+  for (unsigned seed = 0; seed < 100; ++seed)
+    {
+      recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+      rs->add_movies (records);
+      ivf_config config;
+      config.lists = 2;
+      config.seed = seed;
+      rs->build_content_index (config);
+      rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+      ranks[rs->get_movie ("R1", 2003)] = 1;
+      ranks[rs->get_movie ("R2", 2004)] = 10;
+      RSUser user ("user", ranks, rs);
+      sp_movie found = rs->recommend_by_content (user);
+      same = same && found != nullptr && found->get_name () == "Zero";
+    }
+  check (same, "a movie without features is not pruned");
+}
+
+static void test_exact_content ()
+{
+  std::cout << "Checking the exact content search" << std::endl;
+  // integer features have many equal similarities , the first in movie
+  // order has to win them like in the scan
+  for (bool fractions: {false, true})
+    {
+      std::vector<movie_record> records = random_catalog (600, fractions);
+      std::vector<movie_record> first (records.begin (),
+                                       records.begin () + 500);
+      recommender_system_p plain = std::make_shared<RecommenderSystem> ();
+      plain->add_movies (records);
+      recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+      std::vector<sp_movie> movies = rs->add_movies (first);
+      ivf_config config;
+      config.lists = 16;
+      rs->build_content_index (config);
+      rs->add_movies (std::vector<movie_record> (records.begin () + 500,
+                                                 records.end ()));
+
+      bool same = true;
+      for (size_t u = 0; u < 30; ++u)
+        {
+          rank_map ranks (0, sp_movie_hash, sp_movie_equal),
+              plain_ranks (0, sp_movie_hash, sp_movie_equal);
+          // the first user ranks all alike , a zero preference vector
+          for (size_t i = u, j = 0; i < movies.size (); i += 7 + u, ++j)
+            {
+              double rank = u == 0 ? 5 : (double) (1 + (j * u) % RANK_BUCKETS);
+              ranks[movies[i]] = rank;
+              plain_ranks[plain->get_movie (movies[i]->get_name (),
+                                            movies[i]->get_year ())] = rank;
+            }
+          RSUser user ("user", ranks, rs), plain_user ("user", plain_ranks,
+                                                       plain);
+          sp_movie exact = rs->recommend_by_content (user);
+          sp_movie scanned = plain->recommend_by_content (plain_user);
+          same = same && exact != nullptr
+                 && exact->get_name () == scanned->get_name ()
+                 && exact->get_year () == scanned->get_year ();
+        }
+      check (same, fractions ? "exact search of fractions"
+                             : "exact search of integers");
+    }
+}
+
+static void test_parallel_scoring ()
+{
+  std::cout << "Checking parallel scoring" << std::endl;
+  // integer features , so the first of equal scores has to win
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  rs->set_threads (4); // even on one core
+  std::vector<sp_movie> movies = rs->add_movies (random_catalog
+                                                     (PARALLEL_CONTENT));
+  std::vector<RSUser> users;
+  for (size_t u = 0; u < 5; ++u)
+    {
+      rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+      for (size_t i = u; i < 200; i += 1 + u)
+        {
+          ranks[movies[i]] = (double) (1 + (i * u) % RANK_BUCKETS);
+        }
+      users.emplace_back ("user" + std::to_string (u), ranks, rs);
+    }
+  std::vector<sp_movie> scanned;
+  for (const RSUser &user: users)
+    {
+      scanned.push_back (rs->recommend_by_content (user));
+    }
+  // the exact search of the index is serial
+  rs->build_content_index ();
+  bool same = true;
+  for (size_t u = 0; u < users.size (); ++u)
+    {
+      same = same && rs->recommend_by_content (users[u]) == scanned[u];
+    }
+  check (same, "parallel content scan");
+
+  recommender_system_p cf = std::make_shared<RecommenderSystem> ();
+  cf->set_threads (4);
+  movies = cf->add_movies (random_catalog (PARALLEL_CF));
+  rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+  for (size_t i = 0; i < movies.size (); i += 40)
+    {
+      ranks[movies[i]] = (double) (1 + i % RANK_BUCKETS);
+    }
+  RSUser user ("user", ranks, cf);
+  std::sort (movies.begin (), movies.end (), [] (const sp_movie &a,
+                                                 const sp_movie &b)
+  {
+    return *a < *b;
+  });
+  for (int k: {1, 5})
+    {
+      sp_movie best = nullptr;
+      double best_score = 0;
+      for (const sp_movie &movie: movies)
+        {
+          if (ranks.count (movie) != 0)
+            {
+              continue;
+            }
+          double score = cf->predict_movie_score (user, movie, k);
+          if (best == nullptr || score > best_score)
+            {
+              best = movie;
+              best_score = score;
+            }
+        }
+      check (cf->recommend_by_cf (user, k) == best, "parallel cf , k "
+                                                    + std::to_string (k));
+    }
+}
+
+/**
+ * a parallel_for with a parallel_for in its body
+ * @return whether every item was taken once
+ */
+static bool nested_parallel_for ()
+{
+  std::vector<int> taken (1000, 0);
+  parallel_for (10, 4, 1, [&taken] (size_t begin, size_t end)
+  {
+    for (size_t outer = begin; outer < end; ++outer)
+      {
+        parallel_for (100, 4, 7, [&taken, outer] (size_t b, size_t e)
+        {
+          for (size_t i = b; i < e; ++i)
+            {
+              ++taken[outer * 100 + i];
+            }
+        });
+      }
+  });
+  return std::all_of (taken.begin (), taken.end (), [] (int t)
+  {
+    return t == 1;
+  });
+}
+
+static void test_thread_pool ()
+{
+  std::cout << "Checking the thread pool" << std::endl;
+  // callers on several threads at once share the pool
+  std::atomic<bool> all (true);
+  std::vector<std::thread> callers;
+  for (int c = 0; c < 3; ++c)
+    {
+      callers.emplace_back ([&all] ()
+                            {
+                              for (int round = 0; round < 50; ++round)
+                                {
+                                  if (!nested_parallel_for ())
+                                    {
+                                      all = false;
+                                    }
+                                }
+                            });
+    }
+  for (std::thread &t: callers)
+    {
+      t.join ();
+    }
+  check (all, "every item once");
+
+  bool thrown = false;
+  try
+    {
+      parallel_for (1000, 4, 10, [] (size_t begin, size_t)
+      {
+        if (begin == 500)
+          {
+            throw std::runtime_error ("body");
+          }
+      });
+    }
+  catch (const std::runtime_error &)
+    {
+      thrown = true;
+    }
+  check (thrown, "an exception of a body");
+  std::atomic<size_t> items (0);
+  parallel_for (1000, 4, 10, [&items] (size_t begin, size_t end)
+  {
+    items += end - begin;
+  });
+  check (items == 1000, "the pool works after an exception");
+}
+
+static void test_batch ()
+{
+  std::cout << "Checking batch recommendations" << std::endl;
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  rs->set_threads (3);
+  std::vector<sp_movie> movies = rs->add_movies (random_catalog (500));
+  // like RSUsersLoader , the users rank some of the same movies
+  std::vector<RSUser> users;
+  for (size_t u = 0; u < 25; ++u)
+    {
+      rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+      for (size_t i = u % 4; i < 60 && u != 0; i += 1 + u % 4)
+        {
+          ranks[movies[i * 7]] = (double) (1 + (i + u) % RANK_BUCKETS);
+        }
+      users.emplace_back ("user" + std::to_string (u), ranks, rs);
+    }
+
+  for (bool indexed: {false, true})
+    {
+      if (indexed)
+        {
+          rs->build_similarity_index (20);
+          rs->build_content_index ();
+        }
+      std::vector<sp_movie> by_content = rs->recommend_all_by_content (users);
+      bool same = by_content.size () == users.size ();
+      for (int k: {1, 4})
+        {
+          std::vector<sp_movie> by_cf = rs->recommend_all_by_cf (users, k);
+          same = same && by_cf.size () == users.size ();
+          for (size_t u = 0; same && u < users.size (); ++u)
+            {
+              same = rs->recommend_by_cf (users[u], k) == by_cf[u]
+                     && rs->recommend_by_content (users[u]) == by_content[u];
+            }
+        }
+      check (same, indexed ? "batch with indexes" : "batch");
+    }
+}
+
+static bool same_scored (const std::vector<scored_movie> &a,
+                         const std::vector<scored_movie> &b)
+{
+  bool same = a.size () == b.size ();
+  for (size_t i = 0; same && i < a.size (); ++i)
+    {
+      same = a[i].first == b[i].first && a[i].second == b[i].second;
+    }
+  return same;
+}
+
+static void test_top_n ()
+{
+  std::cout << "Checking top n recommendations" << std::endl;
+  // integer features , so there are equal scores
+  std::vector<movie_record> records = random_catalog (400);
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (records);
+  recommender_system_p indexed = std::make_shared<RecommenderSystem> ();
+  indexed->add_movies (records);
+  indexed->build_content_index ();
+  rank_map ranks = some_ranks (*rs, records);
+  RSUser user ("user", ranks, rs);
+  std::sort (movies.begin (), movies.end (), [] (const sp_movie &a,
+                                                 const sp_movie &b)
+  {
+    return *a < *b;
+  });
+
+  bool same = true;
+  size_t unranked = movies.size () - ranks.size ();
+  std::vector<scored_movie> all = rs->recommend_top_by_content (user, 1000);
+  same = same && all.size () == unranked
+         && all[0].first == rs->recommend_by_content (user);
+  for (size_t n: {0, 1, 10, 50})
+    {
+      std::vector<scored_movie> top = rs->recommend_top_by_content (user, n);
+      same = same && same_scored (top, std::vector<scored_movie>
+          (all.begin (), all.begin () + n));
+      // the index has its own movies , compared by name and year
+      std::vector<scored_movie> from_index =
+          indexed->recommend_top_by_content (RSUser ("user", ranks, indexed),
+                                             n);
+      same = same && from_index.size () == n;
+      for (size_t i = 0; same && i < n; ++i)
+        {
+          same = from_index[i].second == top[i].second
+                 && from_index[i].first->get_name ()
+                    == top[i].first->get_name ();
+        }
+    }
+  check (same, "top n by content");
+
+  same = true;
+  for (int k: {1, 3})
+    {
+      std::vector<scored_movie> expected;
+      for (const sp_movie &movie: movies)
+        {
+          if (ranks.count (movie) == 0)
+            {
+              expected.emplace_back (movie, rs->predict_movie_score
+                  (user, movie, k));
+            }
+        }
+      std::stable_sort (expected.begin (), expected.end (),
+                        [] (const scored_movie &a, const scored_movie &b)
+                        {
+                          return a.second > b.second;
+                        });
+      expected.resize (20);
+      same = same && same_scored (rs->recommend_top_by_cf (user, k, 20),
+                                  expected)
+             && expected[0].first == rs->recommend_by_cf (user, k);
+    }
+  check (same, "top n by cf");
+}
+
+static void test_profile ()
+{
+  std::cout << "Checking user profiles" << std::endl;
+  std::vector<movie_record> records = random_catalog (300, true);
+  recommender_system_p rs = std::make_shared<RecommenderSystem> ();
+  std::vector<sp_movie> movies = rs->add_movies (std::vector<movie_record>
+                                                     (records.begin (),
+                                                      records.end () - 20));
+  rank_map ranks (0, sp_movie_hash, sp_movie_equal);
+  for (size_t i = 0; i < movies.size (); i += 4)
+    {
+      ranks[movies[i]] = (double) (1 + i % RANK_BUCKETS);
+    }
+  RSUser user ("user", ranks, rs);
+  check (user.get_profile ().count == ranks.size (), "profile of the ranks");
+
+  // the last movies ranked one by one , a rank is only added once
+  std::streambuf *out = std::cout.rdbuf (nullptr);
+  for (size_t i = records.size () - 20; i < records.size (); ++i)
+    {
+      double rank = (double) (1 + i % RANK_BUCKETS);
+      user.add_movie_to_rs (records[i].name, records[i].year,
+                            records[i].features, rank);
+      user.add_movie_to_rs (records[i].name, records[i].year,
+                            records[i].features, 1);
+      ranks[rs->get_movie (records[i].name, records[i].year)] = rank;
+    }
+  std::cout.rdbuf (out);
+  check (user.get_profile ().count == ranks.size (), "profile of new ranks");
+
+  // a movie that is not in the system makes the system use the ranks
+  rank_map with_missing = ranks;
+  with_missing[std::make_shared<Movie> ("missing", FIRST_YEAR)] = 5;
+  RSUser from_ranks ("from ranks", with_missing, rs);
+  check (from_ranks.get_profile ().missing == 1, "missing movie");
+  std::vector<scored_movie> kept = rs->recommend_top_by_content (user, 10);
+  std::vector<scored_movie> calculated = rs->recommend_top_by_content
+      (from_ranks, 10);
+  bool same = kept.size () == calculated.size ();
+  for (size_t i = 0; same && i < kept.size (); ++i)
+    {
+      same = kept[i].first == calculated[i].first
+             && std::abs (kept[i].second - calculated[i].second) < 1e-12;
+    }
+  check (same, "profile recommends like the ranks");
+
+  // equal ranks have a zero preference , every movie scores 0 and the
+  // first unranked one wins , like the calculation from the ranks
+  rank_map equal (0, sp_movie_hash, sp_movie_equal);
+  for (size_t i = 0; i < movies.size (); i += 2)
+    {
+      equal[movies[i]] = 7;
+    }
+  RSUser equal_user ("equal", equal, rs);
+  equal[std::make_shared<Movie> ("missing", FIRST_YEAR)] = 7;
+  RSUser equal_from_ranks ("equal from ranks", equal, rs);
+  kept = rs->recommend_top_by_content (equal_user, 10);
+  calculated = rs->recommend_top_by_content (equal_from_ranks, 10);
+  same = kept.size () == calculated.size ();
+  for (size_t i = 0; same && i < kept.size (); ++i)
+    {
+      same = kept[i].first == calculated[i].first && kept[i].second == 0
+             && calculated[i].second == 0;
+    }
+  check (same && rs->recommend_by_content (equal_user)
+                 == rs->recommend_by_content (equal_from_ranks),
+         "profile of equal ranks recommends like the ranks");
+}
+
+static void write_file (const std::string &path, const std::string &text)
+{
+  std::ofstream file (path, std::ofstream::binary);
+  file << text;
+}
+
+template<typename Load>
+static bool throws (Load load, const std::string &what)
+{
+  try
+    {
+      load ();
+    }
+  catch (const std::runtime_error &e)
+    {
+      return what == e.what ();
+    }
+  return false;
+}
+
+static void test_parsers ()
+{
+  std::cout << "Checking the parsers" << std::endl;
+  std::vector<std::string> numbers = {
+      "7", "10", "1.5", "-2.25", "+3", "0.1", "0.30000000000000004",
+      "9.999999999999999", "1e1", "2.5E-1", "000123.4500", ".5", "5.",
+      "123456789012345678901234567890", "1e-30",
+      "0.000000000000000000000000000001"};
+  std::uniform_real_distribution<double> feature (MIN_MOVIE_FEATURE,
+                                                  MAX_MOVIE_FEATURE);
+  for (int i = 0; i < 1000; ++i)
+    {
+      std::ostringstream number;
+      number.precision (1 + i % 17);
+      number << feature (rng);
+      numbers.push_back (number.str ());
+    }
+  bool same = true;
+  for (const std::string &number: numbers)
+    {
+      double value;
+      text_token token{number.data (), number.data () + number.size ()};
+      same = same && parse_double (token, value)
+             && value == std::stod (number);
+    }
+  check (same, "parse_double is std::stod");
+  bool rejected = true;
+  for (std::string number: {"", "-", ".", "e5", "1e", "1x", "nan", "inf",
+                            "0x10", "1..2"})
+    {
+      double value;
+      text_token token{number.data (), number.data () + number.size ()};
+      rejected = rejected && !parse_double (token, value);
+    }
+  check (rejected, "parse_double rejects what is not a number");
+
+  // windows line ends , blank lines and no line end at the end
+  std::string path = "recommender_test_parse.txt";
+  write_file (path, "Titanic-1997 7 2 9 1\r\n\r\n"
+                    "Twilight-2008 2 2.5 3 10\n   \nBatman-2022 1 1 1 1");
+  recommender_system_unique_p rs =
+      RecommenderSystemLoader::create_rs_from_movies_file (path);
+  check (printed (*rs) == "Titanic (1997)\nTwilight (2008)\n"
+                          "Batman (2022)\n", "loaded movies");
+  std::string users_path = "recommender_test_users.txt";
+  write_file (users_path, "Titanic-1997 Twilight-2008 Batman-2022\r\n"
+                          "ann 5 NA 2.5\r\nbob NA NA 10\n");
+  std::vector<RSUser> users = RSUsersLoader::create_users_from_file
+      (users_path, std::move (rs));
+  check (users.size () == 2 && users[0].get_name () == "ann"
+         && users[0].get_ranks ().size () == 2
+         && users[1].get_ranks ().size () == 1, "loaded users");
+
+  for (std::string line: {"Titanic-1997 7 2 9 11", "Titanic-1997 7 2 x 1",
+                          "Titanic-1997 7 0.5 9 1"})
+    {
+      write_file (path, line);
+      check (throws ([&] ()
+                     {
+                       RecommenderSystemLoader::create_rs_from_movies_file
+                           (path);
+                     }, FEATURE_ERR), "rejects " + line);
+    }
+  for (std::string line: {"ann 5 11", "ann five NA"})
+    {
+      write_file (users_path, "Titanic-1997 Twilight-2008\n" + line);
+      write_file (path, "Titanic-1997 7 2 9 1\nTwilight-2008 2 2 3 1\n");
+      check (throws ([&] ()
+                     {
+                       RSUsersLoader::create_users_from_file
+                           (users_path,
+                            RecommenderSystemLoader::create_rs_from_movies_file
+                                (path));
+                     }, "Rank is not in range"), "rejects " + line);
+    }
+  std::remove (path.c_str ());
+  std::remove (users_path.c_str ());
+  check (throws ([&] ()
+                 {
+                   RecommenderSystemLoader::create_rs_from_movies_file (path);
+                 }, FILE_ERR), "rejects a missing file");
+}
+
+int main ()
+{
+  try
+    {
+      test_same_as_add_movie ();
+      test_large_catalog ();
+      test_feature_sizes ();
+      test_lookups ();
+      test_top_k ();
+      test_similarity_index ();
+      test_content_index ();
+      test_empty_content_index ();
+      test_zero_movie_search ();
+      test_exact_content ();
+      test_parallel_scoring ();
+      test_thread_pool ();
+      test_batch ();
+      test_top_n ();
+      test_profile ();
+      test_parsers ();
+    }
+  catch (const std::exception &e)
+    {
+      std::cerr << "unexpected exception: " << e.what () << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  if (failures != 0)
+    {
+      std::cerr << failures << " checks failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+  std::cout << "All recommender checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}